@@ -1,95 +1,598 @@
 #include "syslog.h"
+#include "syslog_alloc.h"
 #include "time.h"
 
-typedef struct bench_clock_t {
-	float start_time;
-	float end_time;
-} bench_clock_t;
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
 
-float get_current_time() {
-	return (float) clock()/CLOCKS_PER_SEC;
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_PERF_EVENTS 1
+#endif
+
+// Runs every corpus twice: once timed as a whole for throughput, and once
+// timing each message on its own for the latency percentiles. Timing every
+// message costs a little, so mixing the two would understate throughput.
+//
+//   ./benchmark [--json] [--perf] [--messages N] [--warmup N] [corpus files...]
+//
+// A corpus file has one message per line. Without any files a built in set
+// of corpora is used.
+//
+// --perf also counts cycles, instructions, branches and cache misses with
+// perf_event_open around the throughput pass. Counters the kernel or the
+// machine won't give us are reported as missing rather than failing the run.
+//
+// Built with make benchmark DEFINES=-DSYSLOG_ALLOC_STATS it also reports
+// allocations, bytes and peak live bytes per message.
+
+#define BUILTIN_VARIANTS 4096
+#define LARGE_MESSAGE_SIZE 8192
+
+typedef struct corpus_t {
+	const char* name;
+	char** messages;
+	size_t* lengths;
+	size_t count;
+	size_t capacity;
+	size_t total_bytes;
+} corpus_t;
+
+enum {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_BRANCHES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_L1D_MISSES,
+	COUNTER_LLC_MISSES,
+	NUM_COUNTERS
+};
+
+typedef struct perf_counters_t {
+	int fds[NUM_COUNTERS];
+	// -1 when a counter could not be read
+	double values[NUM_COUNTERS];
+} perf_counters_t;
+
+typedef struct bench_result_t {
+	size_t messages;
+	size_t failures;
+	size_t bytes;
+	double seconds;
+	double cycles;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+	int have_counters;
+	// Only filled in when built with -DSYSLOG_ALLOC_STATS
+	double allocations_per_message;
+	double bytes_per_message;
+	int64_t peak_live_bytes;
+	double counters[NUM_COUNTERS];
+} bench_result_t;
+
+static double cycles_per_ns = 0;
+
+uint64_t monotonic_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+uint64_t read_cycles() {
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return monotonic_ns();
+#endif
 }
 
-void start_clock(bench_clock_t * bench_clock) {
-	bench_clock->start_time = get_current_time();
+// The TSC ticks at a fixed rate that is close enough to the core clock to
+// report cycles per byte, and it is much cheaper to read per message than the
+// monotonic clock. Work out how fast it goes once up front.
+void calibrate_cycles() {
+	uint64_t start_ns = monotonic_ns();
+	uint64_t start_cycles = read_cycles();
+
+	while (monotonic_ns() - start_ns < 100000000ULL) {
+	}
+
+	uint64_t elapsed_ns = monotonic_ns() - start_ns;
+	cycles_per_ns = (double) (read_cycles() - start_cycles) / elapsed_ns;
 }
 
-void end_clock(bench_clock_t * bench_clock) {
-	bench_clock->end_time = get_current_time();
+#ifdef HAVE_PERF_EVENTS
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} COUNTER_EVENTS[NUM_COUNTERS] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+#endif
+
+// Counters are opened one by one rather than as a group, so a machine that is
+// missing one (VMs often lack the cache events) still reports the others.
+void perf_open(perf_counters_t * counters) {
+	int i;
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		counters->fds[i] = -1;
+
+#ifdef HAVE_PERF_EVENTS
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = COUNTER_EVENTS[i].type;
+		attr.config = COUNTER_EVENTS[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		counters->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
 }
 
-float get_clock_elapsed_time(bench_clock_t * bench_clock) {
-	float time_elapsed = bench_clock->end_time - bench_clock->start_time;
-	if (time_elapsed < 0) {
-		return 0.0;
+int perf_available(const perf_counters_t * counters) {
+	int i;
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		if (counters->fds[i] >= 0) {
+			return 1;
+		}
 	}
-	return time_elapsed;
+	return 0;
 }
 
-void reset_clock(bench_clock_t * bench_clock) {
-	bench_clock->start_time = 0;
-	bench_clock->end_time = 0;
+void perf_start(perf_counters_t * counters) {
+#ifdef HAVE_PERF_EVENTS
+	int i;
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		if (counters->fds[i] >= 0) {
+			ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
 }
 
-void benchmark(int num_messages, bench_clock_t * bench_clock) {
-	char * mm = "<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID Logging message...";
+void perf_stop(perf_counters_t * counters) {
+	int i;
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		counters->values[i] = -1;
+
+#ifdef HAVE_PERF_EVENTS
+		if (counters->fds[i] < 0) {
+			continue;
+		}
+
+		ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
 
-	start_clock(bench_clock);
+		// value, time enabled, time running
+		uint64_t data[3];
+		if (read(counters->fds[i], data, sizeof(data)) != sizeof(data) || !data[2]) {
+			continue;
+		}
 
+		// The kernel multiplexes when there are more counters than registers,
+		// so scale up to the whole time the counter was enabled
+		counters->values[i] = (double) data[0] * data[1] / data[2];
+#endif
+	}
+}
+
+void perf_close(perf_counters_t * counters) {
+#ifdef HAVE_PERF_EVENTS
 	int i;
-	for (i = 0; i < num_messages; i++) {
-		syslog_message_t m = {};
-		if (!parse_syslog_message_t(mm, &m)) {
-			printf("Failed to parse syslog message");
-		} else {
-			free_syslog_message_t(&m);
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		if (counters->fds[i] >= 0) {
+			close(counters->fds[i]);
 		}
 	}
+#endif
+}
+
+void corpus_add(corpus_t * corpus, const char* message, size_t length) {
+	if (corpus->count == corpus->capacity) {
+		corpus->capacity = corpus->capacity ? corpus->capacity * 2 : 256;
+		corpus->messages = realloc(corpus->messages, sizeof(char*) * corpus->capacity);
+		corpus->lengths = realloc(corpus->lengths, sizeof(size_t) * corpus->capacity);
+	}
 
-	/* Do work */
+	char* copy = malloc(length + 1);
+	memcpy(copy, message, length);
+	copy[length] = 0;
 
-	end_clock(bench_clock);
+	corpus->messages[corpus->count] = copy;
+	corpus->lengths[corpus->count] = length;
+	corpus->count++;
+	corpus->total_bytes += length;
 }
 
-void benchmark_with_structured_data(int num_messages, bench_clock_t * bench_clock) {
-	char * mm = "<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"] Logging message...";
+void free_corpus(corpus_t * corpus) {
+	size_t i;
+	for (i = 0; i < corpus->count; i++) {
+		free(corpus->messages[i]);
+	}
+
+	free(corpus->messages);
+	free(corpus->lengths);
+}
+
+int load_corpus(const char* path, corpus_t * corpus) {
+	FILE * file = fopen(path, "r");
+	if (!file) {
+		return 0;
+	}
+
+	const char* slash = strrchr(path, '/');
+	corpus->name = slash ? slash + 1 : path;
+
+	char* line = NULL;
+	size_t line_capacity = 0;
+	ssize_t length;
+
+	while ((length = getline(&line, &line_capacity, file)) >= 0) {
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			length--;
+		}
+
+		if (length > 0) {
+			corpus_add(corpus, line, length);
+		}
+	}
+
+	free(line);
+	fclose(file);
+
+	return corpus->count > 0;
+}
+
+// The built in corpora spread over a few thousand distinct messages so a run
+// is not just the same bytes sitting in L1.
+void build_builtin_corpora(corpus_t * corpora, size_t * count) {
+	char buf[LARGE_MESSAGE_SIZE + 256];
+	char body[LARGE_MESSAGE_SIZE + 1];
+	int i, j;
+
+	memset(body, 'x', LARGE_MESSAGE_SIZE);
+	body[LARGE_MESSAGE_SIZE] = 0;
+
+	corpus_t * typical = &corpora[(*count)++];
+	typical->name = "typical";
+	corpus_t * short_header = &corpora[(*count)++];
+	short_header->name = "short_header";
+	corpus_t * wide_sd = &corpora[(*count)++];
+	wide_sd->name = "wide_sd";
+	corpus_t * escaped = &corpora[(*count)++];
+	escaped->name = "escaped";
+	corpus_t * rfc3164 = &corpora[(*count)++];
+	rfc3164->name = "rfc3164";
+	corpus_t * nil_heavy = &corpora[(*count)++];
+	nil_heavy->name = "nil_heavy";
+	corpus_t * large = &corpora[(*count)++];
+	large->name = "large_8k";
 
-	start_clock(bench_clock);
+	for (i = 0; i < BUILTIN_VARIANTS; i++) {
+		int n;
 
+		n = snprintf(buf, sizeof(buf), i & 1
+			? "<165>1 2016-12-16T12:00:00.000Z hostname-%d appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"%d\"] Logging message..."
+			: "<165>1 2016-12-16T12:00:00.000Z hostname-%d appname PROCID MSGID - Logging message %d...", i % 200, i);
+		corpus_add(typical, buf, n);
+
+		n = snprintf(buf, sizeof(buf), "<%d>1 - h%d a - - - m", i % 192, i % 50);
+		corpus_add(short_header, buf, n);
+
+		n = snprintf(buf, sizeof(buf), "<14>1 2016-12-16T12:00:00.000+01:00 host-%d app 1234 ID", i % 100);
+		for (j = 0; j < 8; j++) {
+			n += snprintf(buf + n, sizeof(buf) - n, " [sd%d@32473 a=\"%d\" bb=\"value %d\" ccc=\"x\" dddd=\"%d\" e=\"y\" ff=\"z\" ggg=\"%d\" hhhh=\"w\"]", j, i, j, i + j, i * j);
+		}
+		// RFC5424 has no space between SD elements
+		char* space;
+		while ((space = strstr(buf, "] [")) != NULL) {
+			memmove(space + 1, space + 2, strlen(space + 2) + 1);
+			n--;
+		}
+		n += snprintf(buf + n, sizeof(buf) - n, " wide structured data");
+		corpus_add(wide_sd, buf, n);
+
+		n = snprintf(buf, sizeof(buf), "<14>1 - host app - - [esc@1 path=\"C:\\\\logs\\\\%d\" quote=\"say \\\"hi\\\"\" bracket=\"[%d\\]\"] escaped", i, i);
+		corpus_add(escaped, buf, n);
+
+		n = snprintf(buf, sizeof(buf), "<34>Oct %2d 22:14:15 mymachine-%d su: 'su root' failed for lonvick on /dev/pts/%d", i % 28 + 1, i % 100, i % 8);
+		corpus_add(rfc3164, buf, n);
+
+		n = snprintf(buf, sizeof(buf), i & 1 ? "<%d>1 - - - - - -" : "<%d>1 - - - - - - %d", i % 192, i);
+		corpus_add(nil_heavy, buf, n);
+
+		if (i < BUILTIN_VARIANTS / 8) {
+			n = snprintf(buf, sizeof(buf), "<14>1 2016-12-16T12:00:00Z host-%d app - - - %s", i, body);
+			corpus_add(large, buf, n);
+		}
+	}
+}
+
+int compare_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+uint64_t percentile(const uint64_t * sorted, size_t count, double p) {
+	size_t index = (size_t) (p * (count - 1));
+	return sorted[index];
+}
+
+size_t parse_one(corpus_t * corpus, size_t i) {
 	syslog_message_t m = {};
+	if (!parse_syslog_message_t(corpus->messages[i], &m)) {
+		return 0;
+	}
+
+	free_syslog_message_t(&m);
+	return 1;
+}
+
+void benchmark(corpus_t * corpus, size_t num_messages, size_t warmup, perf_counters_t * counters, bench_result_t * result) {
+	size_t i;
+
+	memset(result, 0, sizeof(bench_result_t));
+
+	for (i = 0; i < warmup; i++) {
+		parse_one(corpus, i % corpus->count);
+	}
+
+	// Throughput
+	if (counters) {
+		perf_start(counters);
+	}
+
+	uint64_t start_ns = monotonic_ns();
+	uint64_t start_cycles = read_cycles();
 
-	int i;
 	for (i = 0; i < num_messages; i++) {
-		if (!parse_syslog_message_t(mm, &m)) {
-			printf("Failed to parse syslog message");
-		} else {
-			free_syslog_message_t(&m);
+		size_t index = i % corpus->count;
+		result->failures += !parse_one(corpus, index);
+		result->bytes += corpus->lengths[index];
+	}
+
+	result->cycles = read_cycles() - start_cycles;
+	result->seconds = (monotonic_ns() - start_ns) / 1e9;
+	result->messages = num_messages;
+
+	if (counters) {
+		perf_stop(counters);
+		result->have_counters = 1;
+		memcpy(result->counters, counters->values, sizeof(result->counters));
+	}
+
+#ifndef HAVE_RDTSC
+	// read_cycles is the monotonic clock here, so this is nanoseconds
+	result->cycles = 0;
+#endif
+
+	// Latency
+	uint64_t * latencies = malloc(sizeof(uint64_t) * num_messages);
+
+	for (i = 0; i < num_messages; i++) {
+		uint64_t before = read_cycles();
+		parse_one(corpus, i % corpus->count);
+		latencies[i] = read_cycles() - before;
+	}
+
+	qsort(latencies, num_messages, sizeof(uint64_t), compare_u64);
+
+	result->p50_ns = percentile(latencies, num_messages, 0.50) / cycles_per_ns;
+	result->p99_ns = percentile(latencies, num_messages, 0.99) / cycles_per_ns;
+	result->p999_ns = percentile(latencies, num_messages, 0.999) / cycles_per_ns;
+
+	free(latencies);
+
+#ifdef SYSLOG_ALLOC_STATS
+	// One untimed pass over the corpus, the stats make every allocation a
+	// little slower
+	int64_t peak = 0;
+	syslog_alloc_stats_t stats;
+	uint64_t allocations = 0;
+	uint64_t bytes = 0;
+
+	for (i = 0; i < corpus->count; i++) {
+		syslog_alloc_stats_reset();
+		parse_one(corpus, i);
+		syslog_alloc_stats(&stats);
+
+		allocations += stats.allocations + stats.reallocations;
+		bytes += stats.bytes_allocated;
+		if (stats.peak_live_bytes - stats.live_bytes > peak) {
+			peak = stats.peak_live_bytes - stats.live_bytes;
 		}
 	}
 
-	end_clock(bench_clock);
+	result->allocations_per_message = (double) allocations / corpus->count;
+	result->bytes_per_message = (double) bytes / corpus->count;
+	result->peak_live_bytes = peak;
+#endif
+}
+
+// a / b, or -1 when either counter is missing
+double counter_ratio(const bench_result_t * result, int a, int b) {
+	if (result->counters[a] < 0 || result->counters[b] <= 0) {
+		return -1;
+	}
+	return result->counters[a] / result->counters[b];
+}
+
+double counter_per_message(const bench_result_t * result, int a) {
+	if (result->counters[a] < 0) {
+		return -1;
+	}
+	return result->counters[a] / result->messages;
+}
+
+void print_counter(const char* label, const char* format, double value) {
+	printf("  %s ", label);
+	if (value < 0) {
+		printf("n/a");
+	} else {
+		printf(format, value);
+	}
+}
+
+void print_json_counter(const char* name, double value) {
+	if (value < 0) {
+		printf(", \"%s\": null", name);
+	} else {
+		printf(", \"%s\": %.4f", name, value);
+	}
+}
+
+void print_result(const corpus_t * corpus, const bench_result_t * result) {
+	printf("%-14s %9.0f msgs/s %8.2f MB/s %7.2f cycles/byte  p50 %6llu ns  p99 %6llu ns  p999 %6llu ns",
+		corpus->name,
+		result->messages / result->seconds,
+		result->bytes / result->seconds / 1e6,
+		result->bytes ? result->cycles / result->bytes : 0,
+		(unsigned long long) result->p50_ns,
+		(unsigned long long) result->p99_ns,
+		(unsigned long long) result->p999_ns);
+
+	if (result->failures) {
+		printf("  (%zu failed to parse)", result->failures);
+	}
+
+	printf("\n");
+
+#ifdef SYSLOG_ALLOC_STATS
+	printf("%-14s  allocations/msg %.2f  bytes/msg %.0f  peak live bytes %lld\n", "",
+		result->allocations_per_message, result->bytes_per_message, (long long) result->peak_live_bytes);
+#endif
+
+	if (result->have_counters) {
+		printf("%-14s", "");
+		print_counter("IPC", "%.2f", counter_ratio(result, COUNTER_INSTRUCTIONS, COUNTER_CYCLES));
+		print_counter("instructions/msg", "%.0f", counter_per_message(result, COUNTER_INSTRUCTIONS));
+		double miss_rate = counter_ratio(result, COUNTER_BRANCH_MISSES, COUNTER_BRANCHES);
+		print_counter("branch misses", "%.2f%%", miss_rate < 0 ? -1 : miss_rate * 100);
+		print_counter("L1d misses/msg", "%.2f", counter_per_message(result, COUNTER_L1D_MISSES));
+		print_counter("LLC misses/msg", "%.3f", counter_per_message(result, COUNTER_LLC_MISSES));
+		printf("\n");
+	}
+}
+
+void print_json_result(const corpus_t * corpus, const bench_result_t * result, int last) {
+	printf("    {\"name\": \"%s\", \"messages\": %zu, \"failures\": %zu, \"bytes\": %zu, \"seconds\": %f, "
+		"\"msgs_per_sec\": %.0f, \"bytes_per_sec\": %.0f, \"cycles_per_byte\": %.3f, "
+		"\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu",
+		corpus->name,
+		result->messages,
+		result->failures,
+		result->bytes,
+		result->seconds,
+		result->messages / result->seconds,
+		result->bytes / result->seconds,
+		result->bytes ? result->cycles / result->bytes : 0,
+		(unsigned long long) result->p50_ns,
+		(unsigned long long) result->p99_ns,
+		(unsigned long long) result->p999_ns);
+
+#ifdef SYSLOG_ALLOC_STATS
+	printf(", \"allocations_per_msg\": %.2f, \"bytes_per_msg\": %.0f, \"peak_live_bytes\": %lld",
+		result->allocations_per_message, result->bytes_per_message, (long long) result->peak_live_bytes);
+#endif
+
+	if (result->have_counters) {
+		print_json_counter("ipc", counter_ratio(result, COUNTER_INSTRUCTIONS, COUNTER_CYCLES));
+		print_json_counter("instructions_per_msg", counter_per_message(result, COUNTER_INSTRUCTIONS));
+		print_json_counter("branch_miss_rate", counter_ratio(result, COUNTER_BRANCH_MISSES, COUNTER_BRANCHES));
+		print_json_counter("l1d_misses_per_msg", counter_per_message(result, COUNTER_L1D_MISSES));
+		print_json_counter("llc_misses_per_msg", counter_per_message(result, COUNTER_LLC_MISSES));
+	}
+
+	printf("}%s\n", last ? "" : ",");
 }
 
 int main(int argc, char* argv[]) {
-	bench_clock_t bench_clock = {};
+	corpus_t corpora[64] = {};
+	size_t num_corpora = 0;
+	size_t num_messages = 1000000;
+	size_t warmup = 100000;
+	int json = 0;
+	int perf = 0;
 
-	int num_messages = 12540000;
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--json")) {
+			json = 1;
+		} else if (!strcmp(argv[i], "--perf")) {
+			perf = 1;
+		} else if (!strcmp(argv[i], "--messages") && i + 1 < argc) {
+			num_messages = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			warmup = strtoul(argv[++i], NULL, 10);
+		} else if (num_corpora < sizeof(corpora) / sizeof(corpora[0])) {
+			if (!load_corpus(argv[i], &corpora[num_corpora])) {
+				fprintf(stderr, "Could not load any messages from %s\n", argv[i]);
+				return 1;
+			}
+			num_corpora++;
+		}
+	}
 
-	benchmark(num_messages, &bench_clock);
-	{
-		float elapsed_time = get_clock_elapsed_time(&bench_clock);
-		int mps = num_messages / elapsed_time;
+	if (!num_messages) {
+		fprintf(stderr, "--messages needs to be at least 1\n");
+		return 1;
+	}
 
-		printf("Took %f to process %d messages without structured data, which is %d messages per second\n", elapsed_time, num_messages, mps);
+	if (!num_corpora) {
+		build_builtin_corpora(corpora, &num_corpora);
 	}
-	reset_clock(&bench_clock);
 
-	benchmark_with_structured_data(num_messages, &bench_clock);
-	{
-		float elapsed_time = get_clock_elapsed_time(&bench_clock);
-		int mps = num_messages / elapsed_time;
+	calibrate_cycles();
 
-		printf("Took %f to process %d messages with structured data, which is %d messages per second\n", elapsed_time, num_messages, mps);
+	perf_counters_t counters;
+	if (perf) {
+		perf_open(&counters);
+		if (!perf_available(&counters)) {
+			fprintf(stderr, "No hardware counters available, is perf_event_paranoid too high?\n");
+			perf = 0;
+		}
 	}
-	reset_clock(&bench_clock);
+
+	if (json) {
+		printf("{\n  \"messages_per_corpus\": %zu,\n  \"warmup\": %zu,\n  \"corpora\": [\n", num_messages, warmup);
+	}
+
+	size_t c;
+	for (c = 0; c < num_corpora; c++) {
+		bench_result_t result;
+		benchmark(&corpora[c], num_messages, warmup, perf ? &counters : NULL, &result);
+
+		if (json) {
+			print_json_result(&corpora[c], &result, c + 1 == num_corpora);
+		} else {
+			print_result(&corpora[c], &result);
+		}
+
+		free_corpus(&corpora[c]);
+	}
+
+	if (json) {
+		printf("  ]\n}\n");
+	}
+
+	if (perf) {
+		perf_close(&counters);
+	}
+
+	return 0;
 }
@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Writes a synthetic RFC5424 corpus to stdout, one message per line, for the
+// benchmark to read. The same options and seed always give the same bytes.
+//
+//   ./generate_corpus [options] > corpus.log
+//
+// Hostnames and app names are picked from a fixed population with a Zipf
+// distribution, so a few sources send most of the messages like they do in
+// production.
+
+typedef struct generator_config_t {
+	uint64_t seed;
+	size_t count;
+
+	size_t hostnames;
+	size_t appnames;
+	double zipf;
+	size_t hostname_length;
+
+	// Each header field (other than the timestamp) is NIL with this probability
+	double nil_rate;
+
+	// Fractional seconds get 0 to this many digits, and this share of
+	// timestamps have a numeric offset instead of Z
+	int max_fraction_digits;
+	double offset_rate;
+	double nil_timestamp_rate;
+
+	// Elements per message and params per element are uniform from 0
+	int max_sd_elements;
+	int max_sd_params;
+	size_t sd_value_length;
+	// Chance that a param value contains characters that need escaping
+	double escape_rate;
+
+	// Message bodies are roughly exponential around the mean, capped at max
+	size_t message_size;
+	size_t max_message_size;
+} generator_config_t;
+
+typedef struct rng_t {
+	uint64_t state;
+} rng_t;
+
+// splitmix64, small and plenty random for picking lengths
+uint64_t rng_next(rng_t * rng) {
+	uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+double rng_double(rng_t * rng) {
+	return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+size_t rng_below(rng_t * rng, size_t n) {
+	return n ? rng_next(rng) % n : 0;
+}
+
+int rng_chance(rng_t * rng, double p) {
+	return rng_double(rng) < p;
+}
+
+// Cumulative weights of a Zipf distribution over n ranks
+double* zipf_table(size_t n, double s) {
+	double* cdf = malloc(sizeof(double) * n);
+	double total = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		total += 1.0 / pow(i + 1, s);
+		cdf[i] = total;
+	}
+
+	for (i = 0; i < n; i++) {
+		cdf[i] /= total;
+	}
+
+	return cdf;
+}
+
+size_t zipf_pick(rng_t * rng, const double* cdf, size_t n) {
+	double u = rng_double(rng);
+	size_t low = 0;
+	size_t high = n - 1;
+
+	while (low < high) {
+		size_t mid = (low + high) / 2;
+		if (cdf[mid] < u) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+void put_random_word(rng_t * rng, size_t length) {
+	size_t i;
+	for (i = 0; i < length; i++) {
+		putchar(ALPHABET[rng_below(rng, sizeof(ALPHABET) - 1)]);
+	}
+}
+
+// Names are derived from their rank rather than stored, so the population can
+// be huge without costing memory
+void put_name(const char* prefix, size_t rank, size_t length) {
+	int n = printf("%s%zu", prefix, rank);
+	while ((size_t) n < length) {
+		putchar('x');
+		n++;
+	}
+}
+
+void put_timestamp(rng_t * rng, const generator_config_t * config, size_t index) {
+	if (rng_chance(rng, config->nil_timestamp_rate)) {
+		putchar('-');
+		return;
+	}
+
+	// Walk forward through a day so timestamps look like a real stream
+	size_t seconds = index / 10 % 86400;
+	printf("2016-12-16T%02zu:%02zu:%02zu", seconds / 3600, seconds / 60 % 60, seconds % 60);
+
+	int digits = rng_below(rng, config->max_fraction_digits + 1);
+	if (digits) {
+		putchar('.');
+		int i;
+		for (i = 0; i < digits; i++) {
+			putchar('0' + rng_below(rng, 10));
+		}
+	}
+
+	if (rng_chance(rng, config->offset_rate)) {
+		int hours = (int) rng_below(rng, 27) - 12;
+		printf("%c%02d:%s", hours < 0 ? '-' : '+', abs(hours), rng_chance(rng, 0.2) ? "30" : "00");
+	} else {
+		putchar('Z');
+	}
+}
+
+void put_sd_value(rng_t * rng, const generator_config_t * config) {
+	size_t length = config->sd_value_length ? 1 + rng_below(rng, config->sd_value_length * 2) : 0;
+	int escape = rng_chance(rng, config->escape_rate);
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		if (escape && rng_chance(rng, 0.15)) {
+			static const char* ESCAPES[] = { "\\\"", "\\\\", "\\]" };
+			fputs(ESCAPES[rng_below(rng, 3)], stdout);
+		} else {
+			putchar(ALPHABET[rng_below(rng, sizeof(ALPHABET) - 1)]);
+		}
+	}
+}
+
+void put_structured_data(rng_t * rng, const generator_config_t * config) {
+	int elements = rng_below(rng, config->max_sd_elements + 1);
+	if (!elements) {
+		putchar('-');
+		return;
+	}
+
+	int e, p;
+	for (e = 0; e < elements; e++) {
+		printf("[sd%d@32473", e);
+
+		int params = rng_below(rng, config->max_sd_params + 1);
+		for (p = 0; p < params; p++) {
+			printf(" p%d=\"", p);
+			put_sd_value(rng, config);
+			putchar('"');
+		}
+
+		putchar(']');
+	}
+}
+
+void put_message(rng_t * rng, const generator_config_t * config) {
+	if (!config->message_size) {
+		return;
+	}
+
+	size_t length = (size_t) (-log(1.0 - rng_double(rng)) * config->message_size);
+	if (length > config->max_message_size) {
+		length = config->max_message_size;
+	}
+
+	if (!length) {
+		return;
+	}
+
+	putchar(' ');
+
+	// Mostly words, so it reads like a log line
+	size_t written = 0;
+	while (written < length) {
+		size_t word = 1 + rng_below(rng, 9);
+		if (word > length - written) {
+			word = length - written;
+		}
+
+		put_random_word(rng, word);
+		written += word;
+
+		if (written < length) {
+			putchar(' ');
+			written++;
+		}
+	}
+}
+
+void generate(const generator_config_t * config) {
+	rng_t rng = { config->seed };
+	double* host_cdf = zipf_table(config->hostnames, config->zipf);
+	double* app_cdf = zipf_table(config->appnames, config->zipf);
+	size_t i;
+
+	for (i = 0; i < config->count; i++) {
+		printf("<%zu>1 ", rng_below(&rng, 192));
+
+		put_timestamp(&rng, config, i);
+		putchar(' ');
+
+		if (rng_chance(&rng, config->nil_rate)) {
+			putchar('-');
+		} else {
+			put_name("host-", zipf_pick(&rng, host_cdf, config->hostnames), config->hostname_length);
+		}
+		putchar(' ');
+
+		if (rng_chance(&rng, config->nil_rate)) {
+			putchar('-');
+		} else {
+			put_name("app-", zipf_pick(&rng, app_cdf, config->appnames), 0);
+		}
+		putchar(' ');
+
+		if (rng_chance(&rng, config->nil_rate)) {
+			putchar('-');
+		} else {
+			printf("%zu", 1 + rng_below(&rng, 65535));
+		}
+		putchar(' ');
+
+		if (rng_chance(&rng, config->nil_rate)) {
+			putchar('-');
+		} else {
+			printf("ID%zu", rng_below(&rng, 50));
+		}
+		putchar(' ');
+
+		put_structured_data(&rng, config);
+		put_message(&rng, config);
+
+		putchar('\n');
+	}
+
+	free(host_cdf);
+	free(app_cdf);
+}
+
+void usage() {
+	fprintf(stderr,
+		"usage: generate_corpus [options] > corpus.log\n"
+		"  --seed N                 (1)\n"
+		"  --count N                messages to write (100000)\n"
+		"  --hostnames N            distinct hostnames (1000)\n"
+		"  --appnames N             distinct app names (50)\n"
+		"  --zipf S                 skew of hostname and app name popularity (1.1)\n"
+		"  --hostname-length N      pad hostnames to this length (12)\n"
+		"  --nil-rate P             chance each header field is NIL (0.05)\n"
+		"  --nil-timestamp-rate P   chance the timestamp is NIL (0.01)\n"
+		"  --fraction-digits N      up to this many fractional second digits (6)\n"
+		"  --offset-rate P          chance of a numeric offset instead of Z (0.3)\n"
+		"  --sd-elements N          up to this many SD elements (2)\n"
+		"  --sd-params N            up to this many params per element (4)\n"
+		"  --sd-value-length N      mean param value length (12)\n"
+		"  --escape-rate P          chance a param value contains escapes (0.05)\n"
+		"  --message-size N         mean message body size (120)\n"
+		"  --max-message-size N     cap on message body size (8192)\n");
+}
+
+int main(int argc, char* argv[]) {
+	generator_config_t config = {
+		1, 100000,
+		1000, 50, 1.1, 12,
+		0.05,
+		6, 0.3, 0.01,
+		2, 4, 12, 0.05,
+		120, 8192
+	};
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+
+		const char* flag = argv[i];
+		const char* value = argv[++i];
+
+		if (!strcmp(flag, "--seed")) {
+			config.seed = strtoull(value, NULL, 10);
+		} else if (!strcmp(flag, "--count")) {
+			config.count = strtoul(value, NULL, 10);
+		} else if (!strcmp(flag, "--hostnames")) {
+			config.hostnames = strtoul(value, NULL, 10);
+		} else if (!strcmp(flag, "--appnames")) {
+			config.appnames = strtoul(value, NULL, 10);
+		} else if (!strcmp(flag, "--zipf")) {
+			config.zipf = atof(value);
+		} else if (!strcmp(flag, "--hostname-length")) {
+			config.hostname_length = strtoul(value, NULL, 10);
+		} else if (!strcmp(flag, "--nil-rate")) {
+			config.nil_rate = atof(value);
+		} else if (!strcmp(flag, "--nil-timestamp-rate")) {
+			config.nil_timestamp_rate = atof(value);
+		} else if (!strcmp(flag, "--fraction-digits")) {
+			config.max_fraction_digits = atoi(value);
+		} else if (!strcmp(flag, "--offset-rate")) {
+			config.offset_rate = atof(value);
+		} else if (!strcmp(flag, "--sd-elements")) {
+			config.max_sd_elements = atoi(value);
+		} else if (!strcmp(flag, "--sd-params")) {
+			config.max_sd_params = atoi(value);
+		} else if (!strcmp(flag, "--sd-value-length")) {
+			config.sd_value_length = strtoul(value, NULL, 10);
+		} else if (!strcmp(flag, "--escape-rate")) {
+			config.escape_rate = atof(value);
+		} else if (!strcmp(flag, "--message-size")) {
+			config.message_size = strtoul(value, NULL, 10);
+		} else if (!strcmp(flag, "--max-message-size")) {
+			config.max_message_size = strtoul(value, NULL, 10);
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (!config.hostnames || !config.appnames || config.max_fraction_digits < 0 || config.max_fraction_digits > 6) {
+		usage();
+		return 1;
+	}
+
+	generate(&config);
+
+	return 0;
+}
@@ -0,0 +1,361 @@
+#include "syslog.h"
+#include "syslog_internal.h"
+#include "syslog_utf8.h"
+#include "time.h"
+#include "math.h"
+
+// Times each stage of parse_syslog_message_t on its own, so that when the end
+// to end numbers move there is a way to tell which stage moved them.
+//
+//   ./microbench [--samples N] [stage...]
+//
+// Every stage is run for SAMPLES samples of about SAMPLE_NS each. Samples
+// further than OUTLIER_MADS median absolute deviations from the median are
+// thrown away (a context switch or a page fault in the middle of one says
+// nothing about the code), and the rest are summarised.
+
+#define DEFAULT_SAMPLES 31
+#define SAMPLE_NS 10000000ULL
+#define OUTLIER_MADS 3.0
+// Stages that need to set things up or clean up outside the timed part do it
+// this many operations at a time
+#define BATCH 1024
+
+static const char* HEADERS[] = {
+	"1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID -",
+	"1 - h a - - -",
+	"1 2003-10-11T22:14:15.003+07:00 mymachine.example.com evntslog 8710 ID47 -",
+	"1 2016-12-16T12:00:00Z web-frontend-0042.prod.example.com nginx 12345 access -",
+};
+
+static const char* TIMESTAMPS[] = {
+	"2016-12-16T12:00:00.000Z",
+	"2003-10-11T22:14:15.003+07:00",
+	"2016-12-16T12:00:00Z",
+	"1985-04-12T23:20:50.52Z",
+	"2003-08-24T05:14:15.000003-07:00",
+};
+
+static const char* SD_SECTIONS[] = {
+	"[exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"] Logging message...",
+	"[id@1] m",
+	"[exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"][examplePriority@32473 class=\"high\"] m",
+	"[esc@1 path=\"C:\\\\logs\" quote=\"say \\\"hi\\\"\" bracket=\"[x\\]\"] escaped",
+	"[origin ip=\"10.0.0.1\" software=\"app\"][meta sequenceId=\"42\"][timeQuality tzKnown=\"1\" isSynced=\"1\"] m",
+};
+
+static const char* SD_ELEMENTS[] = {
+	"exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"",
+	"id@1",
+	"exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\" a=\"1\" b=\"2\" c=\"3\"",
+	"esc@1 path=\"C:\\\\logs\" quote=\"say \\\"hi\\\"\" bracket=\"[x\\]\"",
+	"origin ip=\"10.0.0.1\" software=\"app\"",
+};
+
+static const char* MESSAGES[] = {
+	"<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID Logging message...",
+	"<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"] Logging message...",
+	"<13>1 - h a - - - m",
+	"<14>1 2016-12-16T12:00:00Z host app - - [a@1 x=\"1\"][b@1 y=\"2\" z=\"3\"] two elements",
+};
+
+// Mostly ASCII with the odd accent, like a real MSG, and one that is all
+// multibyte
+static const char* BODIES[] = {
+	"GET /api/v1/users?id=1042 200 1532 \"Mozilla/5.0 (X11; Linux x86_64)\" request served in 12ms",
+	"user ren\xC3\xA9" "e logged in from caf\xC3\xA9-wifi, session 8f3a2c91d0e4 expires in 3600 seconds",
+	"\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\xE3\x81\xAE\xE3\x83\xAD\xE3\x82\xB0\xE3\x83\xA1\xE3\x83\x83\xE3\x82\xBB\xE3\x83\xBC\xE3\x82\xB8",
+};
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+// Somewhere for results to go so the compiler can't drop the work
+static volatile size_t sink;
+
+uint64_t monotonic_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Each stage runs iterations operations and returns how many nanoseconds the
+// operations themselves took.
+
+uint64_t bench_facility_id(size_t iterations) {
+	size_t total = 0;
+	size_t i;
+
+	uint64_t start = monotonic_ns();
+	for (i = 0; i < iterations; i++) {
+		total += get_facility_id(i % 192);
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+
+	sink = total;
+	return elapsed;
+}
+
+uint64_t bench_next_until(size_t iterations) {
+	char scratch[256];
+	size_t total = 0;
+	size_t i;
+
+	uint64_t start = monotonic_ns();
+	for (i = 0; i < iterations; i++) {
+		syslog_parse_context_t ctx = create_parse_context(HEADERS[i % COUNT(HEADERS)]);
+		size_t length;
+
+		// Splits the whole header, like the parser does field by field
+		while ((length = parse_context_next_until(&ctx, ' ', scratch, 0))) {
+			total += length;
+		}
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+
+	sink = total;
+	return elapsed;
+}
+
+uint64_t bench_iso_8601(size_t iterations) {
+	struct tm tm;
+	size_t total = 0;
+	size_t i;
+
+	uint64_t start = monotonic_ns();
+	for (i = 0; i < iterations; i++) {
+		total += parse_iso_8601(TIMESTAMPS[i % COUNT(TIMESTAMPS)], &tm);
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+
+	sink = total + tm.tm_sec;
+	return elapsed;
+}
+
+uint64_t bench_sd_elements(size_t iterations) {
+	char scratch[1024];
+	size_t total = 0;
+	size_t i;
+
+	uint64_t start = monotonic_ns();
+	for (i = 0; i < iterations; i++) {
+		syslog_parse_context_t ctx = create_parse_context(SD_SECTIONS[i % COUNT(SD_SECTIONS)]);
+		size_t elements;
+		size_t unterminated;
+
+		total += parse_context_get_structured_data_elements(&ctx, scratch, &elements, &unterminated);
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+
+	sink = total;
+	return elapsed;
+}
+
+uint64_t bench_sd_element(size_t iterations) {
+	static syslog_extended_property_t properties[BATCH];
+	char* inputs[COUNT(SD_ELEMENTS)];
+	uint64_t elapsed = 0;
+	size_t done = 0;
+	size_t i;
+
+	// parse_structured_data_element wants a writable string
+	for (i = 0; i < COUNT(SD_ELEMENTS); i++) {
+		inputs[i] = strdup(SD_ELEMENTS[i]);
+	}
+
+	while (done < iterations) {
+		size_t batch = iterations - done < BATCH ? iterations - done : BATCH;
+		size_t parsed = 0;
+
+		uint64_t start = monotonic_ns();
+		for (i = 0; i < batch; i++) {
+			parsed += parse_structured_data_element(inputs[(done + i) % COUNT(inputs)], &properties[i], NULL);
+		}
+		elapsed += monotonic_ns() - start;
+
+		for (i = 0; i < parsed; i++) {
+			free_syslog_extended_property_t(&properties[i]);
+		}
+
+		done += batch;
+	}
+
+	for (i = 0; i < COUNT(inputs); i++) {
+		free(inputs[i]);
+	}
+
+	return elapsed;
+}
+
+uint64_t bench_utf8_validate(size_t iterations) {
+	size_t lengths[COUNT(BODIES)];
+	size_t total = 0;
+	size_t i;
+
+	for (i = 0; i < COUNT(BODIES); i++) {
+		lengths[i] = strlen(BODIES[i]);
+	}
+
+	uint64_t start = monotonic_ns();
+	for (i = 0; i < iterations; i++) {
+		total += syslog_utf8_validate(BODIES[i % COUNT(BODIES)], lengths[i % COUNT(BODIES)]);
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+
+	sink = total;
+	return elapsed;
+}
+
+uint64_t bench_free_message(size_t iterations) {
+	static syslog_message_t messages[BATCH];
+	uint64_t elapsed = 0;
+	size_t done = 0;
+	size_t i;
+
+	while (done < iterations) {
+		size_t batch = iterations - done < BATCH ? iterations - done : BATCH;
+
+		for (i = 0; i < batch; i++) {
+			parse_syslog_message_t(MESSAGES[(done + i) % COUNT(MESSAGES)], &messages[i]);
+		}
+
+		uint64_t start = monotonic_ns();
+		for (i = 0; i < batch; i++) {
+			free_syslog_message_t(&messages[i]);
+		}
+		elapsed += monotonic_ns() - start;
+
+		done += batch;
+	}
+
+	return elapsed;
+}
+
+uint64_t bench_full_parse(size_t iterations) {
+	size_t total = 0;
+	size_t i;
+
+	uint64_t start = monotonic_ns();
+	for (i = 0; i < iterations; i++) {
+		syslog_message_t m = {};
+		if (parse_syslog_message_t(MESSAGES[i % COUNT(MESSAGES)], &m)) {
+			total += m.pri_value;
+			free_syslog_message_t(&m);
+		}
+	}
+	uint64_t elapsed = monotonic_ns() - start;
+
+	sink = total;
+	return elapsed;
+}
+
+typedef struct stage_t {
+	const char* name;
+	uint64_t (*run)(size_t iterations);
+} stage_t;
+
+static const stage_t STAGES[] = {
+	{"facility_id", bench_facility_id},
+	{"next_until", bench_next_until},
+	{"iso_8601", bench_iso_8601},
+	{"sd_elements", bench_sd_elements},
+	{"sd_element", bench_sd_element},
+	{"utf8_validate", bench_utf8_validate},
+	{"free_message", bench_free_message},
+	{"full_parse", bench_full_parse},
+};
+
+int compare_double(const void* a, const void* b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+double median(double* values, size_t count) {
+	qsort(values, count, sizeof(double), compare_double);
+	return count & 1 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+void run_stage(const stage_t * stage, size_t num_samples) {
+	double* samples = malloc(sizeof(double) * num_samples);
+	double* deviations = malloc(sizeof(double) * num_samples);
+	size_t i;
+
+	// Find out how many operations fill a sample, which doubles as a warmup
+	size_t iterations = 1;
+	while (stage->run(iterations) < SAMPLE_NS / 10) {
+		iterations *= 2;
+	}
+	iterations *= 10;
+
+	for (i = 0; i < num_samples; i++) {
+		samples[i] = (double) stage->run(iterations) / iterations;
+	}
+
+	double mid = median(samples, num_samples);
+	for (i = 0; i < num_samples; i++) {
+		deviations[i] = fabs(samples[i] - mid);
+	}
+	double mad = median(deviations, num_samples);
+
+	// samples is sorted now, and so the kept ones are a contiguous run
+	double sum = 0;
+	double sum_squares = 0;
+	double min = 0;
+	size_t kept = 0;
+
+	for (i = 0; i < num_samples; i++) {
+		if (mad > 0 && fabs(samples[i] - mid) > OUTLIER_MADS * mad) {
+			continue;
+		}
+
+		if (!kept) {
+			min = samples[i];
+		}
+
+		sum += samples[i];
+		sum_squares += samples[i] * samples[i];
+		kept++;
+	}
+
+	double mean = sum / kept;
+	double stddev = kept > 1 ? sqrt((sum_squares - kept * mean * mean) / (kept - 1)) : 0;
+
+	printf("%-14s median %9.2f ns/op  mean %9.2f  stddev %7.2f  min %9.2f  (%zu of %zu samples, %zu ops each)\n",
+		stage->name, mid, mean, stddev, min, kept, num_samples, iterations);
+
+	free(samples);
+	free(deviations);
+}
+
+int main(int argc, char* argv[]) {
+	size_t num_samples = DEFAULT_SAMPLES;
+	const char* only[COUNT(STAGES)];
+	size_t num_only = 0;
+	size_t i, j;
+
+	for (i = 1; i < (size_t) argc; i++) {
+		if (!strcmp(argv[i], "--samples") && i + 1 < (size_t) argc) {
+			num_samples = strtoul(argv[++i], NULL, 10);
+		} else if (num_only < COUNT(only)) {
+			only[num_only++] = argv[i];
+		}
+	}
+
+	if (!num_samples) {
+		fprintf(stderr, "--samples needs to be at least 1\n");
+		return 1;
+	}
+
+	for (i = 0; i < COUNT(STAGES); i++) {
+		int wanted = !num_only;
+		for (j = 0; j < num_only; j++) {
+			wanted |= !strcmp(only[j], STAGES[i].name);
+		}
+
+		if (wanted) {
+			run_stage(&STAGES[i], num_samples);
+		}
+	}
+
+	return 0;
+}
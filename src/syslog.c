@@ -1,4 +1,19 @@
+#include <arpa/inet.h>
+#include <ctype.h>
+
 #include "syslog.h"
+#include "syslog_internal.h"
+#include "syslog_hash.h"
+#include "syslog_filter.h"
+#include "syslog_ratelimit.h"
+#include "syslog_dedup.h"
+#include "syslog_stats.h"
+#include "syslog_utf8.h"
+#include "syslog_intern.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define SEPARATOR ' '
 #define NIL '-'
@@ -14,12 +29,6 @@
 
 static int PRI_VALUES[PRI_VALUES_COUNT] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128, 136, 144, 152, 160, 168, 176, 184};
 
-typedef struct syslog_parse_context_t {
-  const char * message;
-  int pointer;
-  int is_eol;
-} syslog_parse_context_t;
-
 int parse_context_is_eol(syslog_parse_context_t * ctx) {
   return ctx->is_eol;
 }
@@ -66,6 +75,9 @@ size_t parse_context_next_until(syslog_parse_context_t * ctx, char until_char, c
     return 0;
   }
 
+  // Running off the end has to be remembered, otherwise the next read starts past the terminator
+  ctx->is_eol = ctx->pointer >= str_len;
+
   if (writestr) {
     // Copy the new string to the buffer
     strncpy(writestr, ctx->message + old_pointer, newstr_len);
@@ -87,11 +99,12 @@ size_t parse_context_next_until_with_escapes(syslog_parse_context_t * ctx, char
       if (c == QUOTE || c == CLOSE_BRACKET || c == ESCAPE) {
         escaped = 0;
       } else {
+        escaped = 0;
         if (evaluate_escapes) {
           // only those 3 characters support escape characters, so we are supposed
           // to treat it as unescaped and NOT throw away the ESCAPE character.
           // See https://tools.ietf.org/html/rfc5424#section-6.3
-          writestr[i] = ESCAPE;
+          writestr[i++] = ESCAPE;
         }
       }
     } else if (c == ESCAPE) {
@@ -120,11 +133,12 @@ size_t parse_context_next_until_with_escapes(syslog_parse_context_t * ctx, char
   return 0;
 }
 
-int parse_context_get_structured_data_elements(syslog_parse_context_t * ctx, char* writestr, size_t * num_elements) {
+int parse_context_get_structured_data_elements(syslog_parse_context_t * ctx, char* writestr, size_t * num_elements, size_t * unterminated) {
   char start = 0;
   parse_context_peek(ctx, &start);
 
   *num_elements = 0;
+  *unterminated = 0;
   int intern_pointer = 0;
 
   if (start == NIL) {
@@ -138,6 +152,7 @@ int parse_context_get_structured_data_elements(syslog_parse_context_t * ctx, cha
 
   char pk = 0;
   while (parse_context_peek(ctx, &pk) && pk == OPEN_BRACKET) {
+    size_t element_start = ctx->pointer;
     parse_context_one(ctx, &pk); // eat [
     // We need to find where structured data ends, but takes escapes into account
     char* ptr_segment = writestr + intern_pointer;
@@ -148,6 +163,11 @@ int parse_context_get_structured_data_elements(syslog_parse_context_t * ctx, cha
       // Increment this intern pointer by the length of the string returned + 1 for the
       // null terminator
       intern_pointer += str_len + 1;
+    } else if (ctx->pointer != element_start + 2 || ctx->message[element_start + 1] != CLOSE_BRACKET) {
+      // Not an empty [] but no ] either, so this one ran off the end
+      *num_elements = 0;
+      *unterminated = element_start;
+      return intern_pointer;
     }
   }
 
@@ -177,46 +197,111 @@ syslog_parse_context_t create_parse_context(const char* raw_message) {
   return ctx;
 }
 
-int parse_structured_data_element(char* data_string, syslog_extended_property_t * property) {
-  syslog_parse_context_t ctx = create_parse_context(data_string);
+// Interns a name that is still sitting in the element string. NULL when the
+// table could not take it.
+static char* intern_sd_name(struct syslog_intern_table_t * table, const char* name, size_t length, uint32_t * id) {
+  *id = syslog_intern(table, name, length);
+  if (*id == SYSLOG_INTERN_ERROR) {
+    return NULL;
+  }
 
-  // New write string time
-  char* element_string = calloc(strlen(data_string) * 2, sizeof(char));
-  int intern_pointer = 0;
+  return (char*) syslog_intern_string(table, *id);
+}
+
+// The SD-ID goes into the table without being copied out first, unless it has
+// an escape in it that needs evaluating. Returns 0 when there is no SD-ID and
+// -1 when the table could not take it.
+static int intern_sd_id(syslog_parse_context_t * ctx, struct syslog_intern_table_t * table, syslog_extended_property_t * property) {
+  size_t length = strlen(ctx->message);
+  const char* separator = strchr(ctx->message, SEPARATOR);
+  size_t id_length = separator ? (size_t) (separator - ctx->message) : length;
+
+  if (!id_length) {
+    return 0;
+  }
+
+  if (!memchr(ctx->message, ESCAPE, id_length)) {
+    // Leave ctx where parse_context_next_until_with_escapes would have
+    ctx->pointer = separator ? id_length + 1 : length;
+    ctx->is_eol = ctx->pointer >= length;
+
+    property->id = intern_sd_name(table, ctx->message, id_length, &property->interned_id);
+    return property->id ? 1 : -1;
+  }
+
+  // The first separator may be escaped, so the SD-ID can run on past it
+  char* unescaped = syslog_calloc(length + 1, sizeof(char));
+  id_length = parse_context_next_until_with_escapes(ctx, SEPARATOR, unescaped, 1, 1);
+  property->id = id_length ? intern_sd_name(table, unescaped, id_length, &property->interned_id) : NULL;
+  syslog_free(unescaped);
 
-  // SD-ID
-  int id_length = parse_context_next_until_with_escapes(&ctx, SEPARATOR, &element_string[intern_pointer], 1, 1);
   if (!id_length) {
-    free(element_string);
     return 0;
   }
+  return property->id ? 1 : -1;
+}
+
+int parse_structured_data_element(char* data_string, syslog_extended_property_t * property, struct syslog_intern_table_t * table) {
+  syslog_parse_context_t ctx = create_parse_context(data_string);
+
+  char* element_string = NULL;
+  int intern_pointer = 0;
 
-  property->id = &element_string[intern_pointer];
+  property->interned_id = SYSLOG_INTERN_NIL;
+  property->raw_interned_message = NULL;
 
-  // Needs to be saved here so it can be free'd
-  property->raw_interned_message = element_string;
+  // SD-ID
+  if (table) {
+    // SD-IDs and PARAM-NAMEs live in the table, so only the values are copied
+    int interned = intern_sd_id(&ctx, table, property);
+    if (interned < 1) {
+      return interned;
+    }
+  } else {
+    // New write string time
+    element_string = syslog_calloc(strlen(data_string) * 2, sizeof(char));
+
+    int id_length = parse_context_next_until_with_escapes(&ctx, SEPARATOR, &element_string[intern_pointer], 1, 1);
+    if (!id_length) {
+      syslog_free(element_string);
+      return 0;
+    }
+
+    property->id = &element_string[intern_pointer];
 
-  // Add one for the null terminator
-  intern_pointer += id_length + 1;
+    // Needs to be saved here so it can be free'd
+    property->raw_interned_message = element_string;
+
+    // Add one for the null terminator
+    intern_pointer += id_length + 1;
+  }
 
   if (parse_context_is_eol(&ctx)) {
     // This means the entire thing is the sd_id, as in
     // [exampleSDID@32473]
     // so it gets an empty value set and we're done.
     property->pairs = NULL;
+    property->num_pairs = 0;
     return 1;
   }
 
+  if (!element_string) {
+    // Values are never longer than what is left, and each one's terminator
+    // takes the place of its closing quote
+    element_string = syslog_calloc(strlen(data_string) - ctx.pointer + 1, sizeof(char));
+    property->raw_interned_message = element_string;
+  }
+
   int pair_increment = 4;
   int allocated_pairs = pair_increment;
 
   // @todo Max 12 elements here. We need to make this bigger
-  property->pairs = (syslog_extended_property_value_t*) malloc(sizeof(syslog_extended_property_value_t) * allocated_pairs);
+  property->pairs = (syslog_extended_property_value_t*) syslog_malloc(sizeof(syslog_extended_property_value_t) * allocated_pairs);
 
   size_t num_elements = 0;
-  // FIX IT FIX IT FIX IT SHOULD BE DOING INTERNING HERE @TODO
   while (!parse_context_is_eol(&ctx)) {
-    int key_len = parse_context_next_until(&ctx, EQUALS, &element_string[intern_pointer], 0);
+    size_t key_offset = ctx.pointer;
+    int key_len = parse_context_next_until(&ctx, EQUALS, table ? NULL : &element_string[intern_pointer], 0);
     if (!key_len) {
       // Invalid because we need a key and value
       break;
@@ -231,7 +316,9 @@ int parse_structured_data_element(char* data_string, syslog_extended_property_t
 
     char* key = &element_string[intern_pointer];
 
-    intern_pointer += key_len + 1;
+    if (!table) {
+      intern_pointer += key_len + 1;
+    }
 
     int val_len = parse_context_next_until_with_escapes(&ctx, QUOTE, &element_string[intern_pointer], 1, 0);
     if (!val_len) {
@@ -239,6 +326,13 @@ int parse_structured_data_element(char* data_string, syslog_extended_property_t
       break;
     }
 
+    uint32_t key_id = SYSLOG_INTERN_NIL;
+    if (table && !(key = intern_sd_name(table, &data_string[key_offset], key_len, &key_id))) {
+      syslog_free(property->pairs);
+      syslog_free(element_string);
+      return -1;
+    }
+
     num_elements++;
 
     char* value = &element_string[intern_pointer];
@@ -248,10 +342,10 @@ int parse_structured_data_element(char* data_string, syslog_extended_property_t
     if (allocated_pairs < num_elements) {
       allocated_pairs += pair_increment;
 
-      property->pairs = (syslog_extended_property_value_t*) realloc(property->pairs, sizeof(syslog_extended_property_value_t) * allocated_pairs);
+      property->pairs = (syslog_extended_property_value_t*) syslog_realloc(property->pairs, sizeof(syslog_extended_property_value_t) * allocated_pairs);
     }
 
-    property->pairs[num_elements - 1] = (syslog_extended_property_value_t) {key, value};
+    property->pairs[num_elements - 1] = (syslog_extended_property_value_t) {key, value, key_id};
 
     if (!parse_context_is_eol(&ctx)) {
       char next = 0;
@@ -268,46 +362,384 @@ int parse_structured_data_element(char* data_string, syslog_extended_property_t
   if (num_elements < allocated_pairs) {
     allocated_pairs = num_elements + 1;
 
-    property->pairs = (syslog_extended_property_value_t*) realloc(property->pairs, sizeof(syslog_extended_property_value_t) * allocated_pairs);
+    property->pairs = (syslog_extended_property_value_t*) syslog_realloc(property->pairs, sizeof(syslog_extended_property_value_t) * allocated_pairs);
   }
 #endif
 
   return 1;
 }
 
-syslog_extended_property_t * get_structured_data(char* structured_data_elements, size_t num_elements) {
+// --- IANA registered SD-IDs
+// The three SD-IDs all have different lengths, and so do the params within each
+// one, so the length is a perfect hash and one memcmp confirms the match.
+
+static int iana_name_is(const char* name, size_t length, const char* expected, size_t expected_length) {
+  return length == expected_length && memcmp(name, expected, length) == 0;
+}
+
+static int iana_parse_integer(const char* value, long long min, long long max, long long * out) {
+  char* end = NULL;
+
+  if (!*value) {
+    return 0;
+  }
+
+  long long parsed = strtoll(value, &end, 10);
+  if (*end || parsed < min || parsed > max) {
+    return 0;
+  }
+
+  *out = parsed;
+  return 1;
+}
+
+static int iana_parse_flag(const char* value) {
+  if (value[0] && !value[1] && (value[0] == '0' || value[0] == '1')) {
+    return value[0] - '0';
+  }
+
+  return -1;
+}
+
+static void decode_time_quality(const syslog_extended_property_t * property, syslog_time_quality_t * time_quality) {
+  *time_quality = (syslog_time_quality_t) {1, -1, -1, -1};
+
+  size_t i;
+  for (i = 0; i < property->num_pairs; i++) {
+    const char* key = property->pairs[i].key;
+    const char* value = property->pairs[i].value;
+    size_t key_length = strlen(key);
+    long long parsed;
+
+    switch (key_length) {
+      case 7:
+        if (iana_name_is(key, key_length, "tzKnown", 7)) {
+          time_quality->tz_known = iana_parse_flag(value);
+        }
+        break;
+      case 8:
+        if (iana_name_is(key, key_length, "isSynced", 8)) {
+          time_quality->is_synced = iana_parse_flag(value);
+        }
+        break;
+      case 12:
+        if (iana_name_is(key, key_length, "syncAccuracy", 12) && iana_parse_integer(value, 0, LONG_MAX, &parsed)) {
+          time_quality->sync_accuracy = (long) parsed;
+        }
+        break;
+    }
+  }
+}
+
+static void decode_origin(const syslog_extended_property_t * property, syslog_origin_t * origin) {
+  memset(origin, 0, sizeof(syslog_origin_t));
+  origin->present = 1;
+
+  size_t i;
+  for (i = 0; i < property->num_pairs; i++) {
+    const char* key = property->pairs[i].key;
+    const char* value = property->pairs[i].value;
+    size_t key_length = strlen(key);
+
+    switch (key_length) {
+      case 2:
+        // ip may be repeated, one per interface
+        if (iana_name_is(key, key_length, "ip", 2) && origin->ip_count < SYSLOG_MAX_ORIGIN_IPS) {
+          syslog_ip_address_t * ip = &origin->ips[origin->ip_count];
+
+          if (inet_pton(AF_INET, value, ip->address) == 1) {
+            ip->version = 4;
+            origin->ip_count++;
+          } else if (inet_pton(AF_INET6, value, ip->address) == 1) {
+            ip->version = 6;
+            origin->ip_count++;
+          }
+        }
+        break;
+      case 8:
+        if (iana_name_is(key, key_length, "software", 8)) {
+          origin->software = value;
+        }
+        break;
+      case 9:
+        if (iana_name_is(key, key_length, "swVersion", 9)) {
+          origin->sw_version = value;
+        }
+        break;
+      case 12:
+        // Kept as a string because it may carry dotted sub-identifiers
+        if (iana_name_is(key, key_length, "enterpriseId", 12)) {
+          origin->enterprise_id = value;
+        }
+        break;
+    }
+  }
+}
+
+static void decode_meta(const syslog_extended_property_t * property, syslog_meta_t * meta) {
+  *meta = (syslog_meta_t) {1, -1, -1, NULL};
+
+  size_t i;
+  for (i = 0; i < property->num_pairs; i++) {
+    const char* key = property->pairs[i].key;
+    const char* value = property->pairs[i].value;
+    size_t key_length = strlen(key);
+    long long parsed;
+
+    switch (key_length) {
+      case 8:
+        if (iana_name_is(key, key_length, "language", 8)) {
+          meta->language = value;
+        }
+        break;
+      case 9:
+        if (iana_name_is(key, key_length, "sysUpTime", 9) && iana_parse_integer(value, 0, LLONG_MAX, &parsed)) {
+          meta->sys_up_time = parsed;
+        }
+        break;
+      case 10:
+        // RFC5424 7.3.1 limits this to 1..2147483647
+        if (iana_name_is(key, key_length, "sequenceId", 10) && iana_parse_integer(value, 1, 2147483647, &parsed)) {
+          meta->sequence_id = (long) parsed;
+        }
+        break;
+    }
+  }
+}
+
+void decode_iana_structured_data(const syslog_extended_property_t * property, syslog_iana_structured_data_t * iana) {
+  size_t id_length = strlen(property->id);
+
+  switch (id_length) {
+    case 4:
+      if (iana_name_is(property->id, id_length, "meta", 4)) {
+        decode_meta(property, &iana->meta);
+      }
+      break;
+    case 6:
+      if (iana_name_is(property->id, id_length, "origin", 6)) {
+        decode_origin(property, &iana->origin);
+      }
+      break;
+    case 11:
+      if (iana_name_is(property->id, id_length, "timeQuality", 11)) {
+        decode_time_quality(property, &iana->time_quality);
+      }
+      break;
+  }
+}
+
+int get_structured_data(char* structured_data_elements, size_t num_elements, struct syslog_intern_table_t * table, syslog_iana_structured_data_t * iana, syslog_extended_property_t ** out, size_t * num_parsed) {
   // the message may contain multiple structured data parts, as in:
   // [exampleSDID@32473 iut="3" eventSource="Application" eventID="1011"][examplePriority@32473 class="high"]
   // in which case we are given each separately within the list array.
-  syslog_extended_property_t * properties = (syslog_extended_property_t*) malloc(sizeof(syslog_extended_property_t) * num_elements + 1);
+  syslog_extended_property_t * properties = (syslog_extended_property_t*) syslog_malloc(sizeof(syslog_extended_property_t) * num_elements + 1);
 
   int ep_num = 0;
   int last_string_size = 0;
 
+  *out = NULL;
+  *num_parsed = 0;
+
   size_t i;
   for (i = 0; i < num_elements; i++) {
     char* st_element = &structured_data_elements[last_string_size];
-    if (parse_structured_data_element(st_element, &properties[ep_num])) {
+    int parsed = parse_structured_data_element(st_element, &properties[ep_num], table);
+    if (parsed < 0) {
+      while (ep_num > 0) {
+        free_syslog_extended_property_t(&properties[--ep_num]);
+      }
+      syslog_free(properties);
+      return 0;
+    }
+
+    if (parsed) {
+      decode_iana_structured_data(&properties[ep_num], iana);
       ep_num++;
     }
-    last_string_size = strlen(st_element) + 1;
+    // Elements are packed back to back, so keep a running offset
+    last_string_size += strlen(st_element) + 1;
+  }
+
+  // Elements that could not be parsed are dropped, and only the rest count
+  if (!ep_num) {
+    syslog_free(properties);
+    return 1;
+  }
+
+  *out = properties;
+  *num_parsed = ep_num;
+
+  return 1;
+}
+
+// --- Structured data index
+// A small open addressing table over every (SD-ID, param name) in the message.
+// It is only built when someone actually looks something up.
+
+#define SD_INDEX_SEED 0x9747b28c
+
+typedef struct sd_index_entry_t {
+  uint64_t hash;
+  const syslog_extended_property_t * property;
+  const syslog_extended_property_value_t * pair;
+} sd_index_entry_t;
+
+typedef struct sd_index_t {
+  size_t mask;
+  sd_index_entry_t entries[];
+} sd_index_t;
+
+static uint64_t sd_index_hash(const char* sd_id, size_t sd_id_length, const char* param_name, size_t param_name_length) {
+  return syslog_hash64_combine(syslog_hash64(sd_id, sd_id_length, SD_INDEX_SEED),
+                               syslog_hash64(param_name, param_name_length, SD_INDEX_SEED));
+}
+
+static sd_index_t * build_sd_index(const syslog_message_t * msg) {
+  size_t num_pairs = 0;
+
+  size_t i, j;
+  for (i = 0; i < msg->structured_data_count; i++) {
+    num_pairs += msg->structured_data[i].num_pairs;
+  }
+
+  // Keep the table at most half full
+  size_t capacity = 8;
+  while (capacity < num_pairs * 2) {
+    capacity <<= 1;
+  }
+
+  sd_index_t * index = syslog_calloc(1, sizeof(sd_index_t) + sizeof(sd_index_entry_t) * capacity);
+  if (!index) {
+    return NULL;
+  }
+
+  index->mask = capacity - 1;
+
+  for (i = 0; i < msg->structured_data_count; i++) {
+    const syslog_extended_property_t * property = &msg->structured_data[i];
+    size_t id_length = strlen(property->id);
+
+    for (j = 0; j < property->num_pairs; j++) {
+      const syslog_extended_property_value_t * pair = &property->pairs[j];
+      uint64_t hash = sd_index_hash(property->id, id_length, pair->key, strlen(pair->key));
+
+      // Linear probing keeps repeated params in insertion order, so the first wins
+      size_t slot = hash & index->mask;
+      while (index->entries[slot].pair) {
+        slot = (slot + 1) & index->mask;
+      }
+
+      index->entries[slot] = (sd_index_entry_t) {hash, property, pair};
+    }
+  }
+
+  return index;
+}
+
+syslog_sd_key_t syslog_sd_key(const char* sd_id, const char* param_name, size_t param_name_length) {
+  syslog_sd_key_t key = {
+    sd_id, param_name, param_name_length,
+    sd_index_hash(sd_id, strlen(sd_id), param_name, param_name_length)
+  };
+
+  return key;
+}
+
+const char* syslog_sd_find_key(syslog_message_t * msg, const syslog_sd_key_t * key) {
+  if (!msg->structured_data_count) {
+    return NULL;
+  }
+
+  sd_index_t * index = (sd_index_t*) msg->structured_data_index;
+  if (!index) {
+    index = build_sd_index(msg);
+    if (!index) {
+      return NULL;
+    }
+
+    msg->structured_data_index = index;
+  }
+
+  size_t slot = key->hash & index->mask;
+  while (index->entries[slot].pair) {
+    const sd_index_entry_t * entry = &index->entries[slot];
+
+    if (entry->hash == key->hash
+        && strncmp(entry->pair->key, key->param_name, key->param_name_length) == 0
+        && entry->pair->key[key->param_name_length] == 0
+        && strcmp(entry->property->id, key->sd_id) == 0) {
+      return entry->pair->value;
+    }
+
+    slot = (slot + 1) & index->mask;
   }
 
-  return properties;
+  return NULL;
+}
+
+const char* syslog_sd_find(syslog_message_t * msg, const char* sd_id, const char* param_name, size_t param_name_length) {
+  syslog_sd_key_t key = syslog_sd_key(sd_id, param_name, param_name_length);
+  return syslog_sd_find_key(msg, &key);
 }
 
 int get_facility_id(int pri_value) {
   // given a pri-value from a SysLog entry, which is Facility*8+Severity,
-  // return the Facility value portion. Which is given by the maximum _priValue
-  // that is less than priValue.
+  // return the Facility value portion. Severity is the low three bits so the
+  // facility is just an index into the table.
+  if (pri_value < 0 || pri_value >= PRI_VALUES_COUNT * 8) {
+    return 0;
+  }
+
+  return PRI_VALUES[pri_value >> 3];
+}
+
+void syslog_pri_mask_accept(syslog_pri_mask_t * mask, int pri_value) {
+  if (pri_value >= 0 && pri_value < PRI_VALUES_COUNT * 8) {
+    mask->bits[pri_value >> 6] |= (uint64_t) 1 << (pri_value & 63);
+  }
+}
+
+void syslog_pri_mask_accept_severity(syslog_pri_mask_t * mask, int max_severity) {
   int i;
-  for (i = PRI_VALUES_COUNT - 1; i >= 0; i--) {
-    // find the first item in the list, starting from the end, that is less than or equal to the priValue.
-    int val = PRI_VALUES[i];
-    if (val <= pri_value) {
-      return val;
+  for (i = 0; i < PRI_VALUES_COUNT * 8; i++) {
+    if ((i & 7) <= max_severity) {
+      syslog_pri_mask_accept(mask, i);
     }
   }
+}
+
+int syslog_pri_mask_accepts(const syslog_pri_mask_t * mask, int pri_value) {
+  return (mask->bits[pri_value >> 6] >> (pri_value & 63)) & 1;
+}
+
+// Decodes <PRI> at the start of buf. Returns the number of bytes consumed, or
+// 0 if there is no valid PRI there.
+static size_t decode_pri(const char* buf, size_t len, int * pri_value) {
+  if (len < 3 || buf[0] != '<') {
+    return 0;
+  }
+
+  int value = 0;
+  size_t i;
+  for (i = 1; i < len && i <= 4; i++) {
+    char c = buf[i];
+
+    if (c == '>') {
+      if (i == 1 || value > 191) {
+        return 0;
+      }
+
+      *pri_value = value;
+      return i + 1;
+    }
+
+    if (c < '0' || c > '9') {
+      return 0;
+    }
+
+    value = value * 10 + (c - '0');
+  }
 
   return 0;
 }
@@ -316,7 +748,13 @@ int parse_iso_8601(const char* datestring, struct tm* tptr) {
   int y,M,d,h,m;
   float s;
   int tzh = 0, tzm = 0;
-  if (6 < sscanf(datestring, "%d-%d-%dT%d:%d:%f%d:%dZ", &y, &M, &d, &h, &m, &s, &tzh, &tzm)) {
+  int fields = sscanf(datestring, "%d-%d-%dT%d:%d:%f%d:%dZ", &y, &M, &d, &h, &m, &s, &tzh, &tzm);
+  if (fields < 6) {
+    // Not even a date and a time, leave tptr alone
+    return 0;
+  }
+
+  if (fields > 6) {
     if (tzh < 0) {
       tzm = -tzm;    // Fix the sign on minutes.
     }
@@ -332,6 +770,40 @@ int parse_iso_8601(const char* datestring, struct tm* tptr) {
   return 1;
 }
 
+// The +HH:MM or -HH:MM after the time, in minutes. Z, or no offset at all, is 0.
+static int timestamp_offset_minutes(const char* raw) {
+  const char* time = strchr(raw, 'T');
+  if (!time) {
+    return 0;
+  }
+
+  const char* offset = strpbrk(time, "+-");
+  if (!offset || !isdigit(offset[1]) || !isdigit(offset[2]) || offset[3] != ':' || !isdigit(offset[4]) || !isdigit(offset[5])) {
+    return 0;
+  }
+
+  int minutes = ((offset[1] - '0') * 10 + (offset[2] - '0')) * 60 + (offset[4] - '0') * 10 + (offset[5] - '0');
+  return offset[0] == '-' ? -minutes : minutes;
+}
+
+int syslog_message_epoch(const syslog_message_t * message, int64_t * seconds) {
+  const char* raw = message->raw_timestamp;
+
+  if (raw && raw[0] == NIL && !raw[1]) {
+    return 0;
+  }
+
+  // timegm may normalize its argument so give it a copy
+  struct tm timestamp = message->timestamp;
+  *seconds = (int64_t) timegm(&timestamp);
+
+  if (raw) {
+    *seconds -= (int64_t) timestamp_offset_minutes(raw) * 60;
+  }
+
+  return 1;
+}
+
 char* filter_nil(char* s) {
   if (strlen(s) == 1 && s[0] == NIL) {
     // Null the string so it is empty
@@ -341,165 +813,714 @@ char* filter_nil(char* s) {
   return s;
 }
 
-int parse_syslog_message_t(const char* raw_message, syslog_message_t * message) {
-  if (!raw_message) {
+// Runs the filter for a stage if it looks at anything that stage made known.
+// Returns 1 when the message should be dropped. Once the filter has matched
+// there is nothing left for it to decide, so it stops being asked.
+static int filter_rejects(const syslog_parse_options_t * options, syslog_message_t * message, syslog_filter_stage_t stage, int * filter_pending) {
+  if (!*filter_pending || !(syslog_filter_stages(options->filter) & (1u << stage))) {
     return 0;
   }
 
-  syslog_parse_context_t ctx = create_parse_context(raw_message);
+  int result = syslog_filter_evaluate(options->filter, message, stage);
+  if (result == SYSLOG_FILTER_MATCH) {
+    *filter_pending = 0;
+  }
 
-  size_t allocation_size = (strlen(raw_message) * 2) + 2;
+  return result == SYSLOG_FILTER_NO_MATCH;
+}
 
-  // Use calloc so we cget a zero'd buffer
-  message->raw_interned_message = calloc(allocation_size, sizeof(char));
+// Hashes the selected fields in a fixed order. lengths holds the length of
+// each field, indexed by its bit position in SYSLOG_FIELD_*.
+static uint64_t hash_fields(const syslog_message_t * message, unsigned fields, const size_t * lengths) {
+  const char* values[SYSLOG_FIELD_COUNT] = {
+    message->hostname,
+    message->appname,
+    message->process_id,
+    message->message_id,
+    message->message
+  };
+
+  uint64_t h = 0;
+  int i;
+  for (i = 0; i < SYSLOG_FIELD_COUNT; i++) {
+    if (fields & (1u << i)) {
+      h = syslog_fingerprint_field(h, values[i], lengths[i]);
+    }
+  }
 
-  // Just keep this for ease of access
-  char* intern = message->raw_interned_message;
+  return h;
+}
 
-  // --- PRI
-  char buf = 0;
-  if (!parse_context_one(&ctx, &buf) || buf != '<') {
-    free_syslog_message_t(message);
-    return 0;
+// Running hashes the parser builds up one field at a time, while each field is
+// still in cache. Fields go in in SYSLOG_FIELD_* order, the same as
+// hash_fields, so the results match syslog_message_hash.
+typedef struct field_hashes_t {
+  unsigned fingerprint_fields;
+  unsigned shard_key_fields;
+  uint64_t fingerprint;
+  uint64_t shard_key;
+} field_hashes_t;
+
+static void hash_parsed_field(field_hashes_t * hashes, unsigned field, const char* value, size_t length) {
+  if (!((hashes->fingerprint_fields | hashes->shard_key_fields) & field)) {
+    return;
   }
 
-  int intern_pointer = 0;
-
-  int pri_val_length = parse_context_next_until(&ctx, '>', &intern[intern_pointer], 0);
-  // We do not need the position here. Just check if it worked
-  if (!pri_val_length) {
-    free_syslog_message_t(message);
-    return 0;
+  // NIL fields have been emptied by filter_nil, and MSG can be missing
+  if (!value || !value[0]) {
+    value = "";
+    length = 0;
   }
 
-  // Don't forget the null terminator
-  intern_pointer += pri_val_length + 1;
+  uint64_t field_hash = syslog_hash64(value, length, SYSLOG_FINGERPRINT_SEED);
 
-  // Again... for clarity's sake
-  int pri_value = atoi(&intern[0]);
+  if (hashes->fingerprint_fields & field) {
+    hashes->fingerprint = syslog_hash64_combine(hashes->fingerprint, field_hash);
+  }
+  if (hashes->shard_key_fields & field) {
+    hashes->shard_key = syslog_hash64_combine(hashes->shard_key, field_hash);
+  }
+}
 
-  if (pri_value < 0 || pri_value > 191) {
-    free_syslog_message_t(message);
-    return 0;
+// Points HOSTNAME, APP-NAME or MSGID at its copy in the buffer, or with an
+// intern table in the options, at the table's copy of it, interned straight
+// from the input. Returns how much of the buffer the field takes up, or -1
+// when the table could not take it.
+static int place_header_field(const syslog_parse_options_t * options, const char* raw, char* copy, size_t length, const char** field, uint32_t * id) {
+  if (!options || !options->intern) {
+    *field = filter_nil(copy);
+    return length + 1;
   }
 
-  int facility_id = get_facility_id(pri_value);
-  // Omg we got our first syslog value
-  message->pri_value = pri_value;
-  message->facility = facility_id / 8;
-  message->severity = pri_value - facility_id;
+  // NIL is interned as the empty string
+  *id = syslog_intern(options->intern, raw, length == 1 && raw[0] == NIL ? 0 : length);
+  if (*id == SYSLOG_INTERN_ERROR) {
+    return -1;
+  }
 
-  // We are actually done with that string in the intern buffer now
+  *field = syslog_intern_string(options->intern, *id);
+  return 0;
+}
 
-  // --- VERSION
-  int syslog_version_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
-  if (!syslog_version_length || syslog_version_length > 2) {
-    free_syslog_message_t(message);
+// Asks the dedup table about the message, which counts it as seen if it is not
+// a repeat
+static int is_duplicate(const syslog_parse_options_t * options, const syslog_message_t * message) {
+  if (!options || !options->dedup) {
     return 0;
   }
 
-  message->syslog_version = &intern[intern_pointer];
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
 
-  intern_pointer += syslog_version_length + 1;
+  return !syslog_dedup_check(options->dedup, message->fingerprint, (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
 
-  // --- TIMESTAMP
-  int timestamp_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
-  if (!timestamp_length) {
-    free_syslog_message_t(message);
-    return 0;
-  }
+uint64_t syslog_message_hash(const syslog_message_t * message, unsigned fields) {
+  size_t lengths[SYSLOG_FIELD_COUNT] = {
+    message->hostname ? strlen(message->hostname) : 0,
+    message->appname ? strlen(message->appname) : 0,
+    message->process_id ? strlen(message->process_id) : 0,
+    message->message_id ? strlen(message->message_id) : 0,
+    message->message ? strlen(message->message) : 0
+  };
 
-  char* timestamp = &intern[intern_pointer];
+  return hash_fields(message, fields, lengths);
+}
 
-  if (timestamp_length == 1 && timestamp[0] == NIL) {
-    // This means we want to get the current time
-    time_t rawtime;
-    time(&rawtime);
+// Jump consistent hash, Lamping and Veach 2014. Growing from n to n + 1
+// buckets moves only 1/(n + 1) of the keys, all of them into the new bucket.
+uint32_t syslog_shard(uint64_t key, uint32_t buckets) {
+  int64_t b = -1;
+  int64_t j = 0;
 
-    message->timestamp = *localtime(&rawtime);
-  } else {
-    parse_iso_8601(timestamp, &message->timestamp);
+  while (j < (int64_t) buckets) {
+    b = j;
+    key = key * 2862933555777941757ULL + 1;
+    j = (int64_t) ((b + 1) * ((double) (1LL << 31) / (double) ((key >> 33) + 1)));
   }
 
-  intern_pointer += timestamp_length + 1;
+  return b < 0 ? 0 : (uint32_t) b;
+}
 
-  // We do not need the timestamp anymore either
+static const char* PARSE_ERROR_NAMES[SYSLOG_ERROR_COUNT] = {
+  "none",
+  "empty input",
+  "bad PRI",
+  "bad VERSION",
+  "bad TIMESTAMP",
+  "missing header field",
+  "unterminated structured data",
+  "header field too long",
+  "bad character in header field",
+  "malformed structured data",
+  "message too long",
+  "MSG is not UTF-8",
+  "intern table could not grow"
+};
+
+const char* syslog_parse_error_name(syslog_parse_error_t error) {
+  if (error < 0 || error >= SYSLOG_ERROR_COUNT) {
+    return "unknown";
+  }
 
-  // --- HOSTNAME
-  int hostname_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
-  if (!hostname_length) {
-    free_syslog_message_t(message);
+  return PARSE_ERROR_NAMES[error];
+}
+
+// --- Strict mode
+
+#define MAX_HOSTNAME_LENGTH 255
+#define MAX_APPNAME_LENGTH 48
+#define MAX_PROCID_LENGTH 128
+#define MAX_MSGID_LENGTH 32
+#define MAX_SD_NAME_LENGTH 32
+
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+static uint64_t load_le64(const char* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+// The high bit of a byte is set when it is outside PRINTUSASCII, 33 to 126,
+// or (for SD-NAMEs) is one of = ] ". A borrow or carry only ever runs up from
+// a byte that is already flagged, so the lowest flagged byte is exact.
+static uint64_t swar_bad_bytes(uint64_t word, int sd_name) {
+  uint64_t bad = ((word - SWAR_ONES * 33) & ~word) | ((word + SWAR_ONES) | word);
+
+  if (sd_name) {
+    uint64_t equals = word ^ (SWAR_ONES * EQUALS);
+    uint64_t bracket = word ^ (SWAR_ONES * CLOSE_BRACKET);
+    uint64_t quote = word ^ (SWAR_ONES * QUOTE);
+
+    bad |= ((equals - SWAR_ONES) & ~equals) | ((bracket - SWAR_ONES) & ~bracket) | ((quote - SWAR_ONES) & ~quote);
+  }
+
+  return bad & SWAR_HIGHS;
+}
+
+static int is_bad_byte(char c, int sd_name) {
+  return c < 33 || c > 126 || (sd_name && (c == EQUALS || c == CLOSE_BRACKET || c == QUOTE));
+}
+
+// How many bytes from the start are fine, sixteen at a time with SSE2 and
+// eight at a time otherwise
+static size_t printusascii_span(const char* s, size_t length, int sd_name) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i below = _mm_set1_epi8(32);
+  const __m128i above = _mm_set1_epi8(127);
+  const __m128i equals = _mm_set1_epi8(EQUALS);
+  const __m128i bracket = _mm_set1_epi8(CLOSE_BRACKET);
+  const __m128i quote = _mm_set1_epi8(QUOTE);
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) (s + i));
+    // The compares are signed, so anything from 0x80 up is negative and fails the first one
+    __m128i good = _mm_and_si128(_mm_cmpgt_epi8(chunk, below), _mm_cmplt_epi8(chunk, above));
+    if (sd_name) {
+      __m128i reserved = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, equals),
+                                                   _mm_cmpeq_epi8(chunk, bracket)),
+                                      _mm_cmpeq_epi8(chunk, quote));
+      good = _mm_andnot_si128(reserved, good);
+    }
+
+    int bad = ~_mm_movemask_epi8(good) & 0xFFFF;
+    if (bad) {
+      return i + __builtin_ctz(bad);
+    }
+  }
+#endif
+
+  for (; i + 8 <= length; i += 8) {
+    uint64_t bad = swar_bad_bytes(load_le64(s + i), sd_name);
+    if (bad) {
+      return i + __builtin_ctzll(bad) / 8;
+    }
+  }
+
+  for (; i < length; i++) {
+    if (is_bad_byte(s[i], sd_name)) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+static syslog_parse_error_t strict_header_field(const char* field, size_t length, size_t max_length) {
+  if (length > max_length) {
+    return SYSLOG_ERROR_FIELD_TOO_LONG;
+  }
+  if (printusascii_span(field, length, 0) != length) {
+    return SYSLOG_ERROR_BAD_CHARACTER;
+  }
+  return SYSLOG_ERROR_NONE;
+}
+
+static int strict_version(const char* version, size_t length) {
+  size_t i;
+
+  if (version[0] < '1' || version[0] > '9') {
     return 0;
   }
+  for (i = 1; i < length; i++) {
+    if (version[i] < '0' || version[i] > '9') {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// 0 when there is no SD-NAME at p, or it is too long
+static size_t strict_sd_name(const char* p, const char* end) {
+  size_t limit = end - p < MAX_SD_NAME_LENGTH + 1 ? end - p : MAX_SD_NAME_LENGTH + 1;
+  size_t length = printusascii_span(p, limit, 1);
+
+  return length <= MAX_SD_NAME_LENGTH ? length : 0;
+}
+
+// Walks STRUCTURED-DATA the way RFC5424 section 6.3 has it. Returns NULL if it
+// is well formed and followed by a separator or the end, otherwise where it
+// went wrong.
+static const char* strict_structured_data(const char* p, const char* end, syslog_parse_error_t * error) {
+  *error = SYSLOG_ERROR_BAD_SD;
+
+  if (p < end && *p == NIL) {
+    p++;
+    return p == end || *p == SEPARATOR ? NULL : p;
+  }
+
+  if (p == end || *p != OPEN_BRACKET) {
+    return p;
+  }
+
+  const char* element = p;
+
+  while (p < end && *p == OPEN_BRACKET) {
+    element = p++;
+
+    size_t length = strict_sd_name(p, end);
+    if (!length) {
+      goto fail;
+    }
+    p += length;
+
+    while (p < end && *p == SEPARATOR) {
+      p++;
+
+      length = strict_sd_name(p, end);
+      if (!length) {
+        goto fail;
+      }
+      p += length;
+
+      if (p == end || *p != EQUALS || ++p == end || *p != QUOTE) {
+        goto fail;
+      }
+      p++;
 
-  message->hostname = filter_nil(&intern[intern_pointer]);
+      while (p < end && *p != QUOTE) {
+        if (*p == ESCAPE && p + 1 < end) {
+          p++;
+        }
+        p++;
+      }
+
+      if (p >= end) {
+        p = end;
+        goto fail;
+      }
+
+      // Skip the closing quote
+      p++;
+    }
+
+    if (p == end || *p != CLOSE_BRACKET) {
+      goto fail;
+    }
+    p++;
+  }
+
+  return p == end || *p == SEPARATOR ? NULL : p;
+
+fail:
+  // Running out of input part way through an element is the same mistake the
+  // lenient parse reports
+  if (p == end) {
+    *error = SYSLOG_ERROR_UNTERMINATED_SD;
+    return element;
+  }
+  return p;
+}
+
+// Records why the parse failed and where, then cleans up
+#define PARSE_FAIL(reason, offset) do { \
+    message->error = (reason); \
+    message->error_offset = (offset); \
+    free_syslog_message_t(message); \
+    return SYSLOG_PARSE_FAILED; \
+  } while (0)
+
+// Checks the header field that was just read
+#define STRICT_HEADER_FIELD(field, length, max_length) do { \
+    syslog_parse_error_t field_error; \
+    if (strict && (field_error = strict_header_field((field), (length), (max_length)))) { \
+      PARSE_FAIL(field_error, ctx.pointer - (length) - 1); \
+    } \
+  } while (0)
+
+int parse_syslog_message_t(const char* raw_message, syslog_message_t * message) {
+  return parse_syslog_message_with_options_t(raw_message, message, NULL) == SYSLOG_PARSE_OK;
+}
+
+static syslog_parse_result_t parse_message(const char* raw_message, size_t raw_length, syslog_message_t * message, const syslog_parse_options_t * options);
+
+syslog_parse_result_t parse_syslog_message_with_options_t(const char* raw_message, syslog_message_t * message, const syslog_parse_options_t * options) {
+  size_t raw_length = 0;
+  if (raw_message) {
+    // Junk from a misbehaving sender can be huge. One byte past the limit is
+    // enough to know it is too long.
+    raw_length = options && options->max_message_size ? strnlen(raw_message, options->max_message_size + 1) : strlen(raw_message);
+  }
 
-  intern_pointer += hostname_length + 1;
+  message->error = SYSLOG_ERROR_NONE;
+  message->error_offset = 0;
+  message->received_ns = options ? options->received_ns : 0;
+  message->parsed_ns = 0;
+
+  syslog_parse_result_t result = parse_message(raw_message, raw_length, message, options);
+  syslog_stats_record(result, message->error, raw_length);
+
+  if (result == SYSLOG_PARSE_OK && message->received_ns) {
+    message->parsed_ns = syslog_now_ns();
+    syslog_latency_record(SYSLOG_LATENCY_PARSE, message->parsed_ns > message->received_ns ? message->parsed_ns - message->received_ns : 0);
+  }
+
+  return result;
+}
+
+static syslog_parse_result_t parse_message(const char* raw_message, size_t raw_length, syslog_message_t * message, const syslog_parse_options_t * options) {
+  if (!raw_message || !raw_length) {
+    message->error = SYSLOG_ERROR_EMPTY_INPUT;
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  int filter_pending = options && options->filter;
+
+  message->raw_interned_message = NULL;
+  message->structured_data = NULL;
+  message->structured_data_count = 0;
+  message->structured_data_index = NULL;
+  message->fingerprint = 0;
+  message->shard_key = 0;
+  message->sample_weight = 1;
+  message->has_bom = 0;
+  message->is_utf8 = 0;
+  message->hostname_id = SYSLOG_INTERN_NIL;
+  message->appname_id = SYSLOG_INTERN_NIL;
+  message->message_id_id = SYSLOG_INTERN_NIL;
+
+  if (options && options->max_message_size && raw_length > options->max_message_size) {
+    PARSE_FAIL(SYSLOG_ERROR_MESSAGE_TOO_LONG, options->max_message_size);
+  }
+
+  int strict = options && options->strict;
+
+  // The fingerprint is only needed to find duplicates
+  field_hashes_t hashes = {
+    options && options->dedup ? SYSLOG_FINGERPRINT_FIELDS : 0,
+    options ? options->shard_key_fields : 0,
+    0, 0
+  };
+
+  // --- PRI
+  // This is decoded straight from the input so that a message the PRI mask
+  // drops costs nothing more than reading a few bytes
+  int pri_value = 0;
+  size_t pri_length = decode_pri(raw_message, raw_length, &pri_value);
+  if (!pri_length) {
+    PARSE_FAIL(SYSLOG_ERROR_BAD_PRI, 0);
+  }
+
+  if (options && options->pri_mask && !syslog_pri_mask_accepts(options->pri_mask, pri_value)) {
+    free_syslog_message_t(message);
+    return SYSLOG_PARSE_FILTERED;
+  }
+
+  int facility_id = get_facility_id(pri_value);
+  // Omg we got our first syslog value
+  message->pri_value = pri_value;
+  message->facility = facility_id / 8;
+  message->severity = pri_value - facility_id;
+
+  // Only PRI is known yet, so this is as early as a filter can run, and a
+  // message dropped here never gets its intern buffer
+  if (filter_rejects(options, message, SYSLOG_FILTER_STAGE_PRI, &filter_pending)) {
+    free_syslog_message_t(message);
+    return SYSLOG_PARSE_FILTERED;
+  }
+
+  syslog_parse_context_t ctx = create_parse_context(raw_message);
+  ctx.pointer = pri_length;
+  ctx.is_eol = pri_length >= raw_length;
+
+  size_t allocation_size = (raw_length * 2) + 2;
+
+  // Interned header fields never take up room in the buffer
+  int interning = options && options->intern;
+  syslog_header_t header;
+  if (interning && syslog_peek_header(raw_message, raw_length, &header)) {
+    allocation_size -= (header.hostname_length + header.appname_length + header.message_id_length) * 2;
+  }
+
+  // Use calloc so we cget a zero'd buffer
+  message->raw_interned_message = syslog_calloc(allocation_size, sizeof(char));
+
+  // Just keep this for ease of access
+  char* intern = message->raw_interned_message;
+
+  int intern_pointer = 0;
+
+  // --- VERSION
+  int syslog_version_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
+  if (!syslog_version_length || syslog_version_length > 2) {
+    PARSE_FAIL(SYSLOG_ERROR_BAD_VERSION, pri_length);
+  }
+
+  if (strict && !strict_version(&intern[intern_pointer], syslog_version_length)) {
+    PARSE_FAIL(SYSLOG_ERROR_BAD_VERSION, pri_length);
+  }
+
+  message->syslog_version = &intern[intern_pointer];
+
+  intern_pointer += syslog_version_length + 1;
+
+  // --- TIMESTAMP
+  size_t timestamp_offset = ctx.pointer;
+  int timestamp_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
+  if (!timestamp_length) {
+    PARSE_FAIL(SYSLOG_ERROR_MISSING_FIELD, timestamp_offset);
+  }
+
+  char* timestamp = &intern[intern_pointer];
+
+  // Keep the original text around, the struct tm loses the fraction and offset
+  message->raw_timestamp = timestamp;
+
+  if (timestamp_length == 1 && timestamp[0] == NIL) {
+    // This means we want to get the current time
+    time_t rawtime;
+    time(&rawtime);
+
+    message->timestamp = *localtime(&rawtime);
+  } else if (!parse_iso_8601(timestamp, &message->timestamp)) {
+    PARSE_FAIL(SYSLOG_ERROR_BAD_TIMESTAMP, timestamp_offset);
+  }
+
+  intern_pointer += timestamp_length + 1;
+
+  // We do not need the timestamp anymore either
+
+  // --- HOSTNAME
+  size_t hostname_offset = ctx.pointer;
+  int hostname_length = parse_context_next_until(&ctx, SEPARATOR, interning ? NULL : &intern[intern_pointer], 0);
+  if (!hostname_length) {
+    PARSE_FAIL(SYSLOG_ERROR_MISSING_FIELD, ctx.pointer);
+  }
+
+  STRICT_HEADER_FIELD(&raw_message[hostname_offset], hostname_length, MAX_HOSTNAME_LENGTH);
+
+  int hostname_size = place_header_field(options, &raw_message[hostname_offset], &intern[intern_pointer], hostname_length, &message->hostname, &message->hostname_id);
+  if (hostname_size < 0) {
+    PARSE_FAIL(SYSLOG_ERROR_INTERN_FAILED, hostname_offset);
+  }
+
+  hash_parsed_field(&hashes, SYSLOG_FIELD_HOSTNAME, message->hostname, hostname_length);
+
+  intern_pointer += hostname_size;
 
   // --- APP-NAME
-  int appname_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
+  size_t appname_offset = ctx.pointer;
+  int appname_length = parse_context_next_until(&ctx, SEPARATOR, interning ? NULL : &intern[intern_pointer], 0);
   if (!appname_length) {
-    free_syslog_message_t(message);
-    return 0;
+    PARSE_FAIL(SYSLOG_ERROR_MISSING_FIELD, ctx.pointer);
+  }
+
+  STRICT_HEADER_FIELD(&raw_message[appname_offset], appname_length, MAX_APPNAME_LENGTH);
+
+  int appname_size = place_header_field(options, &raw_message[appname_offset], &intern[intern_pointer], appname_length, &message->appname, &message->appname_id);
+  if (appname_size < 0) {
+    PARSE_FAIL(SYSLOG_ERROR_INTERN_FAILED, appname_offset);
   }
 
-  message->appname = filter_nil(&intern[intern_pointer]);
+  hash_parsed_field(&hashes, SYSLOG_FIELD_APPNAME, message->appname, appname_length);
 
-  intern_pointer += appname_length + 1;
+  intern_pointer += appname_size;
 
   // --- PROCID
   // surprisingly, can be a string up to 128 chars
   int process_id_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
   if (!process_id_length) {
-    free_syslog_message_t(message);
-    return 0;
+    PARSE_FAIL(SYSLOG_ERROR_MISSING_FIELD, ctx.pointer);
   }
 
+  STRICT_HEADER_FIELD(&intern[intern_pointer], process_id_length, MAX_PROCID_LENGTH);
+
   message->process_id = filter_nil(&intern[intern_pointer]);
+  hash_parsed_field(&hashes, SYSLOG_FIELD_PROCID, message->process_id, process_id_length);
 
-  intern_pointer += appname_length + 1;
+  intern_pointer += process_id_length + 1;
 
   // --- MSGID
-  int message_id_length = parse_context_next_until(&ctx, SEPARATOR, &intern[intern_pointer], 0);
+  size_t message_id_offset = ctx.pointer;
+  int message_id_length = parse_context_next_until(&ctx, SEPARATOR, interning ? NULL : &intern[intern_pointer], 0);
   if (!message_id_length) {
+    PARSE_FAIL(SYSLOG_ERROR_MISSING_FIELD, ctx.pointer);
+  }
+
+  STRICT_HEADER_FIELD(&raw_message[message_id_offset], message_id_length, MAX_MSGID_LENGTH);
+
+  int message_id_size = place_header_field(options, &raw_message[message_id_offset], &intern[intern_pointer], message_id_length, &message->message_id, &message->message_id_id);
+  if (message_id_size < 0) {
+    PARSE_FAIL(SYSLOG_ERROR_INTERN_FAILED, message_id_offset);
+  }
+
+  hash_parsed_field(&hashes, SYSLOG_FIELD_MSGID, message->message_id, message_id_length);
+
+  intern_pointer += message_id_size;
+
+  if (filter_rejects(options, message, SYSLOG_FILTER_STAGE_HEADER, &filter_pending)) {
     free_syslog_message_t(message);
-    return 0;
+    return SYSLOG_PARSE_FILTERED;
   }
 
-  message->message_id = filter_nil(&intern[intern_pointer]);
+  if (options && options->rate_limiter) {
+    syslog_rate_decision_t decision = syslog_rate_limit_message(options->rate_limiter, message);
+    if (decision == SYSLOG_RATE_DROP) {
+      free_syslog_message_t(message);
+      return SYSLOG_PARSE_FILTERED;
+    }
+
+    // Kept in place of the others that were dropped, so it counts for them too
+    if (decision == SYSLOG_RATE_SAMPLED) {
+      message->sample_weight = syslog_rate_limiter_sample_weight(options->rate_limiter);
+    }
+  }
 
-  intern_pointer += message_id_length + 1;
+  memset(&message->iana, 0, sizeof(syslog_iana_structured_data_t));
 
   size_t num_structured_data;
-  int buf_size = parse_context_get_structured_data_elements(&ctx, &intern[intern_pointer], &num_structured_data);
+  size_t structured_data_offset = ctx.pointer;
+
+  if (strict) {
+    syslog_parse_error_t structured_data_error;
+    const char* bad = strict_structured_data(raw_message + structured_data_offset, raw_message + raw_length, &structured_data_error);
+    if (bad) {
+      PARSE_FAIL(structured_data_error, bad - raw_message);
+    }
+  }
+
+  size_t unterminated;
+  int buf_size = parse_context_get_structured_data_elements(&ctx, &intern[intern_pointer], &num_structured_data, &unterminated);
+
+  // Anything else that is not quite structured data is let through as part of
+  // MSG, but an element running off the end means the rest of the message went
+  // with it
+  if (unterminated) {
+    PARSE_FAIL(SYSLOG_ERROR_UNTERMINATED_SD, unterminated);
+  }
+
+  // --- MSG
+  // Rest of the data is the message. It is hashed straight out of raw_message
+  // so a repeat can be dropped before anything after the header is decoded.
+  const char* raw_msg = NULL;
+  size_t message_size = 0;
+  size_t message_offset = ctx.pointer;
+  if (!parse_context_is_eol(&ctx)) {
+    raw_msg = raw_message + message_offset;
+    message_size = raw_length - message_offset;
+
+    if (message_size >= SYSLOG_UTF8_BOM_LENGTH && !memcmp(raw_msg, SYSLOG_UTF8_BOM, SYSLOG_UTF8_BOM_LENGTH)) {
+      raw_msg += SYSLOG_UTF8_BOM_LENGTH;
+      message_size -= SYSLOG_UTF8_BOM_LENGTH;
+      message->has_bom = 1;
+    }
+  }
+
+  // Before the dedup check, so a message that fails never counts as seen
+  if (strict && message->has_bom) {
+    message->is_utf8 = syslog_utf8_validate(raw_msg, message_size);
+    if (!message->is_utf8) {
+      PARSE_FAIL(SYSLOG_ERROR_BAD_UTF8, message_offset);
+    }
+  }
+
+  hash_parsed_field(&hashes, SYSLOG_FIELD_MESSAGE, raw_msg, message_size);
+
+  message->fingerprint = hashes.fingerprint;
+  message->shard_key = hashes.shard_key;
+
+  // A filter that still has SD or MSG to look at could drop the message, and
+  // only kept messages should count towards the dedup table
+  int dedup_late = filter_pending && (syslog_filter_stages(options->filter) & ((1u << SYSLOG_FILTER_STAGE_STRUCTURED_DATA) | (1u << SYSLOG_FILTER_STAGE_MESSAGE)));
+
+  if (!dedup_late && is_duplicate(options, message)) {
+    free_syslog_message_t(message);
+    return SYSLOG_PARSE_DUPLICATE;
+  }
 
   if (num_structured_data < 1) {
     message->structured_data = NULL;
     message->structured_data_count = 0;
   } else {
-    message->structured_data_count = num_structured_data;
-    message->structured_data = get_structured_data(&intern[intern_pointer], num_structured_data);
+    if (!get_structured_data(&intern[intern_pointer], num_structured_data, interning ? options->intern : NULL, &message->iana, &message->structured_data, &message->structured_data_count)) {
+      PARSE_FAIL(SYSLOG_ERROR_INTERN_FAILED, structured_data_offset);
+    }
   }
 
   // No matter what we need to increment the intern pointer here. Because we used the string.
   intern_pointer += buf_size + 1;
 
-  // --- MSG
-  // Rest of the data is the message
-  if (parse_context_is_eol(&ctx)) {
-    message->message = NULL;
-  } else {
-    int message_size = parse_context_next_until(&ctx, '\0', &intern[intern_pointer], 1);
-    message->message = &intern[intern_pointer];
+  if (filter_rejects(options, message, SYSLOG_FILTER_STAGE_STRUCTURED_DATA, &filter_pending)) {
+    free_syslog_message_t(message);
+    return SYSLOG_PARSE_FILTERED;
+  }
 
+  if (raw_msg) {
+    memcpy(&intern[intern_pointer], raw_msg, message_size);
+    message->message = &intern[intern_pointer];
     intern_pointer += message_size + 1;
+  } else {
+    message->message = NULL;
   }
 
   intern[intern_pointer] = 0;
 
+  if (filter_rejects(options, message, SYSLOG_FILTER_STAGE_MESSAGE, &filter_pending)) {
+    free_syslog_message_t(message);
+    return SYSLOG_PARSE_FILTERED;
+  }
+
+  // After the filter, so only messages that are being kept pay for it
+  if (options && options->validate_utf8 && !message->is_utf8) {
+    message->is_utf8 = !message->message || syslog_utf8_validate(message->message, message_size);
+  }
+
+  if (dedup_late && is_duplicate(options, message)) {
+    free_syslog_message_t(message);
+    return SYSLOG_PARSE_DUPLICATE;
+  }
+
 #ifdef OPTIMIZE_FOR_MEMORY
   // This is the real length of the string so we can realloc it
-  intern = realloc(intern, intern_pointer);
+  intern = syslog_realloc(intern, intern_pointer);
 #endif
 
   return 1;
@@ -519,14 +1540,14 @@ void free_syslog_extended_property_t(syslog_extended_property_t * extended_prope
       free_syslog_extended_property_value_t(&extended_property->pairs[i]);
     }
 
-    free(extended_property->pairs);
+    syslog_free(extended_property->pairs);
   }
   extended_property->pairs = NULL;
 
   // Null the chair pointer
   extended_property->id = NULL;
 
-  free(extended_property->raw_interned_message);
+  syslog_free(extended_property->raw_interned_message);
 }
 
 void free_syslog_message_t(syslog_message_t * msg) {
@@ -540,6 +1561,7 @@ void free_syslog_message_t(syslog_message_t * msg) {
   msg->hostname = NULL;
   msg->appname = NULL;
   msg->process_id = NULL;
+  msg->raw_timestamp = NULL;
 
   if (msg->structured_data) {
     size_t i;
@@ -548,12 +1570,284 @@ void free_syslog_message_t(syslog_message_t * msg) {
     }
   }
 
-  free(msg->structured_data);
+  syslog_free(msg->structured_data);
 
   msg->structured_data = NULL;
 
+  syslog_free(msg->structured_data_index);
+
+  msg->structured_data_index = NULL;
+
   // Free the raw interned message
-  free(msg->raw_interned_message);
+  syslog_free(msg->raw_interned_message);
 
   msg->raw_interned_message = NULL;
 }
+
+// --- Event parser
+// A second, allocation free walk over the message. It is strict where the
+// interning parser is lenient: malformed structured data fails the parse
+// rather than being dropped.
+
+// Reads a header field up to the next separator. NIL comes back as an empty
+// span. Returns where the next field starts, or NULL if there is no field.
+static const char* events_header_field(const char* p, const char* end, syslog_span_t * out) {
+  const char* separator = memchr(p, SEPARATOR, end - p);
+  if (!separator || separator == p) {
+    return NULL;
+  }
+
+  out->data = p;
+  out->length = separator - p;
+
+  if (out->length == 1 && *p == NIL) {
+    out->length = 0;
+  }
+
+  return separator + 1;
+}
+
+#define EMIT_EVENT(callback, ...) \
+  if (handler->callback && !handler->callback(user, __VA_ARGS__)) { \
+    return SYSLOG_PARSE_ABORTED; \
+  }
+
+#define EMIT_HEADER_FIELD(callback) \
+  p = events_header_field(p, end, &span); \
+  if (!p) { \
+    return SYSLOG_PARSE_FAILED; \
+  } \
+  EMIT_EVENT(callback, span)
+
+static syslog_parse_result_t events_structured_data(const char** cursor, const char* end, const syslog_handler_t * handler, void* user) {
+  const char* p = *cursor;
+
+  if (*p == NIL) {
+    *cursor = p + 1;
+    return SYSLOG_PARSE_OK;
+  }
+
+  while (p < end && *p == OPEN_BRACKET) {
+    p++;
+
+    // SD-ID runs until a space or the end of the element
+    const char* id_start = p;
+    while (p < end && *p != SEPARATOR && *p != CLOSE_BRACKET) {
+      p++;
+    }
+
+    if (p == id_start || p == end) {
+      return SYSLOG_PARSE_FAILED;
+    }
+
+    syslog_span_t id = {id_start, p - id_start};
+    EMIT_EVENT(on_sd_element, id);
+
+    while (*p == SEPARATOR) {
+      p++;
+
+      const char* name_start = p;
+      while (p < end && *p != EQUALS && *p != SEPARATOR && *p != CLOSE_BRACKET && *p != QUOTE) {
+        p++;
+      }
+
+      if (p == name_start || end - p < 2 || p[0] != EQUALS || p[1] != QUOTE) {
+        return SYSLOG_PARSE_FAILED;
+      }
+
+      syslog_span_t name = {name_start, p - name_start};
+
+      p += 2;
+
+      const char* value_start = p;
+      int escaped = 0;
+      while (p < end && *p != QUOTE) {
+        if (*p == ESCAPE) {
+          escaped = 1;
+          p++;
+        }
+        p++;
+      }
+
+      if (p >= end) {
+        return SYSLOG_PARSE_FAILED;
+      }
+
+      syslog_span_t value = {value_start, p - value_start};
+      EMIT_EVENT(on_sd_param, name, value, escaped);
+
+      // Skip the closing quote
+      p++;
+
+      if (p == end) {
+        return SYSLOG_PARSE_FAILED;
+      }
+    }
+
+    if (*p != CLOSE_BRACKET) {
+      return SYSLOG_PARSE_FAILED;
+    }
+
+    p++;
+
+    if (handler->on_sd_element_end && !handler->on_sd_element_end(user)) {
+      return SYSLOG_PARSE_ABORTED;
+    }
+  }
+
+  if (p == *cursor) {
+    // Structured data must be NIL or start with an open bracket
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  *cursor = p;
+  return SYSLOG_PARSE_OK;
+}
+
+syslog_parse_result_t syslog_parse_events(const char* buf, size_t len, const syslog_handler_t * handler, void* user) {
+  if (!buf || !handler) {
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  const char* p = buf;
+  const char* end = buf + len;
+
+  // --- PRI
+  int pri_value = 0;
+  size_t pri_length = decode_pri(p, len, &pri_value);
+  if (!pri_length) {
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  p += pri_length;
+
+  int facility_id = get_facility_id(pri_value);
+  EMIT_EVENT(on_pri, pri_value, facility_id / 8, pri_value - facility_id);
+
+  // --- VERSION, TIMESTAMP, HOSTNAME, APP-NAME, PROCID, MSGID
+  syslog_span_t span;
+
+  EMIT_HEADER_FIELD(on_version);
+  if (span.length > 2) {
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  EMIT_HEADER_FIELD(on_timestamp);
+  EMIT_HEADER_FIELD(on_hostname);
+  EMIT_HEADER_FIELD(on_appname);
+  EMIT_HEADER_FIELD(on_process_id);
+  EMIT_HEADER_FIELD(on_message_id);
+
+  // --- STRUCTURED-DATA
+  if (p == end) {
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  syslog_parse_result_t result = events_structured_data(&p, end, handler, user);
+  if (result != SYSLOG_PARSE_OK) {
+    return result;
+  }
+
+  // --- MSG
+  if (p == end) {
+    return SYSLOG_PARSE_OK;
+  }
+
+  if (*p != SEPARATOR) {
+    return SYSLOG_PARSE_FAILED;
+  }
+
+  p++;
+
+  if (p < end) {
+    syslog_span_t message = {p, end - p};
+    EMIT_EVENT(on_message, message);
+  }
+
+  return SYSLOG_PARSE_OK;
+}
+
+size_t syslog_sd_unescape(syslog_span_t value, char* out) {
+  size_t i;
+  size_t length = 0;
+
+  for (i = 0; i < value.length; i++) {
+    char c = value.data[i];
+
+    // Only ", \ and ] can be escaped. Anything else keeps its backslash.
+    // See https://tools.ietf.org/html/rfc5424#section-6.3.3
+    if (c == ESCAPE && i + 1 < value.length) {
+      char next = value.data[i + 1];
+      if (next == QUOTE || next == ESCAPE || next == CLOSE_BRACKET) {
+        c = next;
+        i++;
+      }
+    }
+
+    out[length++] = c;
+  }
+
+  return length;
+}
+
+// --- Header peeking
+
+int syslog_peek_header(const char* buf, size_t len, syslog_header_t * header) {
+  if (!buf) {
+    return 0;
+  }
+
+  const char* p = buf;
+  const char* end = buf + len;
+
+  int pri_value = 0;
+  size_t pri_length = decode_pri(p, len, &pri_value);
+  if (!pri_length) {
+    return 0;
+  }
+
+  p += pri_length;
+
+  // VERSION is one or two digits
+  int version = 0;
+  const char* version_start = p;
+  while (p < end && *p >= '0' && *p <= '9' && p - version_start < 2) {
+    version = version * 10 + (*p - '0');
+    p++;
+  }
+
+  if (p == version_start || p == end || *p != SEPARATOR) {
+    return 0;
+  }
+
+  p++;
+
+  syslog_span_t timestamp, hostname, appname, process_id, message_id;
+
+  if (!(p = events_header_field(p, end, &timestamp))
+      || !(p = events_header_field(p, end, &hostname))
+      || !(p = events_header_field(p, end, &appname))
+      || !(p = events_header_field(p, end, &process_id))
+      || !(p = events_header_field(p, end, &message_id))) {
+    return 0;
+  }
+
+  int facility_id = get_facility_id(pri_value);
+
+  header->pri_value = pri_value;
+  header->facility = facility_id / 8;
+  header->severity = pri_value - facility_id;
+  header->version = version;
+
+  header->hostname_offset = hostname.data - buf;
+  header->hostname_length = hostname.length;
+  header->appname_offset = appname.data - buf;
+  header->appname_length = appname.length;
+  header->process_id_offset = process_id.data - buf;
+  header->process_id_length = process_id.length;
+  header->message_id_offset = message_id.data - buf;
+  header->message_id_length = message_id.length;
+  header->structured_data_offset = p - buf;
+
+  return 1;
+}
@@ -7,6 +7,7 @@
 #include <time.h>
 #include <limits.h>
 #include <string.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"{
@@ -15,6 +16,9 @@ extern "C"{
 typedef struct syslog_extended_property_value_t {
   char* key;
   char* value;
+  // Id of the key in the parse options' intern table, which key then points
+  // into. 0 without a table.
+  uint32_t interned_key;
 } syslog_extended_property_value_t;
 
 typedef struct syslog_extended_property_t {
@@ -22,8 +26,81 @@ typedef struct syslog_extended_property_t {
   syslog_extended_property_value_t * pairs;
   size_t num_pairs;
   char* raw_interned_message;
+  // Id of the SD-ID in the parse options' intern table, which id then points
+  // into. 0 without a table.
+  uint32_t interned_id;
 } syslog_extended_property_t;
 
+// Typed views of the SD-IDs registered with IANA in RFC5424 section 7. These
+// are filled in while structured data is parsed; the generic pairs are still
+// there for anything that wants the raw strings.
+#define SYSLOG_MAX_ORIGIN_IPS 4
+
+typedef struct syslog_ip_address_t {
+  int version; // 4 or 6
+  unsigned char address[16]; // Network byte order, only the first 4 bytes for v4
+} syslog_ip_address_t;
+
+typedef struct syslog_time_quality_t {
+  int present;
+  int tz_known; // -1 when the param was not given
+  int is_synced; // -1 when the param was not given
+  long sync_accuracy; // Microseconds, -1 when the param was not given
+} syslog_time_quality_t;
+
+typedef struct syslog_origin_t {
+  int present;
+  syslog_ip_address_t ips[SYSLOG_MAX_ORIGIN_IPS];
+  size_t ip_count;
+  const char* enterprise_id;
+  const char* software;
+  const char* sw_version;
+} syslog_origin_t;
+
+typedef struct syslog_meta_t {
+  int present;
+  long sequence_id; // -1 when the param was not given
+  long long sys_up_time; // Hundredths of a second, -1 when the param was not given
+  const char* language;
+} syslog_meta_t;
+
+typedef struct syslog_iana_structured_data_t {
+  syslog_time_quality_t time_quality;
+  syslog_origin_t origin;
+  syslog_meta_t meta;
+} syslog_iana_structured_data_t;
+
+// Why a parse failed
+typedef enum syslog_parse_error_t {
+  SYSLOG_ERROR_NONE = 0,
+  // NULL or ""
+  SYSLOG_ERROR_EMPTY_INPUT,
+  // No <PRI>, or one that is not a number from 0 to 191
+  SYSLOG_ERROR_BAD_PRI,
+  SYSLOG_ERROR_BAD_VERSION,
+  // Neither NIL nor a date and time
+  SYSLOG_ERROR_BAD_TIMESTAMP,
+  // The message ended before all of the header was there
+  SYSLOG_ERROR_MISSING_FIELD,
+  // A [ with no matching ]
+  SYSLOG_ERROR_UNTERMINATED_SD,
+  // Strict mode: a header field longer than RFC5424 allows
+  SYSLOG_ERROR_FIELD_TOO_LONG,
+  // Strict mode: a header field with something other than printable ASCII in it
+  SYSLOG_ERROR_BAD_CHARACTER,
+  // Strict mode: STRUCTURED-DATA that is not well formed
+  SYSLOG_ERROR_BAD_SD,
+  // Longer than the parse options' max_message_size
+  SYSLOG_ERROR_MESSAGE_TOO_LONG,
+  // Strict mode: MSG starts with a BOM but is not UTF-8
+  SYSLOG_ERROR_BAD_UTF8,
+  // The parse options' intern table could not take a name
+  SYSLOG_ERROR_INTERN_FAILED,
+  SYSLOG_ERROR_COUNT
+} syslog_parse_error_t;
+
+const char* syslog_parse_error_name(syslog_parse_error_t error);
+
 typedef struct syslog_message_t {
   const char* message;
   const char* syslog_version;
@@ -40,6 +117,8 @@ typedef struct syslog_message_t {
   const char* process_id;
 
   struct tm timestamp;
+  // The TIMESTAMP field exactly as it was received, "-" when NIL
+  const char* raw_timestamp;
   enum syslog_type {
     RFC5424=5424
   } syslog_type;
@@ -47,14 +126,232 @@ typedef struct syslog_message_t {
   syslog_extended_property_t * structured_data;
   size_t structured_data_count;
 
+  syslog_iana_structured_data_t iana;
+
+  // Lazily built by syslog_sd_find, freed with the message
+  void* structured_data_index;
+
+  // Hash of HOSTNAME, APP-NAME, MSGID and MSG. Only filled in when the parse
+  // options ask for deduplication, 0 otherwise.
+  uint64_t fingerprint;
+  // Hash of the parse options' shard_key_fields, 0 when there are none
+  uint64_t shard_key;
+  // How many messages this one stands for when counting: the limiter's
+  // sample_one_in when the rate limiter kept it as a sample of a source over
+  // its limit, 1 otherwise.
+  uint32_t sample_weight;
+
+  // Set when a parse fails, along with the byte offset into the input of the
+  // field that was wrong. The rest of the message is not valid then.
+  syslog_parse_error_t error;
+  size_t error_offset;
+
+  // Copied from the parse options' received_ns, and when that is set, the
+  // syslog_now_ns() time the parse finished. Both 0 otherwise.
+  uint64_t received_ns;
+  uint64_t parsed_ns;
+
   size_t message_length;
 
+  // MSG started with a UTF-8 BOM, which the sender uses to say it is UTF-8.
+  // message does not include the BOM.
+  int has_bom;
+  // MSG was checked and is well formed UTF-8, see validate_utf8 in the parse
+  // options. 0 when it was not checked.
+  int is_utf8;
+
+  // Ids of HOSTNAME, APP-NAME and MSGID in the parse options' intern table,
+  // whose strings hostname, appname and message_id then point at. NIL fields
+  // and messages parsed without a table have SYSLOG_INTERN_NIL (0).
+  uint32_t hostname_id;
+  uint32_t appname_id;
+  uint32_t message_id_id;
+
   char* raw_interned_message;
 } syslog_message_t;
 
+typedef enum syslog_parse_result_t {
+  SYSLOG_PARSE_FAILED = 0,
+  SYSLOG_PARSE_OK = 1,
+  // An event handler asked to stop
+  SYSLOG_PARSE_ABORTED = 2,
+  // The parse options decided the message is not wanted
+  SYSLOG_PARSE_FILTERED = 3,
+  // The dedup table has already seen this message inside its window
+  SYSLOG_PARSE_DUPLICATE = 4
+} syslog_parse_result_t;
+
+// Fields that can be hashed together into a fingerprint or shard key
+#define SYSLOG_FIELD_HOSTNAME (1u << 0)
+#define SYSLOG_FIELD_APPNAME (1u << 1)
+#define SYSLOG_FIELD_PROCID (1u << 2)
+#define SYSLOG_FIELD_MSGID (1u << 3)
+#define SYSLOG_FIELD_MESSAGE (1u << 4)
+#define SYSLOG_FIELD_COUNT 5
+
+#define SYSLOG_FINGERPRINT_FIELDS (SYSLOG_FIELD_HOSTNAME | SYSLOG_FIELD_APPNAME | SYSLOG_FIELD_MSGID | SYSLOG_FIELD_MESSAGE)
+
+struct syslog_filter_t;
+struct syslog_rate_limiter_t;
+struct syslog_dedup_t;
+struct syslog_intern_table_t;
+
+// One bit per PRI value, 0 to 191. Bit (pri_value & 63) of bits[pri_value >> 6]
+// is set when messages with that PRI are wanted.
+typedef struct syslog_pri_mask_t {
+  uint64_t bits[3];
+} syslog_pri_mask_t;
+
+void syslog_pri_mask_accept(syslog_pri_mask_t * mask, int pri_value);
+// Accepts every facility at max_severity and anything more severe
+void syslog_pri_mask_accept_severity(syslog_pri_mask_t * mask, int max_severity);
+int syslog_pri_mask_accepts(const syslog_pri_mask_t * mask, int pri_value);
+
+// Optional behaviour for parse_syslog_message_with_options_t. A zeroed struct,
+// or passing NULL, parses exactly like parse_syslog_message_t.
+typedef struct syslog_parse_options_t {
+  // Compiled with syslog_filter_compile. A message the filter rejects is
+  // dropped as soon as that is certain, before the fields after that point are
+  // copied or decoded.
+  const struct syslog_filter_t * filter;
+  // Messages whose PRI is not in the mask are dropped straight after <PRI> is
+  // read, before anything is allocated. NULL accepts everything.
+  const syslog_pri_mask_t * pri_mask;
+  // Asked about every message that got past the filter once its header is
+  // read. Messages it drops come back as SYSLOG_PARSE_FILTERED, and ones it
+  // samples say so in sample_weight.
+  struct syslog_rate_limiter_t * rate_limiter;
+  // Fills in fingerprint and collapses repeats of a message, which come back
+  // as SYSLOG_PARSE_DUPLICATE. Checked as soon as MSG is found, before SD is
+  // decoded or MSG copied, unless the filter still has to look at either; only
+  // kept messages count.
+  struct syslog_dedup_t * dedup;
+  // SYSLOG_FIELD_* bits to hash into shard_key, e.g. SYSLOG_FIELD_HOSTNAME |
+  // SYSLOG_FIELD_APPNAME to keep every source on one shard.
+  unsigned shard_key_fields;
+  // syslog_now_ns() when the message came off the wire. When set, the time
+  // from then to the end of a successful parse goes into the
+  // SYSLOG_LATENCY_PARSE histogram.
+  uint64_t received_ns;
+  // Fail messages the default parse would let through but RFC5424 does not:
+  // HOSTNAME, APP-NAME, PROCID and MSGID longer than 255, 48, 128 and 32
+  // bytes or with anything but printable ASCII in them, a VERSION that is
+  // not a number, and STRUCTURED-DATA that is not well formed, including
+  // SD-IDs and PARAM-NAMEs over 32 bytes.
+  int strict;
+  // Messages longer than this fail with SYSLOG_ERROR_MESSAGE_TOO_LONG before
+  // anything is allocated or copied, and without reading past the limit. 0
+  // means no limit.
+  size_t max_message_size;
+  // Check that MSG is UTF-8 and say so in is_utf8. Strict mode always checks
+  // a MSG that starts with a BOM, and fails it with SYSLOG_ERROR_BAD_UTF8 if
+  // it is not.
+  int validate_utf8;
+  // Looks HOSTNAME, APP-NAME, MSGID, SD-IDs and PARAM-NAMEs up in the table
+  // as they are parsed and points the message at the table's strings instead
+  // of giving it copies. The table has to outlive every message parsed with
+  // it, and is not thread safe, so use one per parsing thread. Messages fail
+  // with SYSLOG_ERROR_INTERN_FAILED if the table cannot grow.
+  struct syslog_intern_table_t * intern;
+} syslog_parse_options_t;
+
 int parse_syslog_message_t(const char*, syslog_message_t*);
+// Returns SYSLOG_PARSE_OK, SYSLOG_PARSE_FAILED, SYSLOG_PARSE_FILTERED or
+// SYSLOG_PARSE_DUPLICATE. There is nothing to free unless it returned
+// SYSLOG_PARSE_OK.
+syslog_parse_result_t parse_syslog_message_with_options_t(const char*, syslog_message_t*, const syslog_parse_options_t*);
 void free_syslog_message_t(syslog_message_t * syslog_message);
 
+// TIMESTAMP as seconds since the epoch. The timestamp struct holds the time as
+// it was written, so the offset is read back from raw_timestamp and taken off.
+// Messages built by hand without a raw_timestamp are taken to be in UTC.
+// Returns 0 for a NIL TIMESTAMP, which has no time of its own.
+int syslog_message_epoch(const syslog_message_t * message, int64_t * seconds);
+
+// The same hash the parser computes for the SYSLOG_FIELD_* bits in fields, for
+// messages that were built by hand or parsed without it. NIL fields hash like
+// empty ones.
+uint64_t syslog_message_hash(const syslog_message_t * message, unsigned fields);
+// Picks one of buckets shards for a key with a jump consistent hash, so adding
+// a shard only moves the keys that end up on it.
+uint32_t syslog_shard(uint64_t key, uint32_t buckets);
+
+// --- Event parsing
+// Walks a message without allocating or copying anything and reports each
+// piece as a span into the caller's buffer. Header fields that are NIL are
+// reported as empty spans. SD param values are reported exactly as they appear
+// on the wire; escaped is set when they contain escapes, in which case
+// syslog_sd_unescape can produce the real value.
+//
+// Every callback is optional. Returning 0 from any of them stops the parse and
+// syslog_parse_events returns SYSLOG_PARSE_ABORTED.
+
+typedef struct syslog_span_t {
+  const char* data;
+  size_t length;
+} syslog_span_t;
+
+typedef struct syslog_handler_t {
+  int (*on_pri)(void* user, int pri_value, int facility, int severity);
+  int (*on_version)(void* user, syslog_span_t version);
+  int (*on_timestamp)(void* user, syslog_span_t timestamp);
+  int (*on_hostname)(void* user, syslog_span_t hostname);
+  int (*on_appname)(void* user, syslog_span_t appname);
+  int (*on_process_id)(void* user, syslog_span_t process_id);
+  int (*on_message_id)(void* user, syslog_span_t message_id);
+  int (*on_sd_element)(void* user, syslog_span_t sd_id);
+  int (*on_sd_param)(void* user, syslog_span_t name, syslog_span_t value, int escaped);
+  int (*on_sd_element_end)(void* user);
+  int (*on_message)(void* user, syslog_span_t message);
+} syslog_handler_t;
+
+syslog_parse_result_t syslog_parse_events(const char* buf, size_t len, const syslog_handler_t * handler, void* user);
+
+// Writes the unescaped form of an SD param value to out, which needs room for
+// value.length bytes. Returns the unescaped length. No terminator is written.
+size_t syslog_sd_unescape(syslog_span_t value, char* out);
+
+// --- Header peeking
+// Decodes just enough of a message to route or drop it: PRI, VERSION and where
+// HOSTNAME, APP-NAME, PROCID and MSGID sit in buf. Nothing is copied and the
+// timestamp and structured data are not looked at. Offsets are from the start
+// of buf, and NIL fields have a length of 0.
+typedef struct syslog_header_t {
+  int pri_value;
+  int facility;
+  int severity;
+  int version;
+
+  size_t hostname_offset;
+  size_t hostname_length;
+  size_t appname_offset;
+  size_t appname_length;
+  size_t process_id_offset;
+  size_t process_id_length;
+  size_t message_id_offset;
+  size_t message_id_length;
+
+  // Where STRUCTURED-DATA starts
+  size_t structured_data_offset;
+} syslog_header_t;
+
+int syslog_peek_header(const char* buf, size_t len, syslog_header_t * header);
+
+// Hash index lookups into structured data. The index is built on the first
+// lookup against a message and reused until the message is freed. When a param
+// is repeated the first occurrence is returned. NULL means not found.
+typedef struct syslog_sd_key_t {
+  const char* sd_id;
+  const char* param_name;
+  size_t param_name_length;
+  uint64_t hash;
+} syslog_sd_key_t;
+
+// Precompute the key once for lookups that are repeated on every message
+syslog_sd_key_t syslog_sd_key(const char* sd_id, const char* param_name, size_t param_name_length);
+const char* syslog_sd_find_key(syslog_message_t * msg, const syslog_sd_key_t * key);
+const char* syslog_sd_find(syslog_message_t * msg, const char* sd_id, const char* param_name, size_t param_name_length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,147 @@
+#include "syslog_internal.h"
+
+static void* default_malloc(size_t size, void* user) {
+  return malloc(size);
+}
+
+static void* default_realloc(void* ptr, size_t size, void* user) {
+  return realloc(ptr, size);
+}
+
+static void default_free(void* ptr, void* user) {
+  free(ptr);
+}
+
+static syslog_allocator_t allocator = { default_malloc, default_realloc, default_free, NULL };
+
+void syslog_set_allocator(const syslog_allocator_t * hooks) {
+  if (hooks) {
+    allocator = *hooks;
+  } else {
+    allocator = (syslog_allocator_t) { default_malloc, default_realloc, default_free, NULL };
+  }
+}
+
+#ifdef SYSLOG_ALLOC_STATS
+
+// Each block starts with its size so frees know how much went away. It is a
+// whole max_align_t so the caller's part stays aligned.
+#define BLOCK_HEADER sizeof(max_align_t)
+
+static __thread syslog_alloc_stats_t stats;
+
+static void track(int64_t delta) {
+  stats.live_bytes += delta;
+  if (stats.live_bytes > stats.peak_live_bytes) {
+    stats.peak_live_bytes = stats.live_bytes;
+  }
+}
+
+void* syslog_malloc(size_t size) {
+  char* block = allocator.malloc(size + BLOCK_HEADER, allocator.user);
+  if (!block) {
+    return NULL;
+  }
+
+  *(size_t *) block = size;
+
+  stats.allocations++;
+  stats.bytes_allocated += size;
+  track(size);
+
+  return block + BLOCK_HEADER;
+}
+
+void* syslog_realloc(void* ptr, size_t size) {
+  if (!ptr) {
+    return syslog_malloc(size);
+  }
+
+  char* block = (char*) ptr - BLOCK_HEADER;
+  size_t old_size = *(size_t *) block;
+
+  block = allocator.realloc(block, size + BLOCK_HEADER, allocator.user);
+  if (!block) {
+    return NULL;
+  }
+
+  *(size_t *) block = size;
+
+  stats.reallocations++;
+  if (size > old_size) {
+    stats.bytes_allocated += size - old_size;
+  }
+  track((int64_t) size - (int64_t) old_size);
+
+  return block + BLOCK_HEADER;
+}
+
+void syslog_free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+
+  char* block = (char*) ptr - BLOCK_HEADER;
+
+  stats.frees++;
+  track(-(int64_t) *(size_t *) block);
+
+  allocator.free(block, allocator.user);
+}
+
+void syslog_alloc_stats(syslog_alloc_stats_t * out) {
+  *out = stats;
+}
+
+const syslog_alloc_stats_t * syslog_alloc_stats_local(void) {
+  return &stats;
+}
+
+void syslog_alloc_stats_reset(void) {
+  int64_t live_bytes = stats.live_bytes;
+  memset(&stats, 0, sizeof(stats));
+  stats.live_bytes = live_bytes;
+  stats.peak_live_bytes = live_bytes;
+}
+
+#else
+
+void* syslog_malloc(size_t size) {
+  return allocator.malloc(size, allocator.user);
+}
+
+void* syslog_realloc(void* ptr, size_t size) {
+  return allocator.realloc(ptr, size, allocator.user);
+}
+
+void syslog_free(void* ptr) {
+  if (ptr) {
+    allocator.free(ptr, allocator.user);
+  }
+}
+
+void syslog_alloc_stats(syslog_alloc_stats_t * out) {
+  memset(out, 0, sizeof(syslog_alloc_stats_t));
+}
+
+const syslog_alloc_stats_t * syslog_alloc_stats_local(void) {
+  return NULL;
+}
+
+void syslog_alloc_stats_reset(void) {
+}
+
+#endif
+
+void* syslog_calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  void* ptr = syslog_malloc(count * size);
+  if (ptr) {
+    memset(ptr, 0, count * size);
+  }
+
+  return ptr;
+}
@@ -0,0 +1,55 @@
+#ifndef LIB_SYSLOG_ALLOC_H
+#define LIB_SYSLOG_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Every allocation the library makes goes through these hooks, so it can run
+// on jemalloc arenas, tcmalloc or anything else without LD_PRELOAD. Set them
+// before any other call into the library and don't change them while anything
+// it allocated is still alive, since it will be freed through the new hooks.
+typedef struct syslog_allocator_t {
+  void* (*malloc)(size_t size, void* user);
+  void* (*realloc)(void* ptr, size_t size, void* user);
+  void (*free)(void* ptr, void* user);
+  void* user;
+} syslog_allocator_t;
+
+// NULL goes back to the C library's allocator
+void syslog_set_allocator(const syslog_allocator_t * allocator);
+
+// Built with -DSYSLOG_ALLOC_STATS, the library also counts its allocations
+// per thread. Reset before a parse and read after it to get that parse's
+// numbers. Without the flag these are always zero.
+//
+// Counting costs a small header on every block.
+typedef struct syslog_alloc_stats_t {
+  uint64_t allocations;
+  uint64_t reallocations;
+  uint64_t frees;
+  // Everything asked for, including growth by realloc
+  uint64_t bytes_allocated;
+  // What this thread allocated less what it freed. Memory freed on another
+  // thread than the one that allocated it makes this drift per thread.
+  int64_t live_bytes;
+  int64_t peak_live_bytes;
+} syslog_alloc_stats_t;
+
+void syslog_alloc_stats(syslog_alloc_stats_t * out);
+// Zeroes the counters. The peak starts again from what is live now.
+void syslog_alloc_stats_reset(void);
+
+// Adds up every thread that has parsed something, including threads that have
+// exited, for exporting as metrics. Resets on any of those threads make the
+// counts go backwards. peak_live_bytes is the highest any one thread reached.
+void syslog_alloc_stats_total(syslog_alloc_stats_t * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
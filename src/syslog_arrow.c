@@ -0,0 +1,449 @@
+#include <stddef.h>
+
+#include "syslog_arrow.h"
+#include "syslog_internal.h"
+
+#define ARROW_COLUMN_COUNT 11
+
+// Every array we hand out owns its buffers and children through one of these.
+// Release walks the children first and then frees whatever buffers were set,
+// so a half built array can be torn down through the same path.
+typedef struct arrow_array_private_t {
+  const void* buffers[3];
+  struct ArrowArray** children;
+  struct ArrowArray* child_storage;
+} arrow_array_private_t;
+
+typedef struct arrow_schema_private_t {
+  struct ArrowSchema** children;
+  struct ArrowSchema* child_storage;
+} arrow_schema_private_t;
+
+static void release_arrow_array(struct ArrowArray* array) {
+  arrow_array_private_t* private_data = (arrow_array_private_t*) array->private_data;
+
+  int64_t i;
+  for (i = 0; i < array->n_children; i++) {
+    if (array->children[i]->release) {
+      array->children[i]->release(array->children[i]);
+    }
+  }
+
+  for (i = 0; i < array->n_buffers; i++) {
+    syslog_free((void*) private_data->buffers[i]);
+  }
+
+  syslog_free(private_data->children);
+  syslog_free(private_data->child_storage);
+  syslog_free(private_data);
+
+  array->release = NULL;
+}
+
+static int init_arrow_array(struct ArrowArray* array, int64_t length, int64_t n_buffers, int64_t n_children) {
+  arrow_array_private_t* private_data = syslog_calloc(1, sizeof(arrow_array_private_t));
+  if (!private_data) {
+    return 0;
+  }
+
+  if (n_children > 0) {
+    private_data->children = syslog_calloc(n_children, sizeof(struct ArrowArray*));
+    private_data->child_storage = syslog_calloc(n_children, sizeof(struct ArrowArray));
+
+    if (!private_data->children || !private_data->child_storage) {
+      syslog_free(private_data->children);
+      syslog_free(private_data->child_storage);
+      syslog_free(private_data);
+      return 0;
+    }
+
+    int64_t i;
+    for (i = 0; i < n_children; i++) {
+      private_data->children[i] = &private_data->child_storage[i];
+    }
+  }
+
+  *array = (struct ArrowArray) {
+    length, 0, 0, n_buffers, n_children,
+    private_data->buffers, private_data->children, NULL,
+    release_arrow_array, private_data
+  };
+
+  return 1;
+}
+
+static void release_arrow_schema(struct ArrowSchema* schema) {
+  arrow_schema_private_t* private_data = (arrow_schema_private_t*) schema->private_data;
+
+  int64_t i;
+  for (i = 0; i < schema->n_children; i++) {
+    if (schema->children[i]->release) {
+      schema->children[i]->release(schema->children[i]);
+    }
+  }
+
+  syslog_free(private_data->children);
+  syslog_free(private_data->child_storage);
+  syslog_free(private_data);
+
+  schema->release = NULL;
+}
+
+static int init_arrow_schema(struct ArrowSchema* schema, const char* format, const char* name, int64_t flags, int64_t n_children) {
+  arrow_schema_private_t* private_data = syslog_calloc(1, sizeof(arrow_schema_private_t));
+  if (!private_data) {
+    return 0;
+  }
+
+  if (n_children > 0) {
+    private_data->children = syslog_calloc(n_children, sizeof(struct ArrowSchema*));
+    private_data->child_storage = syslog_calloc(n_children, sizeof(struct ArrowSchema));
+
+    if (!private_data->children || !private_data->child_storage) {
+      syslog_free(private_data->children);
+      syslog_free(private_data->child_storage);
+      syslog_free(private_data);
+      return 0;
+    }
+
+    int64_t i;
+    for (i = 0; i < n_children; i++) {
+      private_data->children[i] = &private_data->child_storage[i];
+    }
+  }
+
+  // Format and name are always string literals so there is nothing to free for them
+  *schema = (struct ArrowSchema) {
+    format, name, NULL, flags, n_children,
+    private_data->children, NULL,
+    release_arrow_schema, private_data
+  };
+
+  return 1;
+}
+
+// --- Schema
+
+static int build_structured_data_schema(struct ArrowSchema* schema) {
+  if (!init_arrow_schema(schema, "+l", "structured_data", ARROW_FLAG_NULLABLE, 1)) {
+    return 0;
+  }
+
+  struct ArrowSchema* element = schema->children[0];
+  if (!init_arrow_schema(element, "+s", "element", 0, 2)) {
+    return 0;
+  }
+
+  if (!init_arrow_schema(element->children[0], "u", "id", 0, 0)) {
+    return 0;
+  }
+
+  struct ArrowSchema* params = element->children[1];
+  if (!init_arrow_schema(params, "+m", "params", 0, 1)) {
+    return 0;
+  }
+
+  struct ArrowSchema* entries = params->children[0];
+  if (!init_arrow_schema(entries, "+s", "entries", 0, 2)) {
+    return 0;
+  }
+
+  return init_arrow_schema(entries->children[0], "u", "key", 0, 0)
+    && init_arrow_schema(entries->children[1], "u", "value", ARROW_FLAG_NULLABLE, 0);
+}
+
+static int build_arrow_schema(struct ArrowSchema* schema) {
+  if (!init_arrow_schema(schema, "+s", "", 0, ARROW_COLUMN_COUNT)) {
+    return 0;
+  }
+
+  struct ArrowSchema** columns = schema->children;
+
+  return init_arrow_schema(columns[0], "i", "pri_value", 0, 0)
+    && init_arrow_schema(columns[1], "i", "severity", 0, 0)
+    && init_arrow_schema(columns[2], "i", "facility", 0, 0)
+    && init_arrow_schema(columns[3], "tss:UTC", "timestamp", ARROW_FLAG_NULLABLE, 0)
+    && init_arrow_schema(columns[4], "u", "syslog_version", ARROW_FLAG_NULLABLE, 0)
+    && init_arrow_schema(columns[5], "u", "hostname", ARROW_FLAG_NULLABLE, 0)
+    && init_arrow_schema(columns[6], "u", "appname", ARROW_FLAG_NULLABLE, 0)
+    && init_arrow_schema(columns[7], "u", "process_id", ARROW_FLAG_NULLABLE, 0)
+    && init_arrow_schema(columns[8], "u", "message_id", ARROW_FLAG_NULLABLE, 0)
+    && init_arrow_schema(columns[9], "u", "message", ARROW_FLAG_NULLABLE, 0)
+    && build_structured_data_schema(columns[10]);
+}
+
+// --- Arrays
+
+static int build_int32_column(struct ArrowArray* array, const syslog_message_t* messages, size_t count, size_t field_offset) {
+  if (!init_arrow_array(array, count, 2, 0)) {
+    return 0;
+  }
+
+  int32_t* values = syslog_malloc(sizeof(int32_t) * (count + 1));
+  if (!values) {
+    return 0;
+  }
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    values[i] = *(const int*) ((const char*) &messages[i] + field_offset);
+  }
+
+  array->buffers[1] = values;
+
+  return 1;
+}
+
+static int build_timestamp_column(struct ArrowArray* array, const syslog_message_t* messages, size_t count) {
+  if (!init_arrow_array(array, count, 2, 0)) {
+    return 0;
+  }
+
+  int64_t* values = syslog_malloc(sizeof(int64_t) * (count + 1));
+  uint8_t* validity = syslog_calloc((count + 7) / 8 + 1, sizeof(uint8_t));
+  if (!values || !validity) {
+    syslog_free(values);
+    syslog_free(validity);
+    return 0;
+  }
+
+  array->buffers[0] = validity;
+  array->buffers[1] = values;
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    if (syslog_message_epoch(&messages[i], &values[i])) {
+      validity[i / 8] |= (uint8_t) (1 << (i % 8));
+    } else {
+      // NIL, which the parser filled in with the time it ran
+      values[i] = 0;
+      array->null_count++;
+    }
+  }
+
+  if (array->null_count == 0) {
+    syslog_free(validity);
+    array->buffers[0] = NULL;
+  }
+
+  return 1;
+}
+
+// Builds a utf8 array out of count C strings. NULL entries, and empty strings
+// when nil_is_null is set, become nulls since that is how the parser reports NIL.
+static int build_utf8_array(struct ArrowArray* array, const char* const* strings, size_t count, int nil_is_null) {
+  if (!init_arrow_array(array, count, 3, 0)) {
+    return 0;
+  }
+
+  int32_t* offsets = syslog_malloc(sizeof(int32_t) * (count + 1));
+  uint8_t* validity = syslog_calloc((count + 7) / 8 + 1, sizeof(uint8_t));
+  if (!offsets || !validity) {
+    syslog_free(offsets);
+    syslog_free(validity);
+    return 0;
+  }
+
+  array->buffers[0] = validity;
+  array->buffers[1] = offsets;
+
+  size_t i;
+  size_t data_length = 0;
+  offsets[0] = 0;
+  for (i = 0; i < count; i++) {
+    const char* s = strings[i];
+
+    if (!s || (nil_is_null && !*s)) {
+      array->null_count++;
+    } else {
+      validity[i / 8] |= (uint8_t) (1 << (i % 8));
+      data_length += strlen(s);
+
+      if (data_length > INT32_MAX) {
+        // Would need large_utf8, which we do not produce
+        return 0;
+      }
+    }
+
+    offsets[i + 1] = (int32_t) data_length;
+  }
+
+  char* data = syslog_malloc(data_length + 1);
+  if (!data) {
+    return 0;
+  }
+
+  array->buffers[2] = data;
+
+  for (i = 0; i < count; i++) {
+    memcpy(data + offsets[i], strings[i], offsets[i + 1] - offsets[i]);
+  }
+
+  if (array->null_count == 0) {
+    // Consumers may skip the bitmap entirely when there are no nulls
+    syslog_free(validity);
+    array->buffers[0] = NULL;
+  }
+
+  return 1;
+}
+
+static int build_utf8_column(struct ArrowArray* array, const syslog_message_t* messages, size_t count, size_t field_offset) {
+  const char** strings = syslog_malloc(sizeof(char*) * (count + 1));
+  if (!strings) {
+    return 0;
+  }
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    strings[i] = *(const char* const*) ((const char*) &messages[i] + field_offset);
+  }
+
+  int ok = build_utf8_array(array, strings, count, 1);
+
+  syslog_free(strings);
+
+  return ok;
+}
+
+static int build_offsets(struct ArrowArray* array, int32_t** out, size_t count) {
+  int32_t* offsets = syslog_malloc(sizeof(int32_t) * (count + 1));
+  if (!offsets) {
+    return 0;
+  }
+
+  offsets[0] = 0;
+  array->buffers[1] = offsets;
+  *out = offsets;
+
+  return 1;
+}
+
+static int build_structured_data_column(struct ArrowArray* array, const syslog_message_t* messages, size_t count) {
+  size_t total_elements = 0;
+  size_t total_pairs = 0;
+
+  size_t i, j, k;
+  for (i = 0; i < count; i++) {
+    total_elements += messages[i].structured_data_count;
+
+    for (j = 0; j < messages[i].structured_data_count; j++) {
+      total_pairs += messages[i].structured_data[j].num_pairs;
+    }
+  }
+
+  // list<element>
+  int32_t* list_offsets = NULL;
+  if (!init_arrow_array(array, count, 2, 1) || !build_offsets(array, &list_offsets, count)) {
+    return 0;
+  }
+
+  // struct<id, params>
+  struct ArrowArray* element = array->children[0];
+  if (!init_arrow_array(element, total_elements, 1, 2)) {
+    return 0;
+  }
+
+  // map<key, value>
+  struct ArrowArray* params = element->children[1];
+  int32_t* map_offsets = NULL;
+  if (!init_arrow_array(params, total_elements, 2, 1) || !build_offsets(params, &map_offsets, total_elements)) {
+    return 0;
+  }
+
+  struct ArrowArray* entries = params->children[0];
+  if (!init_arrow_array(entries, total_pairs, 1, 2)) {
+    return 0;
+  }
+
+  const char** ids = syslog_malloc(sizeof(char*) * (total_elements + 1));
+  const char** keys = syslog_malloc(sizeof(char*) * (total_pairs + 1));
+  const char** values = syslog_malloc(sizeof(char*) * (total_pairs + 1));
+
+  int ok = ids && keys && values;
+
+  size_t element_index = 0;
+  size_t pair_index = 0;
+  for (i = 0; ok && i < count; i++) {
+    for (j = 0; j < messages[i].structured_data_count; j++) {
+      const syslog_extended_property_t* property = &messages[i].structured_data[j];
+
+      ids[element_index++] = property->id;
+
+      for (k = 0; k < property->num_pairs; k++) {
+        keys[pair_index] = property->pairs[k].key;
+        values[pair_index] = property->pairs[k].value;
+        pair_index++;
+      }
+
+      map_offsets[element_index] = (int32_t) pair_index;
+    }
+
+    list_offsets[i + 1] = (int32_t) element_index;
+  }
+
+  ok = ok
+    && build_utf8_array(element->children[0], ids, total_elements, 0)
+    && build_utf8_array(entries->children[0], keys, total_pairs, 0)
+    && build_utf8_array(entries->children[1], values, total_pairs, 0);
+
+  syslog_free(ids);
+  syslog_free(keys);
+  syslog_free(values);
+
+  return ok;
+}
+
+static int build_arrow_array(struct ArrowArray* array, const syslog_message_t* messages, size_t count) {
+  if (!init_arrow_array(array, count, 1, ARROW_COLUMN_COUNT)) {
+    return 0;
+  }
+
+  struct ArrowArray** columns = array->children;
+
+  return build_int32_column(columns[0], messages, count, offsetof(syslog_message_t, pri_value))
+    && build_int32_column(columns[1], messages, count, offsetof(syslog_message_t, severity))
+    && build_int32_column(columns[2], messages, count, offsetof(syslog_message_t, facility))
+    && build_timestamp_column(columns[3], messages, count)
+    && build_utf8_column(columns[4], messages, count, offsetof(syslog_message_t, syslog_version))
+    && build_utf8_column(columns[5], messages, count, offsetof(syslog_message_t, hostname))
+    && build_utf8_column(columns[6], messages, count, offsetof(syslog_message_t, appname))
+    && build_utf8_column(columns[7], messages, count, offsetof(syslog_message_t, process_id))
+    && build_utf8_column(columns[8], messages, count, offsetof(syslog_message_t, message_id))
+    && build_utf8_column(columns[9], messages, count, offsetof(syslog_message_t, message))
+    && build_structured_data_column(columns[10], messages, count);
+}
+
+int syslog_export_arrow(const syslog_message_t* messages, size_t count, struct ArrowSchema* schema, struct ArrowArray* array) {
+  if (!messages && count) {
+    return 0;
+  }
+
+  if (schema) {
+    schema->release = NULL;
+
+    if (!build_arrow_schema(schema)) {
+      if (schema->release) {
+        schema->release(schema);
+      }
+      return 0;
+    }
+  }
+
+  if (array) {
+    array->release = NULL;
+
+    if (!build_arrow_array(array, messages, count)) {
+      if (array->release) {
+        array->release(array);
+      }
+
+      if (schema && schema->release) {
+        schema->release(schema);
+      }
+      return 0;
+    }
+  }
+
+  return 1;
+}
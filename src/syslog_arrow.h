@@ -0,0 +1,76 @@
+#ifndef LIB_SYSLOG_ARROW_H
+#define LIB_SYSLOG_ARROW_H
+
+#include <stdint.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// The Arrow C Data Interface ABI, as published at
+// https://arrow.apache.org/docs/format/CDataInterface.html
+// It is guarded so it can coexist with the copy shipped by Arrow itself.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+// Exports a batch of parsed messages as a single Arrow struct array with one
+// row per message. The columns are:
+//
+//   pri_value, severity, facility          int32
+//   timestamp                              timestamp[s, UTC] (seconds since epoch, NIL is null)
+//   syslog_version, hostname, appname,
+//   process_id, message_id, message        utf8 (NIL fields are null)
+//   structured_data                        list<struct<id: utf8, params: map<utf8, utf8>>>
+//
+// Either out parameter may be NULL if the caller only needs the other one.
+// Both are owned by the caller afterwards and must be released through their
+// release callbacks. Returns 1 on success and 0 if an allocation failed.
+int syslog_export_arrow(const syslog_message_t* messages, size_t count,
+                        struct ArrowSchema* schema, struct ArrowArray* array);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+#include "syslog_dedup.h"
+#include "syslog_internal.h"
+
+#define DEDUP_MIN_SLOTS 16
+#define DEDUP_PROBE_LIMIT 8
+
+typedef struct dedup_entry_t {
+  // 0 marks an empty slot. A real fingerprint of 0 is bumped to 1.
+  uint64_t fingerprint;
+  uint64_t repeats;
+  uint64_t first_ns;
+  uint64_t last_ns;
+} dedup_entry_t;
+
+struct syslog_dedup_t {
+  dedup_entry_t * entries;
+  size_t slot_mask;
+  uint64_t window_ns;
+
+  syslog_dedup_callback_t on_repeated;
+  void* user;
+};
+
+syslog_dedup_t * syslog_dedup_new(uint64_t window_ns, size_t max_entries, syslog_dedup_callback_t on_repeated, void* user) {
+  syslog_dedup_t * dedup = syslog_calloc(1, sizeof(syslog_dedup_t));
+  if (!dedup) {
+    return NULL;
+  }
+
+  size_t slots = DEDUP_MIN_SLOTS;
+  while (slots < max_entries) {
+    slots <<= 1;
+  }
+
+  dedup->entries = syslog_calloc(slots, sizeof(dedup_entry_t));
+  if (!dedup->entries) {
+    syslog_free(dedup);
+    return NULL;
+  }
+
+  dedup->slot_mask = slots - 1;
+  dedup->window_ns = window_ns;
+  dedup->on_repeated = on_repeated;
+  dedup->user = user;
+
+  return dedup;
+}
+
+// Reports the entry if it collapsed anything and empties the slot
+static void retire_entry(syslog_dedup_t * dedup, dedup_entry_t * entry) {
+  if (entry->repeats && dedup->on_repeated) {
+    dedup->on_repeated(dedup->user, entry->fingerprint, entry->repeats, entry->first_ns, entry->last_ns);
+  }
+
+  entry->fingerprint = 0;
+  entry->repeats = 0;
+}
+
+void syslog_dedup_free(syslog_dedup_t * dedup) {
+  if (!dedup) {
+    return;
+  }
+
+  syslog_dedup_expire(dedup, UINT64_MAX);
+
+  syslog_free(dedup->entries);
+  syslog_free(dedup);
+}
+
+int syslog_dedup_check(syslog_dedup_t * dedup, uint64_t fingerprint, uint64_t now_ns) {
+  if (!fingerprint) {
+    fingerprint = 1;
+  }
+
+  dedup_entry_t * victim = NULL;
+  size_t i;
+
+  // Retired entries leave holes behind, so look at every slot in reach rather
+  // than stopping at the first empty one
+  for (i = 0; i < DEDUP_PROBE_LIMIT; i++) {
+    dedup_entry_t * entry = &dedup->entries[(fingerprint + i) & dedup->slot_mask];
+
+    if (entry->fingerprint == fingerprint) {
+      if (now_ns - entry->first_ns < dedup->window_ns) {
+        entry->repeats++;
+        entry->last_ns = now_ns;
+        return 0;
+      }
+
+      // The window is over, this one starts a new one
+      victim = entry;
+      break;
+    }
+
+    if (!victim || (victim->fingerprint && (!entry->fingerprint || entry->first_ns < victim->first_ns))) {
+      victim = entry;
+    }
+  }
+
+  if (victim->fingerprint) {
+    retire_entry(dedup, victim);
+  }
+
+  victim->fingerprint = fingerprint;
+  victim->first_ns = now_ns;
+  victim->last_ns = now_ns;
+
+  return 1;
+}
+
+void syslog_dedup_expire(syslog_dedup_t * dedup, uint64_t now_ns) {
+  size_t i;
+  for (i = 0; i <= dedup->slot_mask; i++) {
+    dedup_entry_t * entry = &dedup->entries[i];
+
+    if (entry->fingerprint && (now_ns == UINT64_MAX || now_ns - entry->first_ns >= dedup->window_ns)) {
+      retire_entry(dedup, entry);
+    }
+  }
+}
+
+uint64_t syslog_message_fingerprint(const syslog_message_t * msg) {
+  return syslog_message_hash(msg, SYSLOG_FINGERPRINT_FIELDS);
+}
@@ -0,0 +1,47 @@
+#ifndef LIB_SYSLOG_DEDUP_H
+#define LIB_SYSLOG_DEDUP_H
+
+#include <stdint.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Collapses repeated messages, like syslogd's "last message repeated N times".
+//
+// Messages are compared by fingerprint, a hash of HOSTNAME, APP-NAME, MSGID
+// and MSG that the parser fills in when it is given a dedup table. The first
+// message with a fingerprint is kept and opens a window of window_ns. Repeats
+// inside the window are counted instead of kept. When the window is over, or
+// the entry has to make room for another, on_repeated is told how many
+// repeats there were, if any, so a single record can stand in for all of them.
+//
+// Memory is fixed when the table is created. A dedup table is not thread safe.
+
+typedef struct syslog_dedup_t syslog_dedup_t;
+
+typedef void (*syslog_dedup_callback_t)(void* user, uint64_t fingerprint, uint64_t repeats, uint64_t first_ns, uint64_t last_ns);
+
+syslog_dedup_t * syslog_dedup_new(uint64_t window_ns, size_t max_entries, syslog_dedup_callback_t on_repeated, void* user);
+// Reports whatever repeats are still pending before freeing the table
+void syslog_dedup_free(syslog_dedup_t * dedup);
+
+// Returns 1 if a message with this fingerprint should be kept, 0 if it repeats
+// one kept less than window_ns ago. now_ns has to come from a clock that never
+// goes backwards.
+int syslog_dedup_check(syslog_dedup_t * dedup, uint64_t fingerprint, uint64_t now_ns);
+
+// Reports and forgets every entry whose window ended before now_ns. Call it
+// now and then so that repeats of messages that stop arriving get reported.
+void syslog_dedup_expire(syslog_dedup_t * dedup, uint64_t now_ns);
+
+// The fingerprint the parser computes, for messages that were built by hand.
+uint64_t syslog_message_fingerprint(const syslog_message_t * msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
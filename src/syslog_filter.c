@@ -0,0 +1,642 @@
+#include <ctype.h>
+
+#include "syslog_filter.h"
+#include "syslog_internal.h"
+
+// Expressions compile to postfix instructions which are run against a small
+// stack of three valued results: a term on a field that is not known yet is
+// UNKNOWN, and AND/OR/NOT follow Kleene logic so that a partially parsed
+// message can still be rejected as soon as the answer cannot change.
+
+#define FILTER_MAX_DEPTH 64
+// How deep ( and ! can nest while compiling. The compiler recurses for each,
+// so without a limit a long enough run of them would overflow the stack.
+#define FILTER_MAX_NESTING 64
+
+typedef enum filter_field_t {
+  FIELD_SEVERITY,
+  FIELD_FACILITY,
+  FIELD_PRI,
+  FIELD_VERSION,
+  FIELD_HOSTNAME,
+  FIELD_APPNAME,
+  FIELD_PROCID,
+  FIELD_MSGID,
+  FIELD_MESSAGE,
+  FIELD_SD
+} filter_field_t;
+
+typedef enum filter_op_t {
+  OP_EQ,
+  OP_NE,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_STARTSWITH,
+  OP_ENDSWITH,
+  OP_CONTAINS
+} filter_op_t;
+
+typedef enum filter_opcode_t {
+  INSN_TERM,
+  INSN_AND,
+  INSN_OR,
+  INSN_NOT
+} filter_opcode_t;
+
+typedef struct filter_insn_t {
+  filter_opcode_t opcode;
+
+  // Only used by INSN_TERM
+  filter_field_t field;
+  filter_op_t op;
+  long number;
+  char* string;
+  size_t string_length;
+  char* sd_id;
+  char* sd_param;
+  syslog_sd_key_t sd_key;
+} filter_insn_t;
+
+struct syslog_filter_t {
+  filter_insn_t * insns;
+  size_t count;
+  size_t capacity;
+  unsigned stages;
+};
+
+typedef struct filter_parser_t {
+  const char* input;
+  const char* p;
+  syslog_filter_t * filter;
+  char* error;
+  size_t error_size;
+  int nesting;
+} filter_parser_t;
+
+static const struct {
+  const char* name;
+  filter_field_t field;
+} FIELD_NAMES[] = {
+  {"severity", FIELD_SEVERITY},
+  {"facility", FIELD_FACILITY},
+  {"pri", FIELD_PRI},
+  {"version", FIELD_VERSION},
+  {"hostname", FIELD_HOSTNAME},
+  {"appname", FIELD_APPNAME},
+  {"procid", FIELD_PROCID},
+  {"msgid", FIELD_MSGID},
+  {"message", FIELD_MESSAGE},
+  {"sd", FIELD_SD}
+};
+
+static const char* SEVERITY_NAMES[8] = {
+  "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+static syslog_filter_stage_t field_stage(filter_field_t field) {
+  switch (field) {
+    case FIELD_SEVERITY:
+    case FIELD_FACILITY:
+    case FIELD_PRI:
+      return SYSLOG_FILTER_STAGE_PRI;
+    case FIELD_SD:
+      return SYSLOG_FILTER_STAGE_STRUCTURED_DATA;
+    case FIELD_MESSAGE:
+      return SYSLOG_FILTER_STAGE_MESSAGE;
+    default:
+      return SYSLOG_FILTER_STAGE_HEADER;
+  }
+}
+
+static int field_is_integer(filter_field_t field) {
+  return field_stage(field) == SYSLOG_FILTER_STAGE_PRI;
+}
+
+// --- Compiling
+
+static int parse_error(filter_parser_t * parser, const char* what) {
+  if (parser->error && parser->error_size) {
+    snprintf(parser->error, parser->error_size, "%s at offset %d", what, (int) (parser->p - parser->input));
+  }
+
+  return 0;
+}
+
+static filter_insn_t * emit(filter_parser_t * parser, filter_opcode_t opcode) {
+  syslog_filter_t * filter = parser->filter;
+
+  if (filter->count == filter->capacity) {
+    size_t capacity = filter->capacity ? filter->capacity * 2 : 8;
+    filter_insn_t * insns = syslog_realloc(filter->insns, sizeof(filter_insn_t) * capacity);
+    if (!insns) {
+      parse_error(parser, "Out of memory");
+      return NULL;
+    }
+
+    filter->insns = insns;
+    filter->capacity = capacity;
+  }
+
+  filter_insn_t * insn = &filter->insns[filter->count++];
+  memset(insn, 0, sizeof(filter_insn_t));
+  insn->opcode = opcode;
+
+  return insn;
+}
+
+static void skip_spaces(filter_parser_t * parser) {
+  while (isspace((unsigned char) *parser->p)) {
+    parser->p++;
+  }
+}
+
+static int accept(filter_parser_t * parser, const char* token) {
+  skip_spaces(parser);
+
+  size_t length = strlen(token);
+  if (strncmp(parser->p, token, length) == 0) {
+    parser->p += length;
+    return 1;
+  }
+
+  return 0;
+}
+
+static int is_name_char(char c) {
+  return c && !isspace((unsigned char) c) && !strchr("=!<>()&|\"[]", c);
+}
+
+// Reads a run of name characters into a new string
+static char* read_name(filter_parser_t * parser) {
+  skip_spaces(parser);
+
+  const char* start = parser->p;
+  while (is_name_char(*parser->p)) {
+    parser->p++;
+  }
+
+  size_t length = parser->p - start;
+  if (!length) {
+    return NULL;
+  }
+
+  char* name = syslog_malloc(length + 1);
+  if (name) {
+    memcpy(name, start, length);
+    name[length] = 0;
+  }
+
+  return name;
+}
+
+static int parse_string(filter_parser_t * parser, filter_insn_t * insn) {
+  skip_spaces(parser);
+
+  if (*parser->p != '"') {
+    return parse_error(parser, "Expected a string");
+  }
+
+  parser->p++;
+
+  // The unescaped string is never longer than what is left of the input
+  char* string = syslog_malloc(strlen(parser->p) + 1);
+  if (!string) {
+    return parse_error(parser, "Out of memory");
+  }
+
+  size_t length = 0;
+  while (*parser->p && *parser->p != '"') {
+    if (*parser->p == '\\' && parser->p[1]) {
+      parser->p++;
+    }
+    string[length++] = *parser->p++;
+  }
+
+  string[length] = 0;
+  insn->string = string;
+  insn->string_length = length;
+
+  if (*parser->p != '"') {
+    return parse_error(parser, "Unterminated string");
+  }
+
+  parser->p++;
+  return 1;
+}
+
+static int parse_number(filter_parser_t * parser, filter_insn_t * insn) {
+  skip_spaces(parser);
+
+  if (insn->field == FIELD_SEVERITY) {
+    int i;
+    for (i = 0; i < 8; i++) {
+      size_t length = strlen(SEVERITY_NAMES[i]);
+      if (strncmp(parser->p, SEVERITY_NAMES[i], length) == 0 && !is_name_char(parser->p[length])) {
+        parser->p += length;
+        insn->number = i;
+        return 1;
+      }
+    }
+  }
+
+  char* end = NULL;
+  long number = strtol(parser->p, &end, 10);
+  if (end == parser->p) {
+    return parse_error(parser, "Expected a number");
+  }
+
+  parser->p = end;
+  insn->number = number;
+
+  return 1;
+}
+
+static int parse_operator(filter_parser_t * parser, filter_insn_t * insn) {
+  static const struct {
+    const char* token;
+    filter_op_t op;
+  } OPERATORS[] = {
+    {"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE}, {"<", OP_LT}, {">", OP_GT},
+    {"startswith", OP_STARTSWITH}, {"endswith", OP_ENDSWITH}, {"contains", OP_CONTAINS}
+  };
+
+  size_t i;
+  for (i = 0; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]); i++) {
+    if (accept(parser, OPERATORS[i].token)) {
+      insn->op = OPERATORS[i].op;
+      return 1;
+    }
+  }
+
+  return parse_error(parser, "Expected an operator");
+}
+
+static int parse_comparison(filter_parser_t * parser) {
+  skip_spaces(parser);
+
+  const char* start = parser->p;
+  while (isalpha((unsigned char) *parser->p)) {
+    parser->p++;
+  }
+
+  size_t length = parser->p - start;
+
+  size_t i;
+  for (i = 0; i < sizeof(FIELD_NAMES) / sizeof(FIELD_NAMES[0]); i++) {
+    if (strlen(FIELD_NAMES[i].name) == length && strncmp(start, FIELD_NAMES[i].name, length) == 0) {
+      break;
+    }
+  }
+
+  if (i == sizeof(FIELD_NAMES) / sizeof(FIELD_NAMES[0])) {
+    parser->p = start;
+    return parse_error(parser, "Unknown field");
+  }
+
+  filter_insn_t * insn = emit(parser, INSN_TERM);
+  if (!insn) {
+    return 0;
+  }
+
+  insn->field = FIELD_NAMES[i].field;
+  parser->filter->stages |= 1u << field_stage(insn->field);
+
+  if (insn->field == FIELD_SD) {
+    if (!accept(parser, "[")) {
+      return parse_error(parser, "Expected [ after sd");
+    }
+
+    insn->sd_id = read_name(parser);
+    if (!insn->sd_id) {
+      return parse_error(parser, "Expected an SD-ID");
+    }
+
+    if (!accept(parser, "]") || !accept(parser, ".")) {
+      return parse_error(parser, "Expected ]. after the SD-ID");
+    }
+
+    insn->sd_param = read_name(parser);
+    if (!insn->sd_param) {
+      return parse_error(parser, "Expected a param name");
+    }
+
+    insn->sd_key = syslog_sd_key(insn->sd_id, insn->sd_param, strlen(insn->sd_param));
+  }
+
+  if (!parse_operator(parser, insn)) {
+    return 0;
+  }
+
+  if (field_is_integer(insn->field)) {
+    if (insn->op > OP_GE) {
+      return parse_error(parser, "String operator used on a number");
+    }
+    return parse_number(parser, insn);
+  }
+
+  if (insn->op != OP_EQ && insn->op != OP_NE && insn->op < OP_STARTSWITH) {
+    return parse_error(parser, "Ordering operator used on a string");
+  }
+
+  return parse_string(parser, insn);
+}
+
+static int parse_or(filter_parser_t * parser);
+
+static int parse_unary(filter_parser_t * parser);
+
+// Parses what comes after a ( or !, one level deeper
+static int parse_nested(filter_parser_t * parser, int (*parse)(filter_parser_t *)) {
+  if (++parser->nesting > FILTER_MAX_NESTING) {
+    return parse_error(parser, "Expression is nested too deeply");
+  }
+
+  int ok = parse(parser);
+  parser->nesting--;
+
+  return ok;
+}
+
+static int parse_unary(filter_parser_t * parser) {
+  skip_spaces(parser);
+
+  if (*parser->p == '!' && parser->p[1] != '=') {
+    parser->p++;
+    return parse_nested(parser, parse_unary) && emit(parser, INSN_NOT);
+  }
+
+  if (*parser->p == '(') {
+    parser->p++;
+    if (!parse_nested(parser, parse_or)) {
+      return 0;
+    }
+    if (!accept(parser, ")")) {
+      return parse_error(parser, "Expected )");
+    }
+    return 1;
+  }
+
+  return parse_comparison(parser);
+}
+
+static int parse_and(filter_parser_t * parser) {
+  if (!parse_unary(parser)) {
+    return 0;
+  }
+
+  while (accept(parser, "&&")) {
+    if (!parse_unary(parser) || !emit(parser, INSN_AND)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int parse_or(filter_parser_t * parser) {
+  if (!parse_and(parser)) {
+    return 0;
+  }
+
+  while (accept(parser, "||")) {
+    if (!parse_and(parser) || !emit(parser, INSN_OR)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static size_t max_stack_depth(const syslog_filter_t * filter) {
+  size_t depth = 0;
+  size_t max_depth = 0;
+
+  size_t i;
+  for (i = 0; i < filter->count; i++) {
+    switch (filter->insns[i].opcode) {
+      case INSN_TERM:
+        depth++;
+        break;
+      case INSN_AND:
+      case INSN_OR:
+        depth--;
+        break;
+      case INSN_NOT:
+        break;
+    }
+
+    if (depth > max_depth) {
+      max_depth = depth;
+    }
+  }
+
+  return max_depth;
+}
+
+syslog_filter_t * syslog_filter_compile(const char* expression, char* error, size_t error_size) {
+  if (error && error_size) {
+    error[0] = 0;
+  }
+
+  syslog_filter_t * filter = syslog_calloc(1, sizeof(syslog_filter_t));
+  if (!filter) {
+    return NULL;
+  }
+
+  filter_parser_t parser = {expression, expression, filter, error, error_size, 0};
+
+  if (!parse_or(&parser)) {
+    syslog_filter_free(filter);
+    return NULL;
+  }
+
+  skip_spaces(&parser);
+  if (*parser.p) {
+    parse_error(&parser, "Unexpected input");
+    syslog_filter_free(filter);
+    return NULL;
+  }
+
+  if (max_stack_depth(filter) > FILTER_MAX_DEPTH) {
+    parse_error(&parser, "Expression is nested too deeply");
+    syslog_filter_free(filter);
+    return NULL;
+  }
+
+  return filter;
+}
+
+void syslog_filter_free(syslog_filter_t * filter) {
+  if (!filter) {
+    return;
+  }
+
+  size_t i;
+  for (i = 0; i < filter->count; i++) {
+    syslog_free(filter->insns[i].string);
+    syslog_free(filter->insns[i].sd_id);
+    syslog_free(filter->insns[i].sd_param);
+  }
+
+  syslog_free(filter->insns);
+  syslog_free(filter);
+}
+
+// --- Evaluating
+
+static int string_contains(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length) {
+  if (!needle_length) {
+    return 1;
+  }
+
+  if (haystack_length < needle_length) {
+    return 0;
+  }
+
+  const char* last = haystack + haystack_length - needle_length;
+  const char* p = haystack;
+
+  while (p <= last) {
+    p = memchr(p, needle[0], last - p + 1);
+    if (!p) {
+      return 0;
+    }
+    if (memcmp(p, needle, needle_length) == 0) {
+      return 1;
+    }
+    p++;
+  }
+
+  return 0;
+}
+
+static int compare_integer(filter_op_t op, long value, long operand) {
+  switch (op) {
+    case OP_EQ: return value == operand;
+    case OP_NE: return value != operand;
+    case OP_LT: return value < operand;
+    case OP_LE: return value <= operand;
+    case OP_GT: return value > operand;
+    case OP_GE: return value >= operand;
+    default: return 0;
+  }
+}
+
+static int compare_string(const filter_insn_t * insn, const char* value) {
+  size_t length = strlen(value);
+
+  switch (insn->op) {
+    case OP_EQ:
+      return length == insn->string_length && memcmp(value, insn->string, length) == 0;
+    case OP_NE:
+      return !(length == insn->string_length && memcmp(value, insn->string, length) == 0);
+    case OP_STARTSWITH:
+      return length >= insn->string_length && memcmp(value, insn->string, insn->string_length) == 0;
+    case OP_ENDSWITH:
+      return length >= insn->string_length && memcmp(value + length - insn->string_length, insn->string, insn->string_length) == 0;
+    case OP_CONTAINS:
+      return string_contains(value, length, insn->string, insn->string_length);
+    default:
+      return 0;
+  }
+}
+
+static const char* string_field(const filter_insn_t * insn, const syslog_message_t * msg) {
+  switch (insn->field) {
+    case FIELD_VERSION: return msg->syslog_version;
+    case FIELD_HOSTNAME: return msg->hostname;
+    case FIELD_APPNAME: return msg->appname;
+    case FIELD_PROCID: return msg->process_id;
+    case FIELD_MSGID: return msg->message_id;
+    case FIELD_MESSAGE: return msg->message;
+    default: return NULL;
+  }
+}
+
+static int evaluate_term(const filter_insn_t * insn, syslog_message_t * msg, syslog_filter_stage_t stage) {
+  if (field_stage(insn->field) > stage) {
+    return SYSLOG_FILTER_UNKNOWN;
+  }
+
+  switch (insn->field) {
+    case FIELD_SEVERITY:
+      return compare_integer(insn->op, msg->severity, insn->number);
+    case FIELD_FACILITY:
+      return compare_integer(insn->op, msg->facility, insn->number);
+    case FIELD_PRI:
+      return compare_integer(insn->op, msg->pri_value, insn->number);
+    case FIELD_SD: {
+      const char* value = syslog_sd_find_key(msg, &insn->sd_key);
+      if (!value) {
+        return insn->op == OP_NE;
+      }
+      return compare_string(insn, value);
+    }
+    default: {
+      const char* value = string_field(insn, msg);
+      return compare_string(insn, value ? value : "");
+    }
+  }
+}
+
+int syslog_filter_evaluate(const syslog_filter_t * filter, syslog_message_t * msg, syslog_filter_stage_t stage) {
+  unsigned char stack[FILTER_MAX_DEPTH];
+  size_t top = 0;
+
+  size_t i;
+  for (i = 0; i < filter->count; i++) {
+    const filter_insn_t * insn = &filter->insns[i];
+
+    switch (insn->opcode) {
+      case INSN_TERM:
+        stack[top++] = evaluate_term(insn, msg, stage);
+        break;
+
+      case INSN_NOT: {
+        unsigned char a = stack[top - 1];
+        stack[top - 1] = a == SYSLOG_FILTER_UNKNOWN ? a : !a;
+        break;
+      }
+
+      case INSN_AND: {
+        unsigned char b = stack[--top];
+        unsigned char a = stack[top - 1];
+
+        if (a == SYSLOG_FILTER_NO_MATCH || b == SYSLOG_FILTER_NO_MATCH) {
+          stack[top - 1] = SYSLOG_FILTER_NO_MATCH;
+        } else if (a == SYSLOG_FILTER_MATCH && b == SYSLOG_FILTER_MATCH) {
+          stack[top - 1] = SYSLOG_FILTER_MATCH;
+        } else {
+          stack[top - 1] = SYSLOG_FILTER_UNKNOWN;
+        }
+        break;
+      }
+
+      case INSN_OR: {
+        unsigned char b = stack[--top];
+        unsigned char a = stack[top - 1];
+
+        if (a == SYSLOG_FILTER_MATCH || b == SYSLOG_FILTER_MATCH) {
+          stack[top - 1] = SYSLOG_FILTER_MATCH;
+        } else if (a == SYSLOG_FILTER_NO_MATCH && b == SYSLOG_FILTER_NO_MATCH) {
+          stack[top - 1] = SYSLOG_FILTER_NO_MATCH;
+        } else {
+          stack[top - 1] = SYSLOG_FILTER_UNKNOWN;
+        }
+        break;
+      }
+    }
+  }
+
+  return top ? stack[0] : SYSLOG_FILTER_MATCH;
+}
+
+unsigned syslog_filter_stages(const syslog_filter_t * filter) {
+  return filter->stages;
+}
+
+int syslog_filter_matches(const syslog_filter_t * filter, syslog_message_t * msg) {
+  return syslog_filter_evaluate(filter, msg, SYSLOG_FILTER_STAGE_MESSAGE) == SYSLOG_FILTER_MATCH;
+}
@@ -0,0 +1,63 @@
+#ifndef LIB_SYSLOG_FILTER_H
+#define LIB_SYSLOG_FILTER_H
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Compiled filter expressions, for example
+//
+//   severity <= warning && appname == "sshd" && sd[origin].ip startswith "10."
+//
+// Integer fields are severity, facility and pri. They compare with
+// ==, !=, <, <=, > and >= against a number, and severity also takes the
+// RFC5424 names (emerg, alert, crit, err, warning, notice, info, debug).
+//
+// String fields are version, hostname, appname, procid, msgid, message and
+// sd[SD-ID].param. They compare with ==, !=, startswith, endswith and contains
+// against a double quoted string. NIL fields compare as "". A param that is
+// not there fails every comparison except !=.
+//
+// Terms combine with &&, ||, ! and parentheses.
+//
+// A compiled filter is immutable, so one can be shared between threads.
+
+typedef struct syslog_filter_t syslog_filter_t;
+
+// The points during a parse at which more of the message becomes known. Each
+// stage knows everything the stages before it did.
+typedef enum syslog_filter_stage_t {
+  SYSLOG_FILTER_STAGE_PRI = 0,
+  SYSLOG_FILTER_STAGE_HEADER = 1,
+  SYSLOG_FILTER_STAGE_STRUCTURED_DATA = 2,
+  SYSLOG_FILTER_STAGE_MESSAGE = 3
+} syslog_filter_stage_t;
+
+#define SYSLOG_FILTER_NO_MATCH 0
+#define SYSLOG_FILTER_MATCH 1
+#define SYSLOG_FILTER_UNKNOWN 2
+
+// Returns NULL if the expression does not compile, in which case a description
+// of the problem is written to error when it is not NULL.
+syslog_filter_t * syslog_filter_compile(const char* expression, char* error, size_t error_size);
+void syslog_filter_free(syslog_filter_t * filter);
+
+// Evaluates the filter against a message of which only the fields up to and
+// including stage are filled in. Terms on later fields are treated as unknown,
+// so the result is SYSLOG_FILTER_UNKNOWN when they could still change it.
+int syslog_filter_evaluate(const syslog_filter_t * filter, syslog_message_t * msg, syslog_filter_stage_t stage);
+
+// Bit (1 << stage) is set for each stage whose fields the filter looks at.
+// Evaluating at any other stage cannot tell you anything new.
+unsigned syslog_filter_stages(const syslog_filter_t * filter);
+
+// Evaluates the filter against a fully parsed message
+int syslog_filter_matches(const syslog_filter_t * filter, syslog_message_t * msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,670 @@
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "syslog_format.h"
+#include "syslog_utf8.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SEPARATOR ' '
+#define NIL '-'
+#define QUOTE '"'
+#define CLOSE_BRACKET ']'
+#define OPEN_BRACKET '['
+#define ESCAPE '\\'
+#define EQUALS '='
+
+// All the encoders share one writer. With a NULL out it only counts, which is
+// how the _size functions are implemented, so sizes can never drift from what
+// actually gets written.
+typedef struct format_writer_t {
+  char* out;
+  size_t cap;
+  size_t used;
+  int overflow;
+} format_writer_t;
+
+static inline void writer_put(format_writer_t * w, const char* s, size_t n) {
+  if (w->out && !w->overflow) {
+    if (w->used + n > w->cap) {
+      w->overflow = 1;
+    } else {
+      memcpy(w->out + w->used, s, n);
+    }
+  }
+
+  w->used += n;
+}
+
+static inline void writer_putc(format_writer_t * w, char c) {
+  if (w->out && !w->overflow) {
+    if (w->used + 1 > w->cap) {
+      w->overflow = 1;
+    } else {
+      w->out[w->used] = c;
+    }
+  }
+
+  w->used++;
+}
+
+static inline void writer_puts(format_writer_t * w, const char* s) {
+  writer_put(w, s, strlen(s));
+}
+
+static void writer_put_uint(format_writer_t * w, unsigned long long value, int min_digits) {
+  char digits[24];
+  int n = 0;
+
+  do {
+    digits[sizeof(digits) - 1 - n++] = '0' + (value % 10);
+    value /= 10;
+  } while (value);
+
+  while (n < min_digits) {
+    digits[sizeof(digits) - 1 - n++] = '0';
+  }
+
+  writer_put(w, &digits[sizeof(digits) - n], n);
+}
+
+static size_t writer_finish(format_writer_t * w) {
+  if (w->overflow || w->used + 1 > w->cap) {
+    return 0;
+  }
+
+  w->out[w->used] = 0;
+  return w->used;
+}
+
+// --- Escaping
+
+// Offset of the first byte in s that has to be escaped inside an SD param
+// value, or length if there is none. Values are usually long runs of plain
+// text, so check 16 bytes at a time and memcpy everything in between.
+static size_t find_sd_escape(const char* s, size_t length) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8(QUOTE);
+  const __m128i escape = _mm_set1_epi8(ESCAPE);
+  const __m128i bracket = _mm_set1_epi8(CLOSE_BRACKET);
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) (s + i));
+    __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                             _mm_cmpeq_epi8(chunk, escape)),
+                                _mm_cmpeq_epi8(chunk, bracket));
+
+    int mask = _mm_movemask_epi8(hits);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  for (; i < length; i++) {
+    char c = s[i];
+    if (c == QUOTE || c == ESCAPE || c == CLOSE_BRACKET) {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+static void writer_put_sd_value(format_writer_t * w, const char* value) {
+  size_t length = strlen(value);
+
+  while (length) {
+    size_t run = find_sd_escape(value, length);
+
+    writer_put(w, value, run);
+
+    if (run == length) {
+      break;
+    }
+
+    char escaped[2] = {ESCAPE, value[run]};
+    writer_put(w, escaped, 2);
+
+    value += run + 1;
+    length -= run + 1;
+  }
+}
+
+// Same idea for JSON strings, where the bytes to look for are ", \ and
+// anything below 0x20.
+static size_t find_json_escape(const char* s, size_t length) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8(QUOTE);
+  const __m128i escape = _mm_set1_epi8(ESCAPE);
+  const __m128i control_max = _mm_set1_epi8(0x1F);
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) (s + i));
+    // There is no unsigned compare, but max(chunk, 0x1F) == 0x1F only for bytes <= 0x1F
+    __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max);
+    __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                             _mm_cmpeq_epi8(chunk, escape)),
+                                control);
+
+    int mask = _mm_movemask_epi8(hits);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  for (; i < length; i++) {
+    unsigned char c = (unsigned char) s[i];
+    if (c == QUOTE || c == ESCAPE || c < 0x20) {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+static void writer_put_json_string(format_writer_t * w, const char* value) {
+  static const char hex[] = "0123456789abcdef";
+
+  size_t length = strlen(value);
+
+  writer_putc(w, QUOTE);
+
+  while (length) {
+    size_t run = find_json_escape(value, length);
+
+    writer_put(w, value, run);
+
+    if (run == length) {
+      break;
+    }
+
+    unsigned char c = (unsigned char) value[run];
+    switch (c) {
+      case QUOTE: writer_put(w, "\\\"", 2); break;
+      case ESCAPE: writer_put(w, "\\\\", 2); break;
+      case '\n': writer_put(w, "\\n", 2); break;
+      case '\r': writer_put(w, "\\r", 2); break;
+      case '\t': writer_put(w, "\\t", 2); break;
+      case '\b': writer_put(w, "\\b", 2); break;
+      case '\f': writer_put(w, "\\f", 2); break;
+      default: {
+        char escaped[6] = {ESCAPE, 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+        writer_put(w, escaped, 6);
+      }
+    }
+
+    value += run + 1;
+    length -= run + 1;
+  }
+
+  writer_putc(w, QUOTE);
+}
+
+// --- RFC5424
+
+static void writer_put_header_field(format_writer_t * w, const char* field) {
+  if (!field || !*field) {
+    writer_putc(w, NIL);
+  } else {
+    writer_puts(w, field);
+  }
+}
+
+static void writer_put_iso_8601(format_writer_t * w, const struct tm * timestamp) {
+  writer_put_uint(w, timestamp->tm_year + 1900, 4);
+  writer_putc(w, '-');
+  writer_put_uint(w, timestamp->tm_mon + 1, 2);
+  writer_putc(w, '-');
+  writer_put_uint(w, timestamp->tm_mday, 2);
+  writer_putc(w, 'T');
+  writer_put_uint(w, timestamp->tm_hour, 2);
+  writer_putc(w, ':');
+  writer_put_uint(w, timestamp->tm_min, 2);
+  writer_putc(w, ':');
+  writer_put_uint(w, timestamp->tm_sec, 2);
+  writer_putc(w, 'Z');
+}
+
+static void writer_put_timestamp(format_writer_t * w, const syslog_message_t * msg) {
+  if (msg->raw_timestamp && *msg->raw_timestamp) {
+    writer_puts(w, msg->raw_timestamp);
+  } else {
+    writer_put_iso_8601(w, &msg->timestamp);
+  }
+}
+
+static void writer_put_structured_data(format_writer_t * w, const syslog_message_t * msg) {
+  if (!msg->structured_data_count) {
+    writer_putc(w, NIL);
+    return;
+  }
+
+  size_t i, j;
+  for (i = 0; i < msg->structured_data_count; i++) {
+    const syslog_extended_property_t * property = &msg->structured_data[i];
+
+    writer_putc(w, OPEN_BRACKET);
+    writer_puts(w, property->id);
+
+    for (j = 0; j < property->num_pairs; j++) {
+      writer_putc(w, SEPARATOR);
+      writer_puts(w, property->pairs[j].key);
+      writer_putc(w, EQUALS);
+      writer_putc(w, QUOTE);
+      writer_put_sd_value(w, property->pairs[j].value);
+      writer_putc(w, QUOTE);
+    }
+
+    writer_putc(w, CLOSE_BRACKET);
+  }
+}
+
+static void write_rfc5424(format_writer_t * w, const syslog_message_t * msg) {
+  writer_putc(w, '<');
+  writer_put_uint(w, msg->pri_value, 1);
+  writer_putc(w, '>');
+  writer_puts(w, msg->syslog_version && *msg->syslog_version ? msg->syslog_version : "1");
+  writer_putc(w, SEPARATOR);
+  writer_put_timestamp(w, msg);
+  writer_putc(w, SEPARATOR);
+  writer_put_header_field(w, msg->hostname);
+  writer_putc(w, SEPARATOR);
+  writer_put_header_field(w, msg->appname);
+  writer_putc(w, SEPARATOR);
+  writer_put_header_field(w, msg->process_id);
+  writer_putc(w, SEPARATOR);
+  writer_put_header_field(w, msg->message_id);
+  writer_putc(w, SEPARATOR);
+  writer_put_structured_data(w, msg);
+
+  if (msg->message) {
+    writer_putc(w, SEPARATOR);
+    // The parser takes the BOM off MSG, so put it back for the round trip
+    if (msg->has_bom) {
+      writer_put(w, SYSLOG_UTF8_BOM, SYSLOG_UTF8_BOM_LENGTH);
+    }
+    writer_puts(w, msg->message);
+  }
+}
+
+size_t syslog_format_message_size(const syslog_message_t * msg) {
+  format_writer_t w = {NULL, 0, 0, 0};
+  write_rfc5424(&w, msg);
+  return w.used;
+}
+
+size_t syslog_format_message(const syslog_message_t * msg, char* out, size_t cap) {
+  format_writer_t w = {out, cap, 0, 0};
+  write_rfc5424(&w, msg);
+  return writer_finish(&w);
+}
+
+// --- JSON
+
+static void writer_put_json_key(format_writer_t * w, const char* key) {
+  // Only used with our own member names, which never need escaping
+  writer_putc(w, QUOTE);
+  writer_puts(w, key);
+  writer_put(w, "\":", 2);
+}
+
+static void writer_put_json_field(format_writer_t * w, const char* key, const char* value) {
+  writer_putc(w, ',');
+  writer_put_json_key(w, key);
+
+  if (!value || !*value) {
+    writer_put(w, "null", 4);
+  } else {
+    writer_put_json_string(w, value);
+  }
+}
+
+static void write_json(format_writer_t * w, const syslog_message_t * msg) {
+  writer_putc(w, '{');
+  writer_put_json_key(w, "pri");
+  writer_put_uint(w, msg->pri_value, 1);
+  writer_putc(w, ',');
+  writer_put_json_key(w, "facility");
+  writer_put_uint(w, msg->facility, 1);
+  writer_putc(w, ',');
+  writer_put_json_key(w, "severity");
+  writer_put_uint(w, msg->severity, 1);
+
+  writer_put_json_field(w, "version", msg->syslog_version);
+
+  writer_putc(w, ',');
+  writer_put_json_key(w, "timestamp");
+  if (msg->raw_timestamp && msg->raw_timestamp[0] == NIL && !msg->raw_timestamp[1]) {
+    // NIL has no time of its own, the struct only holds when it was parsed
+    writer_put(w, "null", 4);
+  } else if (msg->raw_timestamp && *msg->raw_timestamp) {
+    writer_put_json_string(w, msg->raw_timestamp);
+  } else {
+    writer_putc(w, QUOTE);
+    writer_put_iso_8601(w, &msg->timestamp);
+    writer_putc(w, QUOTE);
+  }
+
+  writer_put_json_field(w, "hostname", msg->hostname);
+  writer_put_json_field(w, "appname", msg->appname);
+  writer_put_json_field(w, "procid", msg->process_id);
+  writer_put_json_field(w, "msgid", msg->message_id);
+
+  writer_putc(w, ',');
+  writer_put_json_key(w, "structured_data");
+  writer_putc(w, '{');
+
+  size_t i, j;
+  for (i = 0; i < msg->structured_data_count; i++) {
+    const syslog_extended_property_t * property = &msg->structured_data[i];
+
+    if (i) {
+      writer_putc(w, ',');
+    }
+
+    writer_put_json_string(w, property->id);
+    writer_put(w, ":{", 2);
+
+    for (j = 0; j < property->num_pairs; j++) {
+      if (j) {
+        writer_putc(w, ',');
+      }
+
+      writer_put_json_string(w, property->pairs[j].key);
+      writer_putc(w, ':');
+      writer_put_json_string(w, property->pairs[j].value);
+    }
+
+    writer_putc(w, '}');
+  }
+
+  writer_putc(w, '}');
+
+  writer_put_json_field(w, "message", msg->message);
+
+  writer_putc(w, '}');
+}
+
+size_t syslog_format_json_size(const syslog_message_t * msg) {
+  format_writer_t w = {NULL, 0, 0, 0};
+  write_json(&w, msg);
+  return w.used;
+}
+
+size_t syslog_format_json(const syslog_message_t * msg, char* out, size_t cap) {
+  format_writer_t w = {out, cap, 0, 0};
+  write_json(&w, msg);
+  return writer_finish(&w);
+}
+
+static void write_ndjson(format_writer_t * w, const syslog_message_t * msgs, size_t count) {
+  size_t i;
+  for (i = 0; i < count; i++) {
+    write_json(w, &msgs[i]);
+    writer_putc(w, '\n');
+  }
+}
+
+size_t syslog_format_ndjson_size(const syslog_message_t * msgs, size_t count) {
+  format_writer_t w = {NULL, 0, 0, 0};
+  write_ndjson(&w, msgs, count);
+  return w.used;
+}
+
+size_t syslog_format_ndjson(const syslog_message_t * msgs, size_t count, char* out, size_t cap) {
+  format_writer_t w = {out, cap, 0, 0};
+  write_ndjson(&w, msgs, count);
+  return writer_finish(&w);
+}
+
+// --- RFC3164
+
+static const char* MONTHS[12] = {
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static void write_rfc3164(format_writer_t * w, const syslog_message_t * msg) {
+  const struct tm * timestamp = &msg->timestamp;
+  int month = timestamp->tm_mon >= 0 && timestamp->tm_mon < 12 ? timestamp->tm_mon : 0;
+
+  writer_putc(w, '<');
+  writer_put_uint(w, msg->pri_value, 1);
+  writer_putc(w, '>');
+
+  // Mmm dd hh:mm:ss, where the day is padded with a space rather than a zero
+  writer_put(w, MONTHS[month], 3);
+  writer_putc(w, SEPARATOR);
+  if (timestamp->tm_mday < 10) {
+    writer_putc(w, SEPARATOR);
+  }
+  writer_put_uint(w, timestamp->tm_mday, 1);
+  writer_putc(w, SEPARATOR);
+  writer_put_uint(w, timestamp->tm_hour, 2);
+  writer_putc(w, ':');
+  writer_put_uint(w, timestamp->tm_min, 2);
+  writer_putc(w, ':');
+  writer_put_uint(w, timestamp->tm_sec, 2);
+  writer_putc(w, SEPARATOR);
+
+  writer_put_header_field(w, msg->hostname);
+  writer_putc(w, SEPARATOR);
+
+  if (msg->appname && *msg->appname) {
+    writer_puts(w, msg->appname);
+
+    if (msg->process_id && *msg->process_id) {
+      writer_putc(w, '[');
+      writer_puts(w, msg->process_id);
+      writer_putc(w, ']');
+    }
+
+    writer_put(w, ": ", 2);
+  }
+
+  if (msg->message) {
+    writer_puts(w, msg->message);
+  }
+}
+
+size_t syslog_format_rfc3164_size(const syslog_message_t * msg) {
+  format_writer_t w = {NULL, 0, 0, 0};
+  write_rfc3164(&w, msg);
+  return w.used;
+}
+
+size_t syslog_format_rfc3164(const syslog_message_t * msg, char* out, size_t cap) {
+  format_writer_t w = {out, cap, 0, 0};
+  write_rfc3164(&w, msg);
+  return writer_finish(&w);
+}
+
+// --- GELF
+
+// GELF field names have to match ^[\w\.\-]*$
+static void writer_put_gelf_name(format_writer_t * w, const char* name) {
+  for (; *name; name++) {
+    char c = *name;
+    int allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+      || c == '_' || c == '.' || c == '-';
+
+    writer_putc(w, allowed ? c : '_');
+  }
+}
+
+static void writer_put_gelf_field(format_writer_t * w, const char* name, const char* value) {
+  if (!value || !*value) {
+    return;
+  }
+
+  writer_put(w, ",\"", 2);
+  writer_puts(w, name);
+  writer_put(w, "\":", 2);
+  writer_put_json_string(w, value);
+}
+
+static void writer_put_gelf_timestamp(format_writer_t * w, const syslog_message_t * msg) {
+  // Seconds since the epoch, with the fraction carried over from the original text when there was one
+  int64_t seconds;
+  if (!syslog_message_epoch(msg, &seconds)) {
+    // GELF servers fill in the time they got it, which is all NIL means
+    return;
+  }
+
+  if (seconds < 0) {
+    seconds = 0;
+  }
+
+  writer_put(w, ",\"timestamp\":", 13);
+  writer_put_uint(w, (unsigned long long) seconds, 1);
+
+  const char* fraction = msg->raw_timestamp ? strchr(msg->raw_timestamp, '.') : NULL;
+  if (fraction && fraction[1] >= '0' && fraction[1] <= '9') {
+    writer_putc(w, '.');
+
+    int digits;
+    for (digits = 1; digits <= 6 && fraction[digits] >= '0' && fraction[digits] <= '9'; digits++) {
+      writer_putc(w, fraction[digits]);
+    }
+  }
+}
+
+static void write_gelf(format_writer_t * w, const syslog_message_t * msg) {
+  writer_put(w, "{\"version\":\"1.1\",\"host\":", 24);
+  writer_put_json_string(w, msg->hostname && *msg->hostname ? msg->hostname : "-");
+  writer_put(w, ",\"short_message\":", 17);
+  writer_put_json_string(w, msg->message && *msg->message ? msg->message : "-");
+  writer_put_gelf_timestamp(w, msg);
+  writer_put(w, ",\"level\":", 9);
+  writer_put_uint(w, msg->severity, 1);
+  writer_put(w, ",\"_facility\":", 13);
+  writer_put_uint(w, msg->facility, 1);
+
+  writer_put_gelf_field(w, "_appname", msg->appname);
+  writer_put_gelf_field(w, "_procid", msg->process_id);
+  writer_put_gelf_field(w, "_msgid", msg->message_id);
+
+  size_t i, j;
+  for (i = 0; i < msg->structured_data_count; i++) {
+    const syslog_extended_property_t * property = &msg->structured_data[i];
+
+    for (j = 0; j < property->num_pairs; j++) {
+      writer_put(w, ",\"_", 3);
+      writer_put_gelf_name(w, property->id);
+      writer_putc(w, '_');
+      writer_put_gelf_name(w, property->pairs[j].key);
+      writer_put(w, "\":", 2);
+      writer_put_json_string(w, property->pairs[j].value);
+    }
+  }
+
+  writer_putc(w, '}');
+}
+
+size_t syslog_format_gelf_size(const syslog_message_t * msg) {
+  format_writer_t w = {NULL, 0, 0, 0};
+  write_gelf(&w, msg);
+  return w.used;
+}
+
+size_t syslog_format_gelf(const syslog_message_t * msg, char* out, size_t cap) {
+  format_writer_t w = {out, cap, 0, 0};
+  write_gelf(&w, msg);
+  return writer_finish(&w);
+}
+
+// --- Batches
+
+#define BATCH_IOVECS 64
+
+static size_t format_one(syslog_output_format_t format, const syslog_message_t * msg, char* out, size_t cap) {
+  switch (format) {
+    case SYSLOG_OUTPUT_RFC3164:
+      return syslog_format_rfc3164(msg, out, cap);
+    case SYSLOG_OUTPUT_JSON:
+      return syslog_format_json(msg, out, cap);
+    case SYSLOG_OUTPUT_GELF:
+      return syslog_format_gelf(msg, out, cap);
+    case SYSLOG_OUTPUT_RFC5424:
+    default:
+      return syslog_format_message(msg, out, cap);
+  }
+}
+
+// writev until everything went out, picking up after partial writes
+static ssize_t writev_all(int fd, struct iovec * iov, int iovcnt) {
+  ssize_t total = 0;
+
+  while (iovcnt > 0) {
+    ssize_t written = writev(fd, iov, iovcnt);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+
+    total += written;
+
+    while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if (iovcnt > 0) {
+      iov->iov_base = (char*) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return total;
+}
+
+ssize_t syslog_write_batch(int fd, const syslog_message_t * msgs, size_t count, syslog_output_format_t format, char* scratch, size_t scratch_cap) {
+  struct iovec iov[BATCH_IOVECS];
+  int iovcnt = 0;
+  size_t used = 0;
+  ssize_t total = 0;
+
+  char delimiter = format == SYSLOG_OUTPUT_GELF ? '\0' : '\n';
+
+  size_t i = 0;
+  while (i < count) {
+    size_t length = format_one(format, &msgs[i], scratch + used, scratch_cap - used);
+
+    if (length) {
+      // The encoder NUL terminated it, the delimiter goes in that byte
+      scratch[used + length] = delimiter;
+      iov[iovcnt].iov_base = scratch + used;
+      iov[iovcnt].iov_len = length + 1;
+      iovcnt++;
+      used += length + 1;
+      i++;
+    } else if (!iovcnt) {
+      // Did not fit in an empty buffer, so it never will
+      errno = EMSGSIZE;
+      return -1;
+    }
+
+    if (!length || iovcnt == BATCH_IOVECS || i == count) {
+      ssize_t written = writev_all(fd, iov, iovcnt);
+      if (written < 0) {
+        return -1;
+      }
+
+      total += written;
+      iovcnt = 0;
+      used = 0;
+    }
+  }
+
+  return total;
+}
@@ -0,0 +1,69 @@
+#ifndef LIB_SYSLOG_FORMAT_H
+#define LIB_SYSLOG_FORMAT_H
+
+#include <sys/types.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Encoders that turn a syslog_message_t back into text.
+//
+// Each format has a _size function that returns the exact number of bytes the
+// encoder will produce, not counting the terminator. The encoders write into
+// the caller's buffer, NUL terminate it, and return the number of bytes
+// written. If cap is too small (it needs to be at least size + 1) they return
+// 0 and the contents of out are undefined.
+
+// RFC5424. Empty or NULL header fields are written as NIL, and the timestamp
+// is written exactly as it was received when the message came from the parser.
+// Param values are escaped as described in RFC5424 section 6.3.3.
+size_t syslog_format_message_size(const syslog_message_t * msg);
+size_t syslog_format_message(const syslog_message_t * msg, char* out, size_t cap);
+
+// JSON. Header fields become top level members, NIL ones are null, and the
+// timestamp is an ISO 8601 string. Structured data is an object keyed by
+// SD-ID whose values are objects of the params. Strings are written as they
+// are, only ", \ and control characters are escaped.
+size_t syslog_format_json_size(const syslog_message_t * msg);
+size_t syslog_format_json(const syslog_message_t * msg, char* out, size_t cap);
+
+// Newline delimited JSON for a batch: one object per message, each followed
+// by a newline.
+size_t syslog_format_ndjson_size(const syslog_message_t * msgs, size_t count);
+size_t syslog_format_ndjson(const syslog_message_t * msgs, size_t count, char* out, size_t cap);
+
+// RFC3164 for older collectors: "<PRI>Mmm dd hh:mm:ss HOSTNAME TAG[PID]: MSG",
+// where TAG is the APP-NAME. There is nowhere to put structured data or
+// MSGID in that format so they are dropped.
+size_t syslog_format_rfc3164_size(const syslog_message_t * msg);
+size_t syslog_format_rfc3164(const syslog_message_t * msg, char* out, size_t cap);
+
+// GELF 1.1. Severity becomes level, APP-NAME, PROCID, MSGID and the facility
+// become additional fields, and every SD param becomes an additional field
+// named _<SD-ID>_<param>, with characters GELF does not allow replaced by _.
+size_t syslog_format_gelf_size(const syslog_message_t * msg);
+size_t syslog_format_gelf(const syslog_message_t * msg, char* out, size_t cap);
+
+typedef enum syslog_output_format_t {
+  SYSLOG_OUTPUT_RFC5424,
+  SYSLOG_OUTPUT_RFC3164,
+  SYSLOG_OUTPUT_JSON,
+  SYSLOG_OUTPUT_GELF
+} syslog_output_format_t;
+
+// Encodes count messages into scratch and sends them to fd with as few writev
+// calls as scratch allows, one whenever it fills up. Each message is followed
+// by a newline, or by a NUL byte for GELF as GELF over TCP expects.
+//
+// Returns the number of bytes written, or -1 with errno set. EMSGSIZE means a
+// single message did not fit in scratch.
+ssize_t syslog_write_batch(int fd, const syslog_message_t * msgs, size_t count, syslog_output_format_t format, char* scratch, size_t scratch_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
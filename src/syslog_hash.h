@@ -0,0 +1,65 @@
+#ifndef LIB_SYSLOG_HASH_H
+#define LIB_SYSLOG_HASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+// MurmurHash64A by Austin Appleby (public domain). Reads 8 bytes at a time,
+// which is plenty fast for the short fields we hash (hostnames, app names,
+// SD ids) and has good enough distribution for open addressing.
+static inline uint64_t syslog_hash64(const void* key, size_t len, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+
+  uint64_t h = seed ^ (len * m);
+
+  const unsigned char* data = (const unsigned char*) key;
+  const unsigned char* end = data + (len & ~(size_t) 7);
+
+  while (data != end) {
+    uint64_t k;
+    memcpy(&k, data, sizeof(k));
+    data += 8;
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  switch (len & 7) {
+    case 7: h ^= (uint64_t) data[6] << 48; // fallthrough
+    case 6: h ^= (uint64_t) data[5] << 40; // fallthrough
+    case 5: h ^= (uint64_t) data[4] << 32; // fallthrough
+    case 4: h ^= (uint64_t) data[3] << 24; // fallthrough
+    case 3: h ^= (uint64_t) data[2] << 16; // fallthrough
+    case 2: h ^= (uint64_t) data[1] << 8;  // fallthrough
+    case 1: h ^= (uint64_t) data[0];
+            h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
+
+// Folds a field hash into a running hash so several fields can be combined
+// in order without concatenating them first.
+static inline uint64_t syslog_hash64_combine(uint64_t h, uint64_t field_hash) {
+  h ^= field_hash + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h;
+}
+
+#define SYSLOG_FINGERPRINT_SEED 0xf1e2d3c4
+
+// Adds one field to a message fingerprint. NIL fields hash as if they were
+// empty, whether they are passed as NULL or "".
+static inline uint64_t syslog_fingerprint_field(uint64_t h, const char* field, size_t length) {
+  return syslog_hash64_combine(h, syslog_hash64(field, length, SYSLOG_FINGERPRINT_SEED));
+}
+
+#endif
@@ -0,0 +1,277 @@
+#include "syslog_intern.h"
+#include "syslog_internal.h"
+#include "syslog_hash.h"
+
+#define INTERN_HASH_SEED 0x5bd1e995
+#define INTERN_MIN_SLOTS 64
+#define INTERN_BLOCK_SIZE 65536
+
+typedef struct intern_entry_t {
+  const char* str;
+  uint32_t length;
+  uint64_t hash;
+} intern_entry_t;
+
+// Strings are packed into large blocks that never move, which is what keeps
+// the canonical pointers stable while the slot array is rehashed underneath.
+typedef struct intern_block_t {
+  struct intern_block_t * next;
+  size_t used;
+  size_t capacity;
+  char data[];
+} intern_block_t;
+
+struct syslog_intern_table_t {
+  // Open addressing with linear probing. A slot holds an id, 0 is empty.
+  uint32_t * slots;
+  size_t slot_mask;
+
+  // entries[id] describes the string for id. entries[0] is the NIL entry.
+  intern_entry_t * entries;
+  size_t count;
+  size_t entries_capacity;
+
+  intern_block_t * blocks;
+};
+
+static size_t next_power_of_two(size_t n) {
+  size_t p = INTERN_MIN_SLOTS;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+syslog_intern_table_t * syslog_intern_table_new(size_t expected_strings) {
+  syslog_intern_table_t * table = syslog_calloc(1, sizeof(syslog_intern_table_t));
+  if (!table) {
+    return NULL;
+  }
+
+  // Stay under half full so probe sequences are short
+  size_t slots = next_power_of_two(expected_strings * 2);
+
+  table->slots = syslog_calloc(slots, sizeof(uint32_t));
+  table->slot_mask = slots - 1;
+  table->entries_capacity = slots / 2 + 1;
+  table->entries = syslog_malloc(sizeof(intern_entry_t) * table->entries_capacity);
+
+  if (!table->slots || !table->entries) {
+    syslog_intern_table_free(table);
+    return NULL;
+  }
+
+  table->entries[SYSLOG_INTERN_NIL] = (intern_entry_t) {"", 0, 0};
+  table->count = 1;
+
+  return table;
+}
+
+void syslog_intern_table_free(syslog_intern_table_t * table) {
+  if (!table) {
+    return;
+  }
+
+  intern_block_t * block = table->blocks;
+  while (block) {
+    intern_block_t * next = block->next;
+    syslog_free(block);
+    block = next;
+  }
+
+  syslog_free(table->slots);
+  syslog_free(table->entries);
+  syslog_free(table);
+}
+
+static const char* intern_copy(syslog_intern_table_t * table, const char* str, size_t length) {
+  intern_block_t * block = table->blocks;
+
+  if (!block || block->capacity - block->used < length + 1) {
+    size_t capacity = length + 1 > INTERN_BLOCK_SIZE ? length + 1 : INTERN_BLOCK_SIZE;
+
+    block = syslog_malloc(sizeof(intern_block_t) + capacity);
+    if (!block) {
+      return NULL;
+    }
+
+    block->used = 0;
+    block->capacity = capacity;
+    block->next = table->blocks;
+    table->blocks = block;
+  }
+
+  char* copy = &block->data[block->used];
+  memcpy(copy, str, length);
+  copy[length] = 0;
+  block->used += length + 1;
+
+  return copy;
+}
+
+static int intern_grow(syslog_intern_table_t * table) {
+  size_t slots = (table->slot_mask + 1) * 2;
+
+  uint32_t * new_slots = syslog_calloc(slots, sizeof(uint32_t));
+  intern_entry_t * new_entries = syslog_realloc(table->entries, sizeof(intern_entry_t) * (slots / 2 + 1));
+
+  if (!new_slots || !new_entries) {
+    syslog_free(new_slots);
+    if (new_entries) {
+      table->entries = new_entries;
+    }
+    return 0;
+  }
+
+  table->entries = new_entries;
+  table->entries_capacity = slots / 2 + 1;
+
+  // Hashes are kept with the entries so this never touches the strings
+  size_t mask = slots - 1;
+  uint32_t id;
+  for (id = 1; id < table->count; id++) {
+    size_t slot = table->entries[id].hash & mask;
+    while (new_slots[slot]) {
+      slot = (slot + 1) & mask;
+    }
+    new_slots[slot] = id;
+  }
+
+  syslog_free(table->slots);
+  table->slots = new_slots;
+  table->slot_mask = mask;
+
+  return 1;
+}
+
+uint32_t syslog_intern(syslog_intern_table_t * table, const char* str, size_t length) {
+  if (!str || length == 0) {
+    return SYSLOG_INTERN_NIL;
+  }
+
+  if (length > UINT32_MAX) {
+    return SYSLOG_INTERN_ERROR;
+  }
+
+  uint64_t hash = syslog_hash64(str, length, INTERN_HASH_SEED);
+
+  size_t slot = hash & table->slot_mask;
+  uint32_t id;
+  while ((id = table->slots[slot])) {
+    const intern_entry_t * entry = &table->entries[id];
+    if (entry->hash == hash && entry->length == length && memcmp(entry->str, str, length) == 0) {
+      return id;
+    }
+    slot = (slot + 1) & table->slot_mask;
+  }
+
+  // Not there, so it needs adding. Grow first if that would take us over half full.
+  if (table->count + 1 >= table->entries_capacity) {
+    if (table->count >= SYSLOG_INTERN_ERROR - 1 || !intern_grow(table)) {
+      return SYSLOG_INTERN_ERROR;
+    }
+
+    slot = hash & table->slot_mask;
+    while (table->slots[slot]) {
+      slot = (slot + 1) & table->slot_mask;
+    }
+  }
+
+  const char* copy = intern_copy(table, str, length);
+  if (!copy) {
+    return SYSLOG_INTERN_ERROR;
+  }
+
+  id = (uint32_t) table->count++;
+  table->entries[id] = (intern_entry_t) {copy, (uint32_t) length, hash};
+  table->slots[slot] = id;
+
+  return id;
+}
+
+const char* syslog_intern_string(const syslog_intern_table_t * table, uint32_t id) {
+  if (id >= table->count) {
+    return NULL;
+  }
+
+  return table->entries[id].str;
+}
+
+size_t syslog_intern_string_length(const syslog_intern_table_t * table, uint32_t id) {
+  if (id >= table->count) {
+    return 0;
+  }
+
+  return table->entries[id].length;
+}
+
+size_t syslog_intern_table_count(const syslog_intern_table_t * table) {
+  // Don't count the NIL entry
+  return table->count - 1;
+}
+
+static uint32_t intern_cstr(syslog_intern_table_t * table, const char* str, int * ok) {
+  uint32_t id = syslog_intern(table, str, str ? strlen(str) : 0);
+  if (id == SYSLOG_INTERN_ERROR) {
+    *ok = 0;
+  }
+  return id;
+}
+
+int syslog_intern_message(syslog_intern_table_t * table, const syslog_message_t * message, syslog_interned_message_t * out) {
+  int ok = 1;
+
+  memset(out, 0, sizeof(syslog_interned_message_t));
+
+  out->hostname = intern_cstr(table, message->hostname, &ok);
+  out->appname = intern_cstr(table, message->appname, &ok);
+  out->message_id = intern_cstr(table, message->message_id, &ok);
+
+  if (message->structured_data_count > 0) {
+    size_t param_count = 0;
+
+    size_t i, j;
+    for (i = 0; i < message->structured_data_count; i++) {
+      param_count += message->structured_data[i].num_pairs;
+    }
+
+    out->structured_data_ids = syslog_malloc(sizeof(uint32_t) * message->structured_data_count);
+    out->param_name_ids = syslog_malloc(sizeof(uint32_t) * (param_count + 1));
+
+    if (!out->structured_data_ids || !out->param_name_ids) {
+      free_syslog_interned_message_t(out);
+      return 0;
+    }
+
+    out->structured_data_count = message->structured_data_count;
+    out->param_count = param_count;
+
+    size_t param_index = 0;
+    for (i = 0; i < message->structured_data_count; i++) {
+      const syslog_extended_property_t * property = &message->structured_data[i];
+
+      out->structured_data_ids[i] = intern_cstr(table, property->id, &ok);
+
+      for (j = 0; j < property->num_pairs; j++) {
+        out->param_name_ids[param_index++] = intern_cstr(table, property->pairs[j].key, &ok);
+      }
+    }
+  }
+
+  if (!ok) {
+    free_syslog_interned_message_t(out);
+    return 0;
+  }
+
+  return 1;
+}
+
+void free_syslog_interned_message_t(syslog_interned_message_t * interned) {
+  syslog_free(interned->structured_data_ids);
+  syslog_free(interned->param_name_ids);
+
+  interned->structured_data_ids = NULL;
+  interned->param_name_ids = NULL;
+  interned->structured_data_count = 0;
+  interned->param_count = 0;
+}
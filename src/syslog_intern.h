@@ -0,0 +1,61 @@
+#ifndef LIB_SYSLOG_INTERN_H
+#define LIB_SYSLOG_INTERN_H
+
+#include <stdint.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Id 0 is reserved for NIL / empty strings and is never handed out for
+// anything else, so a zeroed syslog_interned_message_t is all NIL.
+#define SYSLOG_INTERN_NIL 0
+// Returned when the table could not grow to hold a new string
+#define SYSLOG_INTERN_ERROR UINT32_MAX
+
+// An interning table maps strings to small stable ids and keeps one canonical
+// copy of each. Ids are dense, starting at 1, and stay valid (as do the
+// canonical strings) until the table is freed.
+//
+// Tables are not thread safe. Give each parsing thread its own table, or put
+// a lock around a shared one if ids need to agree across threads.
+typedef struct syslog_intern_table_t syslog_intern_table_t;
+
+// The low cardinality parts of a parsed message, as ids into a table.
+typedef struct syslog_interned_message_t {
+  uint32_t hostname;
+  uint32_t appname;
+  uint32_t message_id;
+
+  // One id per structured data element
+  uint32_t * structured_data_ids;
+  size_t structured_data_count;
+
+  // The key of every param, in order, across all elements. Element i owns
+  // structured_data[i].num_pairs consecutive entries.
+  uint32_t * param_name_ids;
+  size_t param_count;
+} syslog_interned_message_t;
+
+syslog_intern_table_t * syslog_intern_table_new(size_t expected_strings);
+void syslog_intern_table_free(syslog_intern_table_t * table);
+
+uint32_t syslog_intern(syslog_intern_table_t * table, const char* str, size_t length);
+const char* syslog_intern_string(const syslog_intern_table_t * table, uint32_t id);
+size_t syslog_intern_string_length(const syslog_intern_table_t * table, uint32_t id);
+size_t syslog_intern_table_count(const syslog_intern_table_t * table);
+
+// Interns a message that has already been parsed. Putting the table in the
+// parse options is cheaper: the names are never copied into the message, and
+// their ids come back in hostname_id, appname_id and message_id_id and on the
+// structured data itself.
+int syslog_intern_message(syslog_intern_table_t * table, const syslog_message_t * message, syslog_interned_message_t * out);
+void free_syslog_interned_message_t(syslog_interned_message_t * interned);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef LIB_SYSLOG_INTERNAL_H
+#define LIB_SYSLOG_INTERNAL_H
+
+#include "syslog.h"
+#include "syslog_alloc.h"
+
+// Library internals. This header is not installed. It declares the allocation
+// wrappers every module uses, and the stages parse_syslog_message_t is built
+// from so the microbenchmarks can time each stage on its own.
+
+typedef struct syslog_parse_context_t {
+  const char * message;
+  int pointer;
+  int is_eol;
+} syslog_parse_context_t;
+
+syslog_parse_context_t create_parse_context(const char* raw_message);
+int parse_context_is_eol(syslog_parse_context_t * ctx);
+int parse_context_peek(syslog_parse_context_t * ctx, char* out);
+int parse_context_one(syslog_parse_context_t * ctx, char* out);
+size_t parse_context_next_until(syslog_parse_context_t * ctx, char until_char, char* writestr, int include_eol);
+size_t parse_context_next_until_with_escapes(syslog_parse_context_t * ctx, char until_char, char* writestr, int evaluate_escapes, int or_eol);
+// unterminated is set to the offset of an element with no closing bracket, 0
+// when there is none
+int parse_context_get_structured_data_elements(syslog_parse_context_t * ctx, char* writestr, size_t * num_elements, size_t * unterminated);
+
+struct syslog_intern_table_t;
+
+// With a table the SD-ID and PARAM-NAMEs are interned rather than copied.
+// Returns 0 for an element that is not valid and -1 when the table could not
+// take a name.
+int parse_structured_data_element(char* data_string, syslog_extended_property_t * property, struct syslog_intern_table_t * table);
+// Elements that are not valid are left out of out and num_parsed, and out is
+// NULL when none are. Returns 0 when the table could not take a name.
+int get_structured_data(char* structured_data_elements, size_t num_elements, struct syslog_intern_table_t * table, syslog_iana_structured_data_t * iana, syslog_extended_property_t ** out, size_t * num_parsed);
+void free_syslog_extended_property_t(syslog_extended_property_t * extended_property);
+
+// Counts a parse in the calling thread's stats, see syslog_stats.h
+void syslog_stats_record(syslog_parse_result_t result, syslog_parse_error_t error, size_t bytes);
+
+int get_facility_id(int pri_value);
+int parse_iso_8601(const char* datestring, struct tm* tptr);
+
+// Everything in the library allocates through these, never malloc and friends
+// directly, so the hooks in syslog_alloc.h see all of it.
+void* syslog_malloc(size_t size);
+void* syslog_calloc(size_t count, size_t size);
+void* syslog_realloc(void* ptr, size_t size);
+void syslog_free(void* ptr);
+// The calling thread's allocation counters, NULL when they are not being kept
+const syslog_alloc_stats_t * syslog_alloc_stats_local(void);
+
+#endif
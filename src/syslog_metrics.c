@@ -0,0 +1,395 @@
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "syslog_metrics.h"
+#include "syslog_stats.h"
+#include "syslog_internal.h"
+
+// Label values for each syslog_parse_error_t, which have to stay put once
+// someone has a dashboard on them
+static const char* ERROR_LABELS[SYSLOG_ERROR_COUNT] = {
+  "none",
+  "empty_input",
+  "bad_pri",
+  "bad_version",
+  "bad_timestamp",
+  "missing_field",
+  "unterminated_sd",
+  "field_too_long",
+  "bad_character",
+  "bad_sd",
+  "message_too_long",
+  "bad_utf8",
+  "intern_failed"
+};
+
+static const char* STAGE_LABELS[SYSLOG_LATENCY_STAGES] = {
+  "parse",
+  "sink",
+  "total"
+};
+
+// Some of what rendering writes, snprintf style. length keeps counting once
+// the buffer is full so the caller can find out how much it needed.
+typedef struct metrics_writer_t {
+  char* out;
+  size_t size;
+  size_t length;
+} metrics_writer_t;
+
+static void emit(metrics_writer_t * writer, const char* format, ...) {
+  va_list args;
+  char* at = writer->length < writer->size ? writer->out + writer->length : NULL;
+  size_t left = at ? writer->size - writer->length : 0;
+
+  va_start(args, format);
+  int n = vsnprintf(at, left, format, args);
+  va_end(args);
+
+  if (n > 0) {
+    writer->length += n;
+  }
+}
+
+static void emit_family(metrics_writer_t * writer, const char* name, const char* type, const char* help) {
+  emit(writer, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void emit_seconds(metrics_writer_t * writer, const char* name, const char* stage, const char* quantile, uint64_t ns) {
+  if (quantile) {
+    emit(writer, "%s{stage=\"%s\",quantile=\"%s\"} %llu.%09llu\n", name, stage, quantile,
+      (unsigned long long) (ns / 1000000000ULL), (unsigned long long) (ns % 1000000000ULL));
+  } else {
+    emit(writer, "%s{stage=\"%s\"} %llu.%09llu\n", name, stage,
+      (unsigned long long) (ns / 1000000000ULL), (unsigned long long) (ns % 1000000000ULL));
+  }
+}
+
+static void render_parse_stats(metrics_writer_t * writer) {
+  syslog_parse_stats_t stats;
+  int error;
+
+  syslog_parse_stats(&stats);
+
+  emit_family(writer, "syslog_messages", "counter", "Messages handed to the parser.");
+  emit(writer, "syslog_messages_total %llu\n", (unsigned long long) stats.messages);
+
+  emit_family(writer, "syslog_received_bytes", "counter", "Bytes handed to the parser.");
+  emit(writer, "# UNIT syslog_received_bytes bytes\n");
+  emit(writer, "syslog_received_bytes_total %llu\n", (unsigned long long) stats.bytes);
+
+  emit_family(writer, "syslog_parsed", "counter", "Messages parsed and kept.");
+  emit(writer, "syslog_parsed_total %llu\n", (unsigned long long) stats.parsed);
+
+  emit_family(writer, "syslog_dropped", "counter", "Messages the parse options dropped.");
+  emit(writer, "syslog_dropped_total{reason=\"filtered\"} %llu\n", (unsigned long long) stats.filtered);
+  emit(writer, "syslog_dropped_total{reason=\"duplicate\"} %llu\n", (unsigned long long) stats.duplicates);
+
+  emit_family(writer, "syslog_parse_failures", "counter", "Messages that failed to parse, by reason.");
+  for (error = SYSLOG_ERROR_NONE + 1; error < SYSLOG_ERROR_COUNT; error++) {
+    emit(writer, "syslog_parse_failures_total{reason=\"%s\"} %llu\n", ERROR_LABELS[error],
+      (unsigned long long) stats.failures_by_error[error]);
+  }
+}
+
+static void render_latency(metrics_writer_t * writer) {
+  syslog_latency_summary_t summaries[SYSLOG_LATENCY_STAGES];
+  int stage;
+
+  for (stage = 0; stage < SYSLOG_LATENCY_STAGES; stage++) {
+    syslog_latency(stage, &summaries[stage]);
+  }
+
+  emit_family(writer, "syslog_latency_seconds", "summary", "Time from receipt to parsed, parsed to emitted, and receipt to emitted.");
+  emit(writer, "# UNIT syslog_latency_seconds seconds\n");
+  for (stage = 0; stage < SYSLOG_LATENCY_STAGES; stage++) {
+    const syslog_latency_summary_t * summary = &summaries[stage];
+    const char* label = STAGE_LABELS[stage];
+
+    emit_seconds(writer, "syslog_latency_seconds", label, "0.5", summary->p50_ns);
+    emit_seconds(writer, "syslog_latency_seconds", label, "0.9", summary->p90_ns);
+    emit_seconds(writer, "syslog_latency_seconds", label, "0.99", summary->p99_ns);
+    emit_seconds(writer, "syslog_latency_seconds", label, "0.999", summary->p999_ns);
+    emit_seconds(writer, "syslog_latency_seconds_sum", label, NULL, summary->sum_ns);
+    emit(writer, "syslog_latency_seconds_count{stage=\"%s\"} %llu\n", label, (unsigned long long) summary->count);
+  }
+
+  emit_family(writer, "syslog_latency_max_seconds", "gauge", "Longest latency seen at each stage.");
+  emit(writer, "# UNIT syslog_latency_max_seconds seconds\n");
+  for (stage = 0; stage < SYSLOG_LATENCY_STAGES; stage++) {
+    emit_seconds(writer, "syslog_latency_max_seconds", STAGE_LABELS[stage], NULL, summaries[stage].max_ns);
+  }
+}
+
+#ifdef SYSLOG_ALLOC_STATS
+static void render_alloc_stats(metrics_writer_t * writer) {
+  syslog_alloc_stats_t stats;
+
+  syslog_alloc_stats_total(&stats);
+
+  emit_family(writer, "syslog_alloc_allocations", "counter", "Allocations made by the library.");
+  emit(writer, "syslog_alloc_allocations_total %llu\n", (unsigned long long) stats.allocations);
+
+  emit_family(writer, "syslog_alloc_reallocations", "counter", "Reallocations made by the library.");
+  emit(writer, "syslog_alloc_reallocations_total %llu\n", (unsigned long long) stats.reallocations);
+
+  emit_family(writer, "syslog_alloc_frees", "counter", "Frees made by the library.");
+  emit(writer, "syslog_alloc_frees_total %llu\n", (unsigned long long) stats.frees);
+
+  emit_family(writer, "syslog_alloc_allocated_bytes", "counter", "Bytes allocated by the library.");
+  emit(writer, "# UNIT syslog_alloc_allocated_bytes bytes\n");
+  emit(writer, "syslog_alloc_allocated_bytes_total %llu\n", (unsigned long long) stats.bytes_allocated);
+
+  emit_family(writer, "syslog_alloc_live_bytes", "gauge", "Bytes allocated by the library and not yet freed.");
+  emit(writer, "# UNIT syslog_alloc_live_bytes bytes\n");
+  emit(writer, "syslog_alloc_live_bytes %lld\n", (long long) stats.live_bytes);
+}
+#endif
+
+size_t syslog_metrics_render(const syslog_metrics_gauge_t * gauges, size_t gauge_count, char* out, size_t size) {
+  metrics_writer_t writer = { out, size, 0 };
+  size_t i;
+
+  if (out && size) {
+    out[0] = '\0';
+  }
+
+  render_parse_stats(&writer);
+  render_latency(&writer);
+#ifdef SYSLOG_ALLOC_STATS
+  render_alloc_stats(&writer);
+#endif
+
+  for (i = 0; i < gauge_count; i++) {
+    emit_family(&writer, gauges[i].name, "gauge", gauges[i].help ? gauges[i].help : "");
+    emit(&writer, "%s %lld\n", gauges[i].name, (long long) gauges[i].read(gauges[i].user));
+  }
+
+  emit(&writer, "# EOF\n");
+
+  return writer.length;
+}
+
+// Anything longer than this isn't a scrape
+#define MAX_REQUEST 4096
+#define REQUEST_TIMEOUT_SECONDS 2
+
+struct syslog_metrics_server_t {
+  int listen_fd;
+  // Writing to wake[1] tells the server thread to stop
+  int wake[2];
+  uint16_t port;
+  const syslog_metrics_gauge_t * gauges;
+  size_t gauge_count;
+  pthread_t thread;
+};
+
+static int send_all(int fd, const char* data, size_t length) {
+  while (length) {
+    ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return 0;
+    }
+
+    data += sent;
+    length -= sent;
+  }
+
+  return 1;
+}
+
+static void respond(int fd, const char* status, const char* content_type, const char* body, size_t length) {
+  char header[256];
+  int n = snprintf(header, sizeof(header),
+    "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+    status, content_type, length);
+
+  if (send_all(fd, header, n)) {
+    send_all(fd, body, length);
+  }
+}
+
+// The whole text, sized by rendering it once to find out how long it is. The
+// counters can grow between the two renders, hence the loop.
+static char* render_body(const syslog_metrics_server_t * server, size_t * length) {
+  size_t size = syslog_metrics_render(server->gauges, server->gauge_count, NULL, 0) + 256;
+
+  for (;;) {
+    char* body = syslog_malloc(size);
+    if (!body) {
+      return NULL;
+    }
+
+    *length = syslog_metrics_render(server->gauges, server->gauge_count, body, size);
+    if (*length < size) {
+      return body;
+    }
+
+    syslog_free(body);
+    size = *length + 256;
+  }
+}
+
+static void serve_connection(const syslog_metrics_server_t * server, int fd) {
+  char request[MAX_REQUEST + 1];
+  size_t length = 0;
+
+  struct timeval timeout = { REQUEST_TIMEOUT_SECONDS, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // Only the request line matters, but read the headers too so the client
+  // isn't reset for closing on unread data
+  while (length < MAX_REQUEST) {
+    ssize_t n = recv(fd, request + length, MAX_REQUEST - length, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+
+    length += n;
+    request[length] = '\0';
+
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+      break;
+    }
+  }
+  request[length] = '\0';
+
+  static const char NOT_FOUND[] = "Not found, try /metrics\n";
+
+  if (strncmp(request, "GET /metrics", 12) || (request[12] != ' ' && request[12] != '?')) {
+    respond(fd, "404 Not Found", "text/plain", NOT_FOUND, sizeof(NOT_FOUND) - 1);
+    return;
+  }
+
+  size_t body_length;
+  char* body = render_body(server, &body_length);
+  if (!body) {
+    respond(fd, "500 Internal Server Error", "text/plain", "", 0);
+    return;
+  }
+
+  respond(fd, "200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8", body, body_length);
+  syslog_free(body);
+}
+
+static void* server_thread(void* arg) {
+  syslog_metrics_server_t * server = arg;
+  struct pollfd fds[2] = {
+    { server->listen_fd, POLLIN, 0 },
+    { server->wake[0], POLLIN, 0 }
+  };
+
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    if (fds[1].revents) {
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(server->listen_fd, NULL, NULL);
+      if (fd >= 0) {
+        serve_connection(server, fd);
+        close(fd);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+syslog_metrics_server_t * syslog_metrics_server_start(const syslog_metrics_config_t * config) {
+  struct sockaddr_in address;
+  socklen_t address_length = sizeof(address);
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(config->port);
+  if (inet_pton(AF_INET, config->address ? config->address : "127.0.0.1", &address.sin_addr) != 1) {
+    return NULL;
+  }
+
+  syslog_metrics_server_t * server = syslog_calloc(1, sizeof(syslog_metrics_server_t));
+  if (!server) {
+    return NULL;
+  }
+
+  server->gauges = config->gauges;
+  server->gauge_count = config->gauge_count;
+  server->wake[0] = server->wake[1] = -1;
+
+  server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (server->listen_fd < 0) {
+    goto fail;
+  }
+
+  int reuse = 1;
+  setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  if (bind(server->listen_fd, (struct sockaddr *) &address, sizeof(address)) ||
+      listen(server->listen_fd, 16) ||
+      getsockname(server->listen_fd, (struct sockaddr *) &address, &address_length)) {
+    goto fail;
+  }
+  server->port = ntohs(address.sin_port);
+
+  if (pipe(server->wake)) {
+    server->wake[0] = server->wake[1] = -1;
+    goto fail;
+  }
+
+  if (pthread_create(&server->thread, NULL, server_thread, server)) {
+    goto fail;
+  }
+
+  return server;
+
+fail:
+  if (server->listen_fd >= 0) {
+    close(server->listen_fd);
+  }
+  if (server->wake[0] >= 0) {
+    close(server->wake[0]);
+    close(server->wake[1]);
+  }
+  syslog_free(server);
+  return NULL;
+}
+
+uint16_t syslog_metrics_server_port(const syslog_metrics_server_t * server) {
+  return server->port;
+}
+
+void syslog_metrics_server_stop(syslog_metrics_server_t * server) {
+  if (!server) {
+    return;
+  }
+
+  char stop = 1;
+  while (write(server->wake[1], &stop, 1) < 0 && errno == EINTR);
+
+  pthread_join(server->thread, NULL);
+
+  close(server->listen_fd);
+  close(server->wake[0]);
+  close(server->wake[1]);
+  syslog_free(server);
+}
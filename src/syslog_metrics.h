@@ -0,0 +1,65 @@
+#ifndef LIB_SYSLOG_METRICS_H
+#define LIB_SYSLOG_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// The parse counters, latency histograms and allocation counters in OpenMetrics
+// text format, the format Prometheus scrapes. Everything is read from the
+// per-thread stats, so rendering never makes a parsing thread wait.
+//
+// Exported as
+//
+//   syslog_messages_total, syslog_received_bytes_total, syslog_parsed_total
+//   syslog_dropped_total{reason="filtered"|"duplicate"}
+//   syslog_parse_failures_total{reason="bad_pri"|...}
+//   syslog_latency_seconds{stage="parse"|"sink"|"total"} as a summary
+//   syslog_latency_max_seconds{stage=...}
+//   syslog_alloc_*, when built with -DSYSLOG_ALLOC_STATS
+//
+// plus any gauges the program adds, for things only it knows about like queue
+// depths.
+
+typedef struct syslog_metrics_gauge_t {
+  // A valid metric name, e.g. "receiver_queue_depth"
+  const char* name;
+  const char* help;
+  // Called on the thread doing the rendering, so it needs to be safe to call
+  // from there
+  int64_t (*read)(void* user);
+  void* user;
+} syslog_metrics_gauge_t;
+
+// Renders into out like snprintf does, returning the length of the whole text
+// even when it did not fit into size
+size_t syslog_metrics_render(const syslog_metrics_gauge_t * gauges, size_t gauge_count, char* out, size_t size);
+
+// A tiny HTTP server that answers GET /metrics on its own thread, one
+// connection at a time. It is meant for a local scraper, not the internet.
+typedef struct syslog_metrics_server_t syslog_metrics_server_t;
+
+typedef struct syslog_metrics_config_t {
+  // IPv4 address to listen on, 127.0.0.1 when NULL
+  const char* address;
+  // 0 picks a free port, see syslog_metrics_server_port
+  uint16_t port;
+  // Read on every scrape, so they have to outlive the server
+  const syslog_metrics_gauge_t * gauges;
+  size_t gauge_count;
+} syslog_metrics_config_t;
+
+// NULL if the address can't be listened on
+syslog_metrics_server_t * syslog_metrics_server_start(const syslog_metrics_config_t * config);
+uint16_t syslog_metrics_server_port(const syslog_metrics_server_t * server);
+// Waits for a scrape in progress to finish
+void syslog_metrics_server_stop(syslog_metrics_server_t * server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#include <time.h>
+
+#include "syslog_ratelimit.h"
+#include "syslog_internal.h"
+#include "syslog_hash.h"
+
+#define RATE_HASH_SEED 0x2545f491
+#define RATE_MIN_SLOTS 16
+// How far past its home slot a source may live. Also how many candidates there
+// are for eviction when all of them are taken.
+#define RATE_PROBE_LIMIT 8
+
+typedef struct rate_bucket_t {
+  // 0 marks an empty slot. A real key of 0 is bumped to 1.
+  uint64_t key;
+  uint64_t last_ns;
+  double tokens;
+} rate_bucket_t;
+
+struct syslog_rate_limiter_t {
+  rate_bucket_t * buckets;
+  size_t slot_mask;
+
+  double tokens_per_ns;
+  double burst;
+  int keep_severity;
+  uint32_t sample_one_in;
+
+  uint64_t random_state;
+};
+
+syslog_rate_limiter_t * syslog_rate_limiter_new(const syslog_rate_limit_config_t * config) {
+  syslog_rate_limiter_t * limiter = syslog_calloc(1, sizeof(syslog_rate_limiter_t));
+  if (!limiter) {
+    return NULL;
+  }
+
+  size_t slots = RATE_MIN_SLOTS;
+  while (slots < config->max_sources) {
+    slots <<= 1;
+  }
+
+  limiter->buckets = syslog_calloc(slots, sizeof(rate_bucket_t));
+  if (!limiter->buckets) {
+    syslog_free(limiter);
+    return NULL;
+  }
+
+  limiter->slot_mask = slots - 1;
+  limiter->tokens_per_ns = config->rate / 1e9;
+  limiter->burst = config->burst < 1 ? 1 : config->burst;
+  limiter->keep_severity = config->keep_severity;
+  limiter->sample_one_in = config->sample_one_in;
+  limiter->random_state = 0x9e3779b97f4a7c15ULL;
+
+  return limiter;
+}
+
+void syslog_rate_limiter_free(syslog_rate_limiter_t * limiter) {
+  if (!limiter) {
+    return;
+  }
+
+  syslog_free(limiter->buckets);
+  syslog_free(limiter);
+}
+
+uint32_t syslog_rate_limiter_sample_weight(const syslog_rate_limiter_t * limiter) {
+  return limiter->sample_one_in;
+}
+
+// xorshift64*, plenty for picking samples
+static uint64_t next_random(syslog_rate_limiter_t * limiter) {
+  uint64_t x = limiter->random_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  limiter->random_state = x;
+  return x * 0x2545f4914f6cdd1dULL;
+}
+
+static rate_bucket_t * find_bucket(syslog_rate_limiter_t * limiter, uint64_t key, uint64_t now_ns) {
+  rate_bucket_t * oldest = NULL;
+  size_t i;
+
+  for (i = 0; i < RATE_PROBE_LIMIT; i++) {
+    rate_bucket_t * bucket = &limiter->buckets[(key + i) & limiter->slot_mask];
+
+    if (bucket->key == key) {
+      return bucket;
+    }
+
+    if (!bucket->key) {
+      oldest = bucket;
+      break;
+    }
+
+    if (!oldest || bucket->last_ns < oldest->last_ns) {
+      oldest = bucket;
+    }
+  }
+
+  // Either a free slot or the quietest source in reach, which gets forgotten
+  oldest->key = key;
+  oldest->last_ns = now_ns;
+  oldest->tokens = limiter->burst;
+
+  return oldest;
+}
+
+syslog_rate_decision_t syslog_rate_limit(syslog_rate_limiter_t * limiter, const char* hostname, size_t hostname_length, const char* appname, size_t appname_length, int severity, uint64_t now_ns) {
+  if (severity <= limiter->keep_severity) {
+    return SYSLOG_RATE_KEEP;
+  }
+
+  uint64_t key = syslog_hash64(hostname, hostname_length, RATE_HASH_SEED);
+  key = syslog_hash64_combine(key, syslog_hash64(appname, appname_length, RATE_HASH_SEED));
+  if (!key) {
+    key = 1;
+  }
+
+  rate_bucket_t * bucket = find_bucket(limiter, key, now_ns);
+
+  if (now_ns > bucket->last_ns) {
+    bucket->tokens += (now_ns - bucket->last_ns) * limiter->tokens_per_ns;
+    if (bucket->tokens > limiter->burst) {
+      bucket->tokens = limiter->burst;
+    }
+    bucket->last_ns = now_ns;
+  }
+
+  if (bucket->tokens >= 1) {
+    bucket->tokens -= 1;
+    return SYSLOG_RATE_KEEP;
+  }
+
+  if (limiter->sample_one_in && next_random(limiter) % limiter->sample_one_in == 0) {
+    return SYSLOG_RATE_SAMPLED;
+  }
+
+  return SYSLOG_RATE_DROP;
+}
+
+syslog_rate_decision_t syslog_rate_limit_message(syslog_rate_limiter_t * limiter, const syslog_message_t * msg) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  const char* hostname = msg->hostname ? msg->hostname : "";
+  const char* appname = msg->appname ? msg->appname : "";
+
+  return syslog_rate_limit(limiter, hostname, strlen(hostname), appname, strlen(appname), msg->severity, (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
@@ -0,0 +1,66 @@
+#ifndef LIB_SYSLOG_RATELIMIT_H
+#define LIB_SYSLOG_RATELIMIT_H
+
+#include <stdint.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Token bucket rate limiting per source, where a source is a (HOSTNAME,
+// APP-NAME) pair. Each source may send rate messages a second with bursts of
+// up to burst. Once a source runs out it is either dropped or sampled, keeping
+// roughly one in sample_one_in of the messages over the limit.
+//
+// Memory is fixed when the limiter is created. When more sources show up than
+// there is room for, the one that has been quiet the longest loses its bucket
+// and starts again with a full one if it comes back.
+//
+// A limiter is not thread safe. Give each parsing thread its own.
+
+typedef struct syslog_rate_limiter_t syslog_rate_limiter_t;
+
+typedef struct syslog_rate_limit_config_t {
+  // Messages a second each source may send once its burst is used up
+  double rate;
+  // How many messages a source can send at once. Less than 1 means 1.
+  double burst;
+  // How many sources to track at once
+  size_t max_sources;
+  // Messages this severe or more are always kept and never use up tokens.
+  // 0 keeps only emergencies, -1 keeps nothing regardless of rate.
+  int keep_severity;
+  // Keep one in this many messages over the limit, at random. 0 drops them all.
+  uint32_t sample_one_in;
+} syslog_rate_limit_config_t;
+
+typedef enum syslog_rate_decision_t {
+  SYSLOG_RATE_DROP = 0,
+  SYSLOG_RATE_KEEP = 1,
+  // Over the limit but picked by sampling. It stands for about sample_one_in
+  // messages.
+  SYSLOG_RATE_SAMPLED = 2
+} syslog_rate_decision_t;
+
+syslog_rate_limiter_t * syslog_rate_limiter_new(const syslog_rate_limit_config_t * config);
+void syslog_rate_limiter_free(syslog_rate_limiter_t * limiter);
+// How many messages a SYSLOG_RATE_SAMPLED decision stands for, which is the
+// config's sample_one_in
+uint32_t syslog_rate_limiter_sample_weight(const syslog_rate_limiter_t * limiter);
+
+// Decides what to do with a message from a source at now_ns, which has to come
+// from a clock that never goes backwards. The spans from syslog_peek_header
+// can be passed in directly, so this can run before the message is parsed.
+syslog_rate_decision_t syslog_rate_limit(syslog_rate_limiter_t * limiter, const char* hostname, size_t hostname_length, const char* appname, size_t appname_length, int severity, uint64_t now_ns);
+
+// The same for a (possibly partially) parsed message, using CLOCK_MONOTONIC.
+// This is what parse_syslog_message_with_options_t calls after the header.
+syslog_rate_decision_t syslog_rate_limit_message(syslog_rate_limiter_t * limiter, const syslog_message_t * msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
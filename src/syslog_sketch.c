@@ -0,0 +1,391 @@
+#include <math.h>
+
+#include "syslog_sketch.h"
+#include "syslog_internal.h"
+#include "syslog_hash.h"
+
+#define SKETCH_HASH_SEED 0x3c6ef372
+// 4096 registers, about 1.6% standard error
+#define HLL_PRECISION 12
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+enum {
+  TOPK_HOSTNAME,
+  TOPK_APPNAME,
+  TOPK_MESSAGE_ID,
+  TOPK_FIELDS
+};
+
+// One slice of the window. Buckets are copied wholesale by readers, so
+// everything a bucket owns lives inside it.
+typedef struct sketch_bucket_t {
+  // Which slice of time this holds, counting from 1 so 0 means never used
+  uint64_t epoch;
+  uint64_t messages;
+  uint64_t severity_counts[8];
+  size_t topk_used[TOPK_FIELDS];
+  uint8_t hostnames[HLL_REGISTERS];
+  uint8_t sd_values[HLL_REGISTERS];
+  // TOPK_FIELDS runs of k entries
+  syslog_topk_entry_t topk[];
+} sketch_bucket_t;
+
+struct syslog_sketch_t {
+  syslog_sketch_config_t config;
+  uint64_t bucket_ns;
+  size_t bucket_size;
+
+  // A sequence number per bucket. It is odd while the owner is writing to the
+  // bucket, and readers that see it change have to copy the bucket again.
+  unsigned * sequences;
+  char* buckets;
+};
+
+static sketch_bucket_t * get_bucket(const syslog_sketch_t * sketch, size_t i) {
+  return (sketch_bucket_t *) (sketch->buckets + i * sketch->bucket_size);
+}
+
+syslog_sketch_t * syslog_sketch_new(const syslog_sketch_config_t * config) {
+  if (!config->k || !config->buckets || config->window_ns < config->buckets) {
+    return NULL;
+  }
+
+  syslog_sketch_t * sketch = syslog_calloc(1, sizeof(syslog_sketch_t));
+  if (!sketch) {
+    return NULL;
+  }
+
+  sketch->config = *config;
+  sketch->bucket_ns = config->window_ns / config->buckets;
+  sketch->bucket_size = sizeof(sketch_bucket_t) + sizeof(syslog_topk_entry_t) * TOPK_FIELDS * config->k;
+  sketch->sequences = syslog_calloc(config->buckets, sizeof(unsigned));
+  sketch->buckets = syslog_calloc(config->buckets, sketch->bucket_size);
+
+  if (!sketch->sequences || !sketch->buckets) {
+    syslog_sketch_free(sketch);
+    return NULL;
+  }
+
+  return sketch;
+}
+
+void syslog_sketch_free(syslog_sketch_t * sketch) {
+  if (!sketch) {
+    return;
+  }
+
+  syslog_free(sketch->sequences);
+  syslog_free(sketch->buckets);
+  syslog_free(sketch);
+}
+
+static void hll_add(uint8_t * registers, uint64_t hash) {
+  size_t index = hash >> (64 - HLL_PRECISION);
+  // The guard bit keeps the rank in range when the rest of the hash is 0
+  uint64_t rest = (hash << HLL_PRECISION) | ((uint64_t) 1 << (HLL_PRECISION - 1));
+  uint8_t rank = __builtin_clzll(rest) + 1;
+
+  if (rank > registers[index]) {
+    registers[index] = rank;
+  }
+}
+
+static uint64_t hll_estimate(const uint8_t * registers) {
+  double m = HLL_REGISTERS;
+  double sum = 0;
+  int zeros = 0;
+  size_t i;
+
+  for (i = 0; i < HLL_REGISTERS; i++) {
+    sum += ldexp(1.0, -registers[i]);
+    zeros += registers[i] == 0;
+  }
+
+  double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+
+  // Linear counting does better while most registers are still empty
+  if (estimate <= 2.5 * m && zeros) {
+    estimate = m * log(m / zeros);
+  }
+
+  return (uint64_t) (estimate + 0.5);
+}
+
+// Space-Saving: a name that is not tracked takes over the smallest counter and
+// inherits its count as error.
+static void topk_add(syslog_topk_entry_t * entries, size_t * used, size_t k, const char* name) {
+  if (!name || !name[0]) {
+    return;
+  }
+
+  size_t length = strlen(name);
+  uint64_t hash = syslog_hash64(name, length, SKETCH_HASH_SEED);
+  syslog_topk_entry_t * smallest = NULL;
+  size_t i;
+
+  for (i = 0; i < *used; i++) {
+    if (entries[i].hash == hash) {
+      entries[i].count++;
+      return;
+    }
+
+    if (!smallest || entries[i].count < smallest->count) {
+      smallest = &entries[i];
+    }
+  }
+
+  syslog_topk_entry_t * entry;
+  if (*used < k) {
+    entry = &entries[(*used)++];
+    entry->count = 1;
+    entry->error = 0;
+  } else {
+    entry = smallest;
+    entry->error = smallest->count;
+    entry->count = smallest->count + 1;
+  }
+
+  if (length >= SYSLOG_SKETCH_NAME_MAX) {
+    length = SYSLOG_SKETCH_NAME_MAX - 1;
+  }
+
+  memcpy(entry->name, name, length);
+  entry->name[length] = 0;
+  entry->hash = hash;
+}
+
+void syslog_sketch_add(syslog_sketch_t * sketch, const syslog_message_t * msg, uint64_t now_ns) {
+  uint64_t epoch = now_ns / sketch->bucket_ns + 1;
+  size_t index = epoch % sketch->config.buckets;
+  sketch_bucket_t * bucket = get_bucket(sketch, index);
+  unsigned * sequence = &sketch->sequences[index];
+  size_t k = sketch->config.k;
+
+  unsigned start = *sequence;
+  __atomic_store_n(sequence, start + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  if (bucket->epoch != epoch) {
+    memset(bucket, 0, sketch->bucket_size);
+    bucket->epoch = epoch;
+  }
+
+  bucket->messages++;
+  if (msg->severity >= 0 && msg->severity < 8) {
+    bucket->severity_counts[msg->severity]++;
+  }
+
+  topk_add(&bucket->topk[TOPK_HOSTNAME * k], &bucket->topk_used[TOPK_HOSTNAME], k, msg->hostname);
+  topk_add(&bucket->topk[TOPK_APPNAME * k], &bucket->topk_used[TOPK_APPNAME], k, msg->appname);
+  topk_add(&bucket->topk[TOPK_MESSAGE_ID * k], &bucket->topk_used[TOPK_MESSAGE_ID], k, msg->message_id);
+
+  if (msg->hostname && msg->hostname[0]) {
+    hll_add(bucket->hostnames, syslog_hash64(msg->hostname, strlen(msg->hostname), SKETCH_HASH_SEED));
+  }
+
+  size_t i, j;
+  for (i = 0; i < msg->structured_data_count; i++) {
+    const syslog_extended_property_t * element = &msg->structured_data[i];
+    uint64_t element_hash = syslog_hash64(element->id, strlen(element->id), SKETCH_HASH_SEED);
+
+    for (j = 0; j < element->num_pairs; j++) {
+      const syslog_extended_property_value_t * pair = &element->pairs[j];
+      uint64_t h = syslog_hash64_combine(element_hash, syslog_hash64(pair->key, strlen(pair->key), SKETCH_HASH_SEED));
+      h = syslog_hash64_combine(h, syslog_hash64(pair->value, strlen(pair->value), SKETCH_HASH_SEED));
+      hll_add(bucket->sd_values, h);
+    }
+  }
+
+  __atomic_store_n(sequence, start + 2, __ATOMIC_RELEASE);
+}
+
+// Takes a consistent copy of a bucket while its owner may be writing to it
+static void read_bucket(const syslog_sketch_t * sketch, size_t index, sketch_bucket_t * out) {
+  unsigned * sequence = &sketch->sequences[index];
+  unsigned before, after = 0;
+
+  do {
+    before = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      continue;
+    }
+
+    memcpy(out, get_bucket(sketch, index), sketch->bucket_size);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+  } while ((before & 1) || before != after);
+}
+
+static int compare_by_hash(const void* a, const void* b) {
+  uint64_t x = ((const syslog_topk_entry_t *) a)->hash;
+  uint64_t y = ((const syslog_topk_entry_t *) b)->hash;
+  return (x > y) - (x < y);
+}
+
+static int compare_by_count(const void* a, const void* b) {
+  uint64_t x = ((const syslog_topk_entry_t *) a)->count;
+  uint64_t y = ((const syslog_topk_entry_t *) b)->count;
+  return (x < y) - (x > y);
+}
+
+// The smallest count in a full summary. Anything the summary does not list
+// could have been seen up to that many times before it was pushed out, while a
+// summary with room to spare has seen everything it does not list exactly 0
+// times.
+static uint64_t topk_floor(const syslog_topk_entry_t * entries, size_t used, size_t k) {
+  uint64_t floor = 0;
+  size_t i;
+
+  if (used < k) {
+    return 0;
+  }
+
+  for (i = 0; i < used; i++) {
+    if (!i || entries[i].count < floor) {
+      floor = entries[i].count;
+    }
+  }
+
+  return floor;
+}
+
+// Space-Saving summaries merge by adding up counts per name, where a summary
+// that does not list a name adds its floor, and keeping the k largest. On the
+// way in count holds count less the summary's floor and error holds the lower
+// bound count - error, so total_floor, the floors of every summary added up,
+// turns them back into an upper bound and its error. Returns how many entries
+// there are now.
+static size_t merge_topk(syslog_topk_entry_t * entries, size_t count, size_t k, uint64_t total_floor) {
+  if (!count) {
+    return 0;
+  }
+
+  qsort(entries, count, sizeof(syslog_topk_entry_t), compare_by_hash);
+
+  size_t merged = 0;
+  size_t i;
+  for (i = 1; i < count; i++) {
+    if (entries[i].hash == entries[merged].hash) {
+      entries[merged].count += entries[i].count;
+      entries[merged].error += entries[i].error;
+    } else {
+      entries[++merged] = entries[i];
+    }
+  }
+  merged++;
+
+  for (i = 0; i < merged; i++) {
+    entries[i].count += total_floor;
+    entries[i].error = entries[i].count - entries[i].error;
+  }
+
+  qsort(entries, merged, sizeof(syslog_topk_entry_t), compare_by_count);
+
+  return merged < k ? merged : k;
+}
+
+int syslog_sketch_read(syslog_sketch_t * const * sketches, size_t count, uint64_t now_ns, syslog_sketch_summary_t * out) {
+  memset(out, 0, sizeof(syslog_sketch_summary_t));
+
+  if (!count) {
+    return 0;
+  }
+
+  const syslog_sketch_config_t * config = &sketches[0]->config;
+  size_t k = config->k;
+  size_t buckets = config->buckets;
+  size_t i, j, f, r;
+
+  for (i = 1; i < count; i++) {
+    if (sketches[i]->config.k != k || sketches[i]->config.buckets != buckets || sketches[i]->config.window_ns != config->window_ns) {
+      return 0;
+    }
+  }
+
+  // Everything every live bucket has, merged down to k at the end
+  size_t capacity = count * buckets * k;
+  syslog_topk_entry_t * gathered[TOPK_FIELDS];
+  size_t gathered_count[TOPK_FIELDS] = {0};
+  uint64_t total_floor[TOPK_FIELDS] = {0};
+  uint8_t hostnames[HLL_REGISTERS] = {0};
+  uint8_t sd_values[HLL_REGISTERS] = {0};
+
+  sketch_bucket_t * copy = syslog_malloc(sketches[0]->bucket_size);
+  for (f = 0; f < TOPK_FIELDS; f++) {
+    gathered[f] = syslog_malloc(sizeof(syslog_topk_entry_t) * capacity);
+  }
+
+  if (!copy || !gathered[TOPK_HOSTNAME] || !gathered[TOPK_APPNAME] || !gathered[TOPK_MESSAGE_ID]) {
+    syslog_free(copy);
+    for (f = 0; f < TOPK_FIELDS; f++) {
+      syslog_free(gathered[f]);
+    }
+    return 0;
+  }
+
+  uint64_t now_epoch = now_ns / sketches[0]->bucket_ns + 1;
+
+  for (i = 0; i < count; i++) {
+    for (j = 0; j < buckets; j++) {
+      read_bucket(sketches[i], j, copy);
+
+      // Unused, or too old to still be in the window
+      if (!copy->epoch || copy->epoch > now_epoch || now_epoch - copy->epoch >= buckets) {
+        continue;
+      }
+
+      out->messages += copy->messages;
+      for (r = 0; r < 8; r++) {
+        out->severity_counts[r] += copy->severity_counts[r];
+      }
+
+      for (r = 0; r < HLL_REGISTERS; r++) {
+        if (copy->hostnames[r] > hostnames[r]) {
+          hostnames[r] = copy->hostnames[r];
+        }
+        if (copy->sd_values[r] > sd_values[r]) {
+          sd_values[r] = copy->sd_values[r];
+        }
+      }
+
+      for (f = 0; f < TOPK_FIELDS; f++) {
+        const syslog_topk_entry_t * entries = &copy->topk[f * k];
+        uint64_t floor = topk_floor(entries, copy->topk_used[f], k);
+
+        for (r = 0; r < copy->topk_used[f]; r++) {
+          syslog_topk_entry_t * entry = &gathered[f][gathered_count[f]++];
+          *entry = entries[r];
+          entry->count = entries[r].count - floor;
+          entry->error = entries[r].count - entries[r].error;
+        }
+
+        total_floor[f] += floor;
+      }
+    }
+  }
+
+  syslog_free(copy);
+
+  out->distinct_hostnames = hll_estimate(hostnames);
+  out->distinct_sd_values = hll_estimate(sd_values);
+
+  out->hostnames = gathered[TOPK_HOSTNAME];
+  out->hostname_count = merge_topk(gathered[TOPK_HOSTNAME], gathered_count[TOPK_HOSTNAME], k, total_floor[TOPK_HOSTNAME]);
+  out->appnames = gathered[TOPK_APPNAME];
+  out->appname_count = merge_topk(gathered[TOPK_APPNAME], gathered_count[TOPK_APPNAME], k, total_floor[TOPK_APPNAME]);
+  out->message_ids = gathered[TOPK_MESSAGE_ID];
+  out->message_id_count = merge_topk(gathered[TOPK_MESSAGE_ID], gathered_count[TOPK_MESSAGE_ID], k, total_floor[TOPK_MESSAGE_ID]);
+
+  return 1;
+}
+
+void free_syslog_sketch_summary_t(syslog_sketch_summary_t * summary) {
+  syslog_free(summary->hostnames);
+  syslog_free(summary->appnames);
+  syslog_free(summary->message_ids);
+
+  summary->hostnames = NULL;
+  summary->appnames = NULL;
+  summary->message_ids = NULL;
+}
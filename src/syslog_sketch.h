@@ -0,0 +1,79 @@
+#ifndef LIB_SYSLOG_SKETCH_H
+#define LIB_SYSLOG_SKETCH_H
+
+#include <stdint.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Streaming stats over a sliding window of parsed messages: the top K
+// hostnames, app names and MSGIDs (Space-Saving), how many distinct hosts and
+// SD param values there were (HyperLogLog), and message counts per severity.
+//
+// The window is split into buckets that are recycled as time moves on, so it
+// slides in steps of window_ns / buckets.
+//
+// Each parsing thread owns a sketch and is the only one to add to it. Any
+// thread can read a set of sketches at any time, which merges them without
+// taking locks or slowing the writers down. A reader that races a writer just
+// tries that bucket again.
+
+#define SYSLOG_SKETCH_NAME_MAX 64
+
+typedef struct syslog_sketch_t syslog_sketch_t;
+
+typedef struct syslog_sketch_config_t {
+  // How many heavy hitters to track per field. Counts are exact for anything
+  // that stays in the top K for the whole window.
+  size_t k;
+  uint64_t window_ns;
+  size_t buckets;
+} syslog_sketch_config_t;
+
+typedef struct syslog_topk_entry_t {
+  // Truncated to SYSLOG_SKETCH_NAME_MAX - 1 bytes
+  char name[SYSLOG_SKETCH_NAME_MAX];
+  uint64_t hash;
+  // An upper bound on how many times name was seen, across every bucket and
+  // sketch that was read. It is at most error too high.
+  uint64_t count;
+  uint64_t error;
+} syslog_topk_entry_t;
+
+typedef struct syslog_sketch_summary_t {
+  uint64_t messages;
+  uint64_t severity_counts[8];
+
+  uint64_t distinct_hostnames;
+  uint64_t distinct_sd_values;
+
+  // Up to k entries each, most frequent first
+  syslog_topk_entry_t * hostnames;
+  size_t hostname_count;
+  syslog_topk_entry_t * appnames;
+  size_t appname_count;
+  syslog_topk_entry_t * message_ids;
+  size_t message_id_count;
+} syslog_sketch_summary_t;
+
+syslog_sketch_t * syslog_sketch_new(const syslog_sketch_config_t * config);
+void syslog_sketch_free(syslog_sketch_t * sketch);
+
+// Only ever call this from the thread that owns the sketch. now_ns has to come
+// from a clock that never goes backwards.
+void syslog_sketch_add(syslog_sketch_t * sketch, const syslog_message_t * msg, uint64_t now_ns);
+
+// Merges what count sketches saw in the window ending at now_ns. They all need
+// to have been created with the same config. Returns 0 if they were not or if
+// memory ran out, otherwise out needs freeing with free_syslog_sketch_summary_t.
+int syslog_sketch_read(syslog_sketch_t * const * sketches, size_t count, uint64_t now_ns, syslog_sketch_summary_t * out);
+void free_syslog_sketch_summary_t(syslog_sketch_summary_t * summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
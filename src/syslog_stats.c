@@ -0,0 +1,345 @@
+#include <pthread.h>
+#include <time.h>
+
+#include "syslog_stats.h"
+#include "syslog_internal.h"
+
+#define STATS_FIELDS (sizeof(syslog_parse_stats_t) / sizeof(uint64_t))
+
+// Values below 2^SUB_BITS get a bucket each. Above that every power of two is
+// split into 2^SUB_BITS buckets, and values from 2^(MAX_MSB + 1) up are clamped.
+#define LATENCY_SUB_BITS 7
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_MSB 43
+#define LATENCY_MAX_VALUE ((1ULL << (LATENCY_MAX_MSB + 1)) - 1)
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS + (LATENCY_MAX_MSB - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct latency_histogram_t {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+// One per thread that has parsed something. Only the owning thread writes to
+// it, with plain stores that readers are allowed to race.
+typedef struct stats_block_t {
+  syslog_parse_stats_t stats;
+  latency_histogram_t latency[SYSLOG_LATENCY_STAGES];
+  // The thread's counters in syslog_alloc.c, NULL when they are not kept
+  const syslog_alloc_stats_t * alloc;
+  struct stats_block_t * prev;
+  struct stats_block_t * next;
+} stats_block_t;
+
+static __thread stats_block_t * local_block;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+static pthread_key_t registry_key;
+static stats_block_t * blocks;
+// What threads that have exited counted
+static stats_block_t retired;
+static syslog_alloc_stats_t retired_alloc;
+// Where syslog_latency adds the histograms up, only touched under the lock
+static latency_histogram_t merged;
+
+static void add_stats(syslog_parse_stats_t * to, const syslog_parse_stats_t * from) {
+  uint64_t * out = (uint64_t *) to;
+  const uint64_t * in = (const uint64_t *) from;
+  size_t i;
+
+  for (i = 0; i < STATS_FIELDS; i++) {
+    out[i] += __atomic_load_n(&in[i], __ATOMIC_RELAXED);
+  }
+}
+
+static void add_histogram(latency_histogram_t * to, const latency_histogram_t * from) {
+  size_t i;
+
+  to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+  to->sum_ns += __atomic_load_n(&from->sum_ns, __ATOMIC_RELAXED);
+
+  uint64_t max_ns = __atomic_load_n(&from->max_ns, __ATOMIC_RELAXED);
+  if (max_ns > to->max_ns) {
+    to->max_ns = max_ns;
+  }
+
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    to->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+  }
+}
+
+// The owning thread writes these with plain increments, which on everything we
+// run on can't tear, so a racing read is just a little stale
+static void add_alloc_stats(syslog_alloc_stats_t * to, const syslog_alloc_stats_t * from) {
+  to->allocations += __atomic_load_n(&from->allocations, __ATOMIC_RELAXED);
+  to->reallocations += __atomic_load_n(&from->reallocations, __ATOMIC_RELAXED);
+  to->frees += __atomic_load_n(&from->frees, __ATOMIC_RELAXED);
+  to->bytes_allocated += __atomic_load_n(&from->bytes_allocated, __ATOMIC_RELAXED);
+  to->live_bytes += __atomic_load_n(&from->live_bytes, __ATOMIC_RELAXED);
+
+  int64_t peak = __atomic_load_n(&from->peak_live_bytes, __ATOMIC_RELAXED);
+  if (peak > to->peak_live_bytes) {
+    to->peak_live_bytes = peak;
+  }
+}
+
+// Runs as a thread exits so its counts outlive it
+static void retire_block(void* ptr) {
+  stats_block_t * block = ptr;
+
+  pthread_mutex_lock(&registry_lock);
+
+  add_stats(&retired.stats, &block->stats);
+
+  int stage;
+  for (stage = 0; stage < SYSLOG_LATENCY_STAGES; stage++) {
+    add_histogram(&retired.latency[stage], &block->latency[stage]);
+  }
+
+  // Thread locals are still there while key destructors run
+  if (block->alloc) {
+    add_alloc_stats(&retired_alloc, block->alloc);
+  }
+
+  if (block->prev) {
+    block->prev->next = block->next;
+  } else {
+    blocks = block->next;
+  }
+  if (block->next) {
+    block->next->prev = block->prev;
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+
+  free(block);
+}
+
+static void create_key(void) {
+  pthread_key_create(&registry_key, retire_block);
+}
+
+static stats_block_t * register_thread(void) {
+  // Straight from the C library, not the hooks. The block lives as long as the
+  // thread, which can easily be longer than any one set of hooks.
+  stats_block_t * block = calloc(1, sizeof(stats_block_t));
+  if (!block) {
+    return NULL;
+  }
+
+  block->alloc = syslog_alloc_stats_local();
+
+  pthread_once(&registry_once, create_key);
+
+  pthread_mutex_lock(&registry_lock);
+  block->next = blocks;
+  if (blocks) {
+    blocks->prev = block;
+  }
+  blocks = block;
+  pthread_mutex_unlock(&registry_lock);
+
+  pthread_setspecific(registry_key, block);
+  local_block = block;
+
+  return block;
+}
+
+// A plain increment, but written so a concurrent reader is well defined. It
+// compiles to the same load, add and store.
+#define BUMP(field, by) __atomic_store_n(&(field), (field) + (by), __ATOMIC_RELAXED)
+
+void syslog_stats_record(syslog_parse_result_t result, syslog_parse_error_t error, size_t bytes) {
+  stats_block_t * block = local_block;
+  if (!block && !(block = register_thread())) {
+    return;
+  }
+
+  syslog_parse_stats_t * stats = &block->stats;
+
+  BUMP(stats->messages, 1);
+  BUMP(stats->bytes, bytes);
+
+  switch (result) {
+    case SYSLOG_PARSE_OK:
+      BUMP(stats->parsed, 1);
+      break;
+    case SYSLOG_PARSE_FILTERED:
+      BUMP(stats->filtered, 1);
+      break;
+    case SYSLOG_PARSE_DUPLICATE:
+      BUMP(stats->duplicates, 1);
+      break;
+    default:
+      BUMP(stats->failures, 1);
+      if (error >= 0 && error < SYSLOG_ERROR_COUNT) {
+        BUMP(stats->failures_by_error[error], 1);
+      }
+      break;
+  }
+}
+
+void syslog_parse_stats(syslog_parse_stats_t * out) {
+  memset(out, 0, sizeof(syslog_parse_stats_t));
+
+  pthread_mutex_lock(&registry_lock);
+
+  add_stats(out, &retired.stats);
+
+  stats_block_t * block;
+  for (block = blocks; block; block = block->next) {
+    add_stats(out, &block->stats);
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+}
+
+void syslog_parse_stats_thread(syslog_parse_stats_t * out) {
+  memset(out, 0, sizeof(syslog_parse_stats_t));
+
+  if (local_block) {
+    add_stats(out, &local_block->stats);
+  }
+}
+
+void syslog_alloc_stats_total(syslog_alloc_stats_t * out) {
+  memset(out, 0, sizeof(syslog_alloc_stats_t));
+
+  pthread_mutex_lock(&registry_lock);
+
+  add_alloc_stats(out, &retired_alloc);
+
+  stats_block_t * block;
+  for (block = blocks; block; block = block->next) {
+    if (block->alloc) {
+      add_alloc_stats(out, block->alloc);
+    }
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+}
+
+static size_t latency_bucket(uint64_t ns) {
+  if (ns < LATENCY_SUB_BUCKETS) {
+    return ns;
+  }
+  if (ns > LATENCY_MAX_VALUE) {
+    ns = LATENCY_MAX_VALUE;
+  }
+
+  int shift = (63 - __builtin_clzll(ns)) - LATENCY_SUB_BITS;
+  return LATENCY_SUB_BUCKETS + shift * LATENCY_SUB_BUCKETS + ((ns >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// The largest value that lands in bucket
+static uint64_t latency_bucket_top(size_t bucket) {
+  if (bucket < LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  int shift = (bucket - LATENCY_SUB_BUCKETS) / LATENCY_SUB_BUCKETS;
+  uint64_t sub = LATENCY_SUB_BUCKETS + (bucket - LATENCY_SUB_BUCKETS) % LATENCY_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+uint64_t syslog_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void syslog_latency_record(syslog_latency_stage_t stage, uint64_t ns) {
+  if (stage < 0 || stage >= SYSLOG_LATENCY_STAGES) {
+    return;
+  }
+
+  stats_block_t * block = local_block;
+  if (!block && !(block = register_thread())) {
+    return;
+  }
+
+  latency_histogram_t * histogram = &block->latency[stage];
+
+  BUMP(histogram->count, 1);
+  BUMP(histogram->sum_ns, ns);
+  BUMP(histogram->buckets[latency_bucket(ns)], 1);
+  if (ns > histogram->max_ns) {
+    __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+  }
+}
+
+void syslog_latency_emitted(const syslog_message_t * msg) {
+  if (!msg->received_ns) {
+    return;
+  }
+
+  uint64_t now = syslog_now_ns();
+
+  // A message parsed on a core whose clock is a little ahead can look like it
+  // arrived in the future. Call that 0 rather than wrapping around.
+  syslog_latency_record(SYSLOG_LATENCY_SINK, now > msg->parsed_ns ? now - msg->parsed_ns : 0);
+  syslog_latency_record(SYSLOG_LATENCY_TOTAL, now > msg->received_ns ? now - msg->received_ns : 0);
+}
+
+static uint64_t percentile(const latency_histogram_t * histogram, double quantile) {
+  // The rank of the value wanted, counting from 1
+  uint64_t rank = (uint64_t) (quantile * histogram->count + 0.999999);
+  uint64_t seen = 0;
+  size_t i;
+
+  if (!rank) {
+    rank = 1;
+  }
+
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t top = latency_bucket_top(i);
+      return top < histogram->max_ns ? top : histogram->max_ns;
+    }
+  }
+
+  return histogram->max_ns;
+}
+
+void syslog_latency(syslog_latency_stage_t stage, syslog_latency_summary_t * out) {
+  memset(out, 0, sizeof(syslog_latency_summary_t));
+
+  if (stage < 0 || stage >= SYSLOG_LATENCY_STAGES) {
+    return;
+  }
+
+  pthread_mutex_lock(&registry_lock);
+
+  memset(&merged, 0, sizeof(merged));
+  add_histogram(&merged, &retired.latency[stage]);
+
+  stats_block_t * block;
+  for (block = blocks; block; block = block->next) {
+    add_histogram(&merged, &block->latency[stage]);
+  }
+
+  // A racing writer can have bumped the count but not yet the bucket, so go
+  // by what the buckets say
+  uint64_t count = 0;
+  size_t i;
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    count += merged.buckets[i];
+  }
+  merged.count = count;
+
+  if (count) {
+    out->count = count;
+    out->sum_ns = merged.sum_ns;
+    out->mean_ns = merged.sum_ns / count;
+    out->p50_ns = percentile(&merged, 0.5);
+    out->p90_ns = percentile(&merged, 0.9);
+    out->p99_ns = percentile(&merged, 0.99);
+    out->p999_ns = percentile(&merged, 0.999);
+    out->max_ns = merged.max_ns;
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+}
@@ -0,0 +1,81 @@
+#ifndef LIB_SYSLOG_STATS_H
+#define LIB_SYSLOG_STATS_H
+
+#include <stdint.h>
+
+#include "syslog.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// Counters for every parse_syslog_message_t and
+// parse_syslog_message_with_options_t call, kept per thread so the parse
+// itself never touches a shared cache line or does an atomic read-modify-write.
+// Reading them adds up every thread's counters, including threads that have
+// since exited. A read racing parses on other threads may miss their last few
+// increments but never sees a torn value.
+//
+// Every field is a uint64_t.
+typedef struct syslog_parse_stats_t {
+  uint64_t messages;
+  uint64_t bytes;
+
+  uint64_t parsed;
+  uint64_t filtered;
+  uint64_t duplicates;
+
+  uint64_t failures;
+  uint64_t failures_by_error[SYSLOG_ERROR_COUNT];
+} syslog_parse_stats_t;
+
+// Totals across all threads
+void syslog_parse_stats(syslog_parse_stats_t * out);
+// Just the calling thread
+void syslog_parse_stats_thread(syslog_parse_stats_t * out);
+
+// Latency histograms, kept per thread the same way as the counters. Buckets
+// are log-linear like HdrHistogram's, 128 to each power of two, so any value
+// is recorded to within 1%. Values of 2^44 ns (about 4.9 hours) and up all
+// land in the last bucket.
+typedef enum syslog_latency_stage_t {
+  // From received_ns to the end of the parse
+  SYSLOG_LATENCY_PARSE = 0,
+  // From the end of the parse to syslog_latency_emitted
+  SYSLOG_LATENCY_SINK = 1,
+  // From received_ns to syslog_latency_emitted
+  SYSLOG_LATENCY_TOTAL = 2,
+  SYSLOG_LATENCY_STAGES
+} syslog_latency_stage_t;
+
+typedef struct syslog_latency_summary_t {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t mean_ns;
+  // Percentiles are the top of the bucket they fall in, so they never under
+  // report, and are never more than max_ns
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+} syslog_latency_summary_t;
+
+// CLOCK_MONOTONIC in nanoseconds, the clock every latency is measured with
+uint64_t syslog_now_ns(void);
+
+void syslog_latency_record(syslog_latency_stage_t stage, uint64_t ns);
+// Call once a message has been handed on. Records SYSLOG_LATENCY_SINK and
+// SYSLOG_LATENCY_TOTAL for messages that were parsed with received_ns set, and
+// does nothing for the rest.
+void syslog_latency_emitted(const syslog_message_t * msg);
+
+// Merges every thread's histogram for the stage, including threads that have
+// exited
+void syslog_latency(syslog_latency_stage_t stage, syslog_latency_summary_t * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
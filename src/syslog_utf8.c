@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "syslog_utf8.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// What a lead byte says about the sequence it starts: how long it is and the
+// range its second byte has to be in. That range is what rules out overlong
+// forms (E0, F0), surrogates (ED) and anything past U+10FFFF (F4). Every other
+// continuation byte is 80 to BF. Bytes that can't start a sequence have a
+// length of 0.
+typedef struct utf8_lead_t {
+  unsigned char length;
+  unsigned char second_min;
+  unsigned char second_max;
+} utf8_lead_t;
+
+static const utf8_lead_t LEADS[256] = {
+  [0x00 ... 0x7F] = {1, 0, 0},
+  [0xC2 ... 0xDF] = {2, 0x80, 0xBF},
+  [0xE0] = {3, 0xA0, 0xBF},
+  [0xE1 ... 0xEC] = {3, 0x80, 0xBF},
+  [0xED] = {3, 0x80, 0x9F},
+  [0xEE ... 0xEF] = {3, 0x80, 0xBF},
+  [0xF0] = {4, 0x90, 0xBF},
+  [0xF1 ... 0xF3] = {4, 0x80, 0xBF},
+  [0xF4] = {4, 0x80, 0x8F},
+};
+
+// Offset of the first byte from i on with the high bit set, or length. Log
+// messages are mostly ASCII, so this is where nearly all the time goes.
+static size_t skip_ascii(const unsigned char* s, size_t i, size_t length) {
+#if defined(__SSE2__)
+  for (; i + 16 <= length; i += 16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (s + i)));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  for (; i < length; i++) {
+    if (s[i] & 0x80) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+int syslog_utf8_validate(const char* str, size_t length) {
+  const unsigned char* s = (const unsigned char*) str;
+  size_t i = 0;
+
+  while ((i = skip_ascii(s, i, length)) < length) {
+    const utf8_lead_t * lead = &LEADS[s[i]];
+
+    if (lead->length < 2 || lead->length > length - i) {
+      return 0;
+    }
+
+    if (s[i + 1] < lead->second_min || s[i + 1] > lead->second_max) {
+      return 0;
+    }
+
+    size_t j;
+    for (j = 2; j < lead->length; j++) {
+      if ((s[i + j] & 0xC0) != 0x80) {
+        return 0;
+      }
+    }
+
+    i += lead->length;
+  }
+
+  return 1;
+}
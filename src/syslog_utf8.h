@@ -0,0 +1,23 @@
+#ifndef LIB_SYSLOG_UTF8_H
+#define LIB_SYSLOG_UTF8_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// The byte order mark RFC5424 puts at the start of a MSG that is UTF-8
+#define SYSLOG_UTF8_BOM "\xEF\xBB\xBF"
+#define SYSLOG_UTF8_BOM_LENGTH 3
+
+// 1 if the bytes are well formed UTF-8 as RFC3629 has it, so no overlong
+// forms, surrogates or code points past U+10FFFF. Runs of ASCII are checked 16
+// bytes at a time.
+int syslog_utf8_validate(const char* s, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
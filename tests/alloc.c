@@ -0,0 +1,40 @@
+#include "test.h"
+#include "syslog_alloc.h"
+
+void test_alloc__goes_through_the_hooks(void) {
+  counting_t counting = {};
+  syslog_allocator_t allocator = counting_allocator(&counting);
+  syslog_message_t msg = {};
+
+  syslog_set_allocator(&allocator);
+
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [a@1 x=\"1\" y=\"2\" z=\"3\" w=\"4\" v=\"5\"][b@1] m", &msg));
+  cl_assert(syslog_sd_find(&msg, "a@1", "v", 1));
+  free_syslog_message_t(&msg);
+
+  syslog_set_allocator(NULL);
+
+  cl_assert(counting.mallocs > 0);
+  cl_assert(counting.reallocs > 0);
+  cl_assert_equal_i(counting.mallocs, counting.frees);
+}
+
+void test_alloc__counts_a_parse(void) {
+  syslog_alloc_stats_t stats;
+  syslog_message_t msg = {};
+
+  syslog_alloc_stats_reset();
+  cl_assert(parse_syslog_message_t("<165>1 - h a - - [a@1 x=\"1\"] m", &msg));
+  free_syslog_message_t(&msg);
+  syslog_alloc_stats(&stats);
+
+#ifdef SYSLOG_ALLOC_STATS
+  cl_assert(stats.allocations > 0);
+  cl_assert(stats.allocations == stats.frees);
+  cl_assert(stats.bytes_allocated > 0);
+  cl_assert_equal_i((int) stats.live_bytes, 0);
+  cl_assert(stats.peak_live_bytes > 0);
+#else
+  cl_assert_equal_i((int) stats.allocations, 0);
+#endif
+}
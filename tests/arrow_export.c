@@ -0,0 +1,130 @@
+#include "test.h"
+#include "syslog_arrow.h"
+
+static const char* utf8_value(struct ArrowArray* array, int64_t i, int32_t* length) {
+  const int32_t* offsets = (const int32_t*) array->buffers[1];
+  *length = offsets[i + 1] - offsets[i];
+  return (const char*) array->buffers[2] + offsets[i];
+}
+
+static int is_valid(struct ArrowArray* array, int64_t i) {
+  const uint8_t* validity = (const uint8_t*) array->buffers[0];
+  return !validity || (validity[i / 8] >> (i % 8)) & 1;
+}
+
+void test_arrow_export__exports_schema(void) {
+  struct ArrowSchema schema;
+
+  cl_assert(syslog_export_arrow(NULL, 0, &schema, NULL));
+
+  cl_assert_equal_s(schema.format, "+s");
+  cl_assert_equal_i((int) schema.n_children, 11);
+  cl_assert_equal_s(schema.children[0]->name, "pri_value");
+  cl_assert_equal_s(schema.children[0]->format, "i");
+  cl_assert_equal_s(schema.children[3]->format, "tss:UTC");
+  cl_assert_equal_s(schema.children[5]->name, "hostname");
+  cl_assert_equal_s(schema.children[5]->format, "u");
+
+  struct ArrowSchema* sd = schema.children[10];
+  cl_assert_equal_s(sd->format, "+l");
+  cl_assert_equal_s(sd->children[0]->format, "+s");
+  cl_assert_equal_s(sd->children[0]->children[1]->format, "+m");
+  cl_assert_equal_s(sd->children[0]->children[1]->children[0]->children[0]->name, "key");
+
+  schema.release(&schema);
+  cl_assert(schema.release == NULL);
+}
+
+void test_arrow_export__exports_batch(void) {
+  syslog_message_t msgs[2] = {};
+
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"][exampleSDID_2@32473 foo=\"bar\"] Logging message...", &msgs[0]));
+  cl_assert(parse_syslog_message_t("<13>1 2016-12-16T12:00:01.000Z - sshd - - - Another one", &msgs[1]));
+
+  struct ArrowSchema schema;
+  struct ArrowArray array;
+
+  cl_assert(syslog_export_arrow(msgs, 2, &schema, &array));
+
+  cl_assert_equal_i((int) array.length, 2);
+  cl_assert_equal_i((int) array.n_children, 11);
+
+  const int32_t* pri = (const int32_t*) array.children[0]->buffers[1];
+  cl_assert_equal_i(pri[0], 165);
+  cl_assert_equal_i(pri[1], 13);
+
+  const int32_t* severity = (const int32_t*) array.children[1]->buffers[1];
+  cl_assert_equal_i(severity[1], 5);
+
+  const int64_t* timestamp = (const int64_t*) array.children[3]->buffers[1];
+  cl_assert_equal_i((int) (timestamp[1] - timestamp[0]), 1);
+  cl_assert(timestamp[0] == 1481889600);
+
+  int32_t length;
+  struct ArrowArray* hostname = array.children[5];
+  cl_assert_equal_i((int) hostname->null_count, 1);
+  cl_assert(is_valid(hostname, 0));
+  cl_assert(!is_valid(hostname, 1));
+  const char* value = utf8_value(hostname, 0, &length);
+  cl_assert_equal_i(length, 8);
+  cl_assert(memcmp(value, "hostname", 8) == 0);
+
+  struct ArrowArray* appname = array.children[6];
+  cl_assert_equal_i((int) appname->null_count, 0);
+  cl_assert(appname->buffers[0] == NULL);
+  value = utf8_value(appname, 1, &length);
+  cl_assert_equal_i(length, 4);
+  cl_assert(memcmp(value, "sshd", 4) == 0);
+
+  // Structured data
+  struct ArrowArray* sd = array.children[10];
+  const int32_t* list_offsets = (const int32_t*) sd->buffers[1];
+  cl_assert_equal_i(list_offsets[0], 0);
+  cl_assert_equal_i(list_offsets[1], 2);
+  cl_assert_equal_i(list_offsets[2], 2);
+
+  struct ArrowArray* ids = sd->children[0]->children[0];
+  value = utf8_value(ids, 1, &length);
+  cl_assert(length == 19 && memcmp(value, "exampleSDID_2@32473", 19) == 0);
+
+  struct ArrowArray* params = sd->children[0]->children[1];
+  const int32_t* map_offsets = (const int32_t*) params->buffers[1];
+  cl_assert_equal_i(map_offsets[1], 2);
+  cl_assert_equal_i(map_offsets[2], 3);
+
+  struct ArrowArray* values = params->children[0]->children[1];
+  value = utf8_value(values, 1, &length);
+  cl_assert(length == 4 && memcmp(value, "1011", 4) == 0);
+
+  array.release(&array);
+  schema.release(&schema);
+
+  free_syslog_message_t(&msgs[0]);
+  free_syslog_message_t(&msgs[1]);
+}
+
+void test_arrow_export__exports_timestamps_in_utc(void) {
+  syslog_message_t msgs[3] = {};
+  struct ArrowArray array;
+
+  cl_assert(parse_syslog_message_t("<13>1 2016-12-16T12:00:00Z h - - - - m", &msgs[0]));
+  cl_assert(parse_syslog_message_t("<13>1 2016-12-16T12:00:00.5-07:00 h - - - - m", &msgs[1]));
+  cl_assert(parse_syslog_message_t("<13>1 - h - - - - m", &msgs[2]));
+
+  cl_assert(syslog_export_arrow(msgs, 3, NULL, &array));
+
+  struct ArrowArray* column = array.children[3];
+  const int64_t* timestamp = (const int64_t*) column->buffers[1];
+  cl_assert(timestamp[0] == 1481889600);
+  cl_assert(timestamp[1] == 1481889600 + 7 * 3600);
+  cl_assert_equal_i((int) column->null_count, 1);
+  cl_assert(is_valid(column, 1));
+  cl_assert(!is_valid(column, 2));
+
+  array.release(&array);
+
+  int i;
+  for (i = 0; i < 3; i++) {
+    free_syslog_message_t(&msgs[i]);
+  }
+}
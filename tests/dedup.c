@@ -0,0 +1,111 @@
+#include "test.h"
+#include "syslog_dedup.h"
+#include "syslog_alloc.h"
+#include "syslog_filter.h"
+
+#define SECOND 1000000000ULL
+
+typedef struct repeated_t {
+  int calls;
+  uint64_t fingerprint;
+  uint64_t repeats;
+} repeated_t;
+
+static void on_repeated(void* user, uint64_t fingerprint, uint64_t repeats, uint64_t first_ns, uint64_t last_ns) {
+  repeated_t * repeated = user;
+  repeated->calls++;
+  repeated->fingerprint = fingerprint;
+  repeated->repeats = repeats;
+}
+
+void test_dedup__collapses_repeats_inside_the_window(void) {
+  repeated_t repeated = {};
+  syslog_dedup_t * dedup = syslog_dedup_new(10 * SECOND, 64, on_repeated, &repeated);
+
+  cl_assert(syslog_dedup_check(dedup, 42, 0));
+  cl_assert(!syslog_dedup_check(dedup, 42, SECOND));
+  cl_assert(!syslog_dedup_check(dedup, 42, 2 * SECOND));
+  cl_assert(syslog_dedup_check(dedup, 43, 2 * SECOND));
+
+  syslog_dedup_expire(dedup, 5 * SECOND);
+  cl_assert_equal_i(repeated.calls, 0);
+
+  // Once the window is over the next one is kept and the repeats reported
+  cl_assert(syslog_dedup_check(dedup, 42, 11 * SECOND));
+  cl_assert_equal_i(repeated.calls, 1);
+  cl_assert(repeated.fingerprint == 42);
+  cl_assert_equal_i((int) repeated.repeats, 2);
+
+  // 43 never repeated, so there is nothing to say about it
+  syslog_dedup_expire(dedup, 30 * SECOND);
+  cl_assert_equal_i(repeated.calls, 1);
+
+  syslog_dedup_free(dedup);
+}
+
+void test_dedup__drops_repeats_during_parse(void) {
+  repeated_t repeated = {};
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.dedup = syslog_dedup_new(60 * SECOND, 64, on_repeated, &repeated);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - web nginx 1 - - worker crashed", &msg, &options), SYSLOG_PARSE_OK);
+  uint64_t fingerprint = msg.fingerprint;
+  cl_assert(fingerprint == syslog_message_fingerprint(&msg));
+  free_syslog_message_t(&msg);
+
+  // PROCID and the timestamp are not part of the fingerprint
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 2016-12-16T12:00:00Z web nginx 2 - - worker crashed", &msg, &options), SYSLOG_PARSE_DUPLICATE);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - web nginx 3 - - worker crashed", &msg, &options), SYSLOG_PARSE_DUPLICATE);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - db nginx 1 - - worker crashed", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert(msg.fingerprint != fingerprint);
+  free_syslog_message_t(&msg);
+
+  syslog_dedup_free(options.dedup);
+  cl_assert_equal_i(repeated.calls, 1);
+  cl_assert(repeated.fingerprint == fingerprint);
+  cl_assert_equal_i((int) repeated.repeats, 2);
+}
+
+void test_dedup__drops_repeats_before_decoding_structured_data(void) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+  counting_t counting = {};
+  syslog_allocator_t allocator = counting_allocator(&counting);
+  const char* raw = "<11>1 - web nginx 1 - [origin ip=\"10.0.0.1\"][meta sequenceId=\"1\"] worker crashed";
+
+  options.dedup = syslog_dedup_new(60 * SECOND, 64, NULL, NULL);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t(raw, &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_i((int) msg.structured_data_count, 2);
+  free_syslog_message_t(&msg);
+
+  syslog_set_allocator(&allocator);
+  cl_assert_equal_i(parse_syslog_message_with_options_t(raw, &msg, &options), SYSLOG_PARSE_DUPLICATE);
+  syslog_set_allocator(NULL);
+
+  // Only the buffer the header was copied into
+  cl_assert_equal_i(counting.mallocs + counting.reallocs, 1);
+
+  syslog_dedup_free(options.dedup);
+}
+
+void test_dedup__waits_for_the_filter(void) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.dedup = syslog_dedup_new(60 * SECOND, 64, NULL, NULL);
+  options.filter = syslog_filter_compile("sd[origin].ip == \"10.0.0.1\"", NULL, 0);
+  cl_assert(options.filter);
+
+  // Filtered out on SD, so it must not count as seen
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - web nginx 1 - [origin ip=\"10.0.0.2\"] worker crashed", &msg, &options), SYSLOG_PARSE_FILTERED);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - web nginx 1 - [origin ip=\"10.0.0.1\"] worker crashed", &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - web nginx 1 - [origin ip=\"10.0.0.1\"] worker crashed", &msg, &options), SYSLOG_PARSE_DUPLICATE);
+
+  syslog_filter_free((syslog_filter_t *) options.filter);
+  syslog_dedup_free(options.dedup);
+}
@@ -0,0 +1,137 @@
+#include "test.h"
+#include "syslog_filter.h"
+#include "syslog_alloc.h"
+
+static int matches(const char* expression, const char* mm) {
+  syslog_message_t msg = {};
+  char error[128];
+
+  syslog_filter_t * filter = syslog_filter_compile(expression, error, sizeof(error));
+  cl_assert_(filter, error);
+  cl_assert_(parse_syslog_message_t(mm, &msg), mm);
+
+  int result = syslog_filter_matches(filter, &msg);
+
+  free_syslog_message_t(&msg);
+  syslog_filter_free(filter);
+
+  return result;
+}
+
+void test_filter__rejects_bad_expressions(void) {
+  char error[128];
+
+  cl_assert(!syslog_filter_compile("severity <=", error, sizeof(error)));
+  cl_assert(strlen(error) > 0);
+  cl_assert(!syslog_filter_compile("colour == \"red\"", error, sizeof(error)));
+  cl_assert(!syslog_filter_compile("severity <= loud", error, sizeof(error)));
+  cl_assert(!syslog_filter_compile("(appname == \"a\"", NULL, 0));
+  cl_assert(!syslog_filter_compile("hostname < \"a\"", NULL, 0));
+}
+
+void test_filter__limits_nesting(void) {
+  static char expression[200000];
+  char error[128];
+  size_t i;
+
+  // Deep enough to run the compiler out of stack if it just kept recursing
+  for (i = 0; i < 100000; i++) {
+    expression[i] = '(';
+  }
+  strcpy(expression + i, "severity == 1");
+  cl_assert(!syslog_filter_compile(expression, error, sizeof(error)));
+  cl_assert(strstr(error, "nested too deeply"));
+
+  memset(expression, '!', 100000);
+  cl_assert(!syslog_filter_compile(expression, error, sizeof(error)));
+  cl_assert(strstr(error, "nested too deeply"));
+
+  syslog_filter_t * filter = syslog_filter_compile("!(!(severity == 1 || (appname == \"a\" && !(pri > 3))))", NULL, 0);
+  cl_assert(filter);
+  syslog_filter_free(filter);
+}
+
+void test_filter__matches_fields(void) {
+  const char* mm = "<165>1 2016-12-16T12:00:00.000Z hostname sshd 42 MSGID [origin ip=\"10.1.2.3\"] Accepted publickey";
+
+  cl_assert_equal_i(matches("severity <= notice && appname == \"sshd\"", mm), SYSLOG_FILTER_MATCH);
+  cl_assert_equal_i(matches("severity <= warning", mm), SYSLOG_FILTER_NO_MATCH);
+  cl_assert_equal_i(matches("facility == 20 && pri == 165", mm), SYSLOG_FILTER_MATCH);
+  cl_assert_equal_i(matches("sd[origin].ip startswith \"10.\"", mm), SYSLOG_FILTER_MATCH);
+  cl_assert_equal_i(matches("sd[origin].port == \"514\"", mm), SYSLOG_FILTER_NO_MATCH);
+  cl_assert_equal_i(matches("sd[origin].port != \"514\"", mm), SYSLOG_FILTER_MATCH);
+  cl_assert_equal_i(matches("message contains \"publickey\" || hostname endswith \"x\"", mm), SYSLOG_FILTER_MATCH);
+  cl_assert_equal_i(matches("!(msgid == \"MSGID\")", mm), SYSLOG_FILTER_NO_MATCH);
+}
+
+void test_filter__knows_which_stages_it_needs(void) {
+  syslog_filter_t * filter = syslog_filter_compile("severity <= err || message contains \"x\"", NULL, 0);
+  cl_assert(filter);
+  cl_assert_equal_i(syslog_filter_stages(filter), (1 << SYSLOG_FILTER_STAGE_PRI) | (1 << SYSLOG_FILTER_STAGE_MESSAGE));
+  syslog_filter_free(filter);
+}
+
+void test_filter__stops_parsing_once_rejected(void) {
+  syslog_message_t msg = {};
+  syslog_parse_options_t options = {};
+
+  syslog_filter_t * filter = syslog_filter_compile("severity <= err && sd[origin].ip startswith \"10.\"", NULL, 0);
+  cl_assert(filter);
+  options.filter = filter;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<14>1 - h a - - [origin ip=\"10.0.0.1\"] m", &msg, &options), SYSLOG_PARSE_FILTERED);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - h a - - [origin ip=\"192.168.0.1\"] m", &msg, &options), SYSLOG_PARSE_FILTERED);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 - h a - - [origin ip=\"10.0.0.1\"] m", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_s(msg.message, "m");
+  free_syslog_message_t(&msg);
+
+  syslog_filter_free(filter);
+}
+
+void test_filter__rejects_on_pri_without_allocating(void) {
+  syslog_message_t msg = {};
+  syslog_parse_options_t options = {};
+  counting_t counting = {};
+  syslog_allocator_t allocator = counting_allocator(&counting);
+
+  syslog_filter_t * filter = syslog_filter_compile("severity <= err", NULL, 0);
+  cl_assert(filter);
+  options.filter = filter;
+
+  syslog_set_allocator(&allocator);
+  // Nothing past PRI is looked at, so garbage after it doesn't matter
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<15>garbage", &msg, &options), SYSLOG_PARSE_FILTERED);
+  syslog_set_allocator(NULL);
+
+  cl_assert_equal_i(counting.mallocs + counting.reallocs, 0);
+
+  syslog_filter_free(filter);
+}
+
+void test_filter__drops_by_pri_before_parsing(void) {
+  syslog_message_t msg = {};
+  syslog_pri_mask_t mask = {};
+  syslog_parse_options_t options = {};
+
+  syslog_pri_mask_accept_severity(&mask, 4);
+  syslog_pri_mask_accept(&mask, 191);
+  options.pri_mask = &mask;
+
+  cl_assert(syslog_pri_mask_accepts(&mask, 188));
+  cl_assert(!syslog_pri_mask_accepts(&mask, 190));
+
+  // Dropped before the rest of the message is even looked at
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<15>garbage", &msg, &options), SYSLOG_PARSE_FILTERED);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<192>1 - h - - - - m", &msg, &options), SYSLOG_PARSE_FAILED);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<191>1 - h - - - - m", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_i(msg.facility, 23);
+  cl_assert_equal_i(msg.severity, 7);
+  free_syslog_message_t(&msg);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<12>1 - h - - - - m", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_i(msg.facility, 1);
+  cl_assert_equal_i(msg.severity, 4);
+  free_syslog_message_t(&msg);
+}
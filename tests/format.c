@@ -0,0 +1,184 @@
+#include "test.h"
+#include "syslog_format.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+static void assert_round_trip(const char* mm) {
+  syslog_message_t msg = {};
+  char out[1024];
+
+  cl_assert_(parse_syslog_message_t(mm, &msg), mm);
+
+  size_t size = syslog_format_message_size(&msg);
+  cl_assert_equal_i((int) size, (int) strlen(mm));
+  cl_assert_equal_i((int) syslog_format_message(&msg, out, sizeof(out)), (int) size);
+  cl_assert_equal_s(out, mm);
+
+  free_syslog_message_t(&msg);
+}
+
+void test_format__round_trips_rfc5424(void) {
+  assert_round_trip("<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID - Logging message...");
+  assert_round_trip("<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"][exampleSDID_2@32473 foo=\"bar\"] Logging message...");
+  assert_round_trip("<0>1 2003-10-11T22:14:15.003+07:00 - - - - - msg");
+  assert_round_trip("<13>1 - h a 12345 - [id@1] done");
+  assert_round_trip("<165>1 2016-12-16T12:00:00Z h a - - - \xEF\xBB\xBFhello");
+}
+
+void test_format__escapes_param_values(void) {
+  assert_round_trip("<165>1 - h - - - [id@1 v=\"___\\\"___\"] m");
+  assert_round_trip("<165>1 - h - - - [id@1 v=\"a long value that crosses \\] a sixteen byte boundary \\\\ twice\"] m");
+}
+
+void test_format__writes_nil_for_empty_fields(void) {
+  syslog_message_t msg = {};
+  char out[128];
+
+  msg.pri_value = 14;
+  msg.hostname = "host";
+  msg.message = "hi";
+  msg.timestamp.tm_year = 116;
+  msg.timestamp.tm_mon = 11;
+  msg.timestamp.tm_mday = 6;
+  msg.timestamp.tm_hour = 1;
+  msg.timestamp.tm_min = 2;
+  msg.timestamp.tm_sec = 3;
+
+  cl_assert(syslog_format_message(&msg, out, sizeof(out)));
+  cl_assert_equal_s(out, "<14>1 2016-12-06T01:02:03Z host - - - - hi");
+}
+
+void test_format__fails_when_the_buffer_is_too_small(void) {
+  syslog_message_t msg = {};
+  char out[128];
+
+  cl_assert(parse_syslog_message_t("<165>1 - h - - - [id@1 v=\"\\\"\"] m", &msg));
+
+  size_t size = syslog_format_message_size(&msg);
+  cl_assert_equal_i(syslog_format_message(&msg, out, size), 0);
+  cl_assert_equal_i(syslog_format_message(&msg, out, size + 1), (int) size);
+
+  free_syslog_message_t(&msg);
+}
+
+void test_format__writes_json(void) {
+  syslog_message_t msg = {};
+  char out[1024];
+
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00.000Z hostname - PROCID MSGID [exampleSDID@32473 eventSource=\"App \\\"lication\\\"\" eventID=\"1011\"][id2] Logging\tmessage \\ with \"quotes\" and a \x01 control", &msg));
+
+  size_t size = syslog_format_json_size(&msg);
+  cl_assert_equal_i((int) syslog_format_json(&msg, out, sizeof(out)), (int) size);
+  cl_assert_equal_s(out,
+    "{\"pri\":165,\"facility\":20,\"severity\":5,\"version\":\"1\","
+    "\"timestamp\":\"2016-12-16T12:00:00.000Z\",\"hostname\":\"hostname\",\"appname\":null,"
+    "\"procid\":\"PROCID\",\"msgid\":\"MSGID\","
+    "\"structured_data\":{\"exampleSDID@32473\":{\"eventSource\":\"App \\\"lication\\\"\",\"eventID\":\"1011\"},\"id2\":{}},"
+    "\"message\":\"Logging\\tmessage \\\\ with \\\"quotes\\\" and a \\u0001 control\"}");
+
+  free_syslog_message_t(&msg);
+}
+
+void test_format__writes_nil_timestamps_as_null_in_json(void) {
+  syslog_message_t msg = {};
+  char out[256];
+
+  cl_assert(parse_syslog_message_t("<13>1 - h a - - - m", &msg));
+
+  cl_assert(syslog_format_json(&msg, out, sizeof(out)) < sizeof(out));
+  cl_assert(strstr(out, "\"timestamp\":null,") != NULL);
+
+  free_syslog_message_t(&msg);
+}
+
+void test_format__writes_ndjson(void) {
+  syslog_message_t msgs[2] = {};
+  char out[1024];
+
+  cl_assert(parse_syslog_message_t("<13>1 2016-12-16T12:00:00Z a - - - - one", &msgs[0]));
+  cl_assert(parse_syslog_message_t("<14>1 2016-12-16T12:00:01Z b - - - -", &msgs[1]));
+
+  size_t size = syslog_format_ndjson_size(msgs, 2);
+  cl_assert_equal_i((int) syslog_format_ndjson(msgs, 2, out, sizeof(out)), (int) size);
+  cl_assert_equal_s(out,
+    "{\"pri\":13,\"facility\":1,\"severity\":5,\"version\":\"1\",\"timestamp\":\"2016-12-16T12:00:00Z\",\"hostname\":\"a\",\"appname\":null,\"procid\":null,\"msgid\":null,\"structured_data\":{},\"message\":\"one\"}\n"
+    "{\"pri\":14,\"facility\":1,\"severity\":6,\"version\":\"1\",\"timestamp\":\"2016-12-16T12:00:01Z\",\"hostname\":\"b\",\"appname\":null,\"procid\":null,\"msgid\":null,\"structured_data\":{},\"message\":null}\n");
+
+  cl_assert_equal_i(syslog_format_ndjson(msgs, 2, out, size), 0);
+
+  free_syslog_message_t(&msgs[0]);
+  free_syslog_message_t(&msgs[1]);
+}
+
+void test_format__writes_rfc3164(void) {
+  syslog_message_t msg = {};
+  char out[256];
+
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-06T12:00:00.000Z hostname appname 42 MSGID [id@1 a=\"b\"] Logging message...", &msg));
+  cl_assert_equal_i((int) syslog_format_rfc3164(&msg, out, sizeof(out)), (int) syslog_format_rfc3164_size(&msg));
+  cl_assert_equal_s(out, "<165>Dec  6 12:00:00 hostname appname[42]: Logging message...");
+  free_syslog_message_t(&msg);
+
+  cl_assert(parse_syslog_message_t("<13>1 2016-12-16T01:02:03Z - - - - - hi", &msg));
+  cl_assert(syslog_format_rfc3164(&msg, out, sizeof(out)));
+  cl_assert_equal_s(out, "<13>Dec 16 01:02:03 - hi");
+  free_syslog_message_t(&msg);
+}
+
+void test_format__writes_gelf(void) {
+  syslog_message_t msg = {};
+  char out[512];
+
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00.125Z hostname appname - MSGID [exampleSDID@32473 eventID=\"1011\"][origin ip=\"10.0.0.1\"] Logging message...", &msg));
+  cl_assert_equal_i((int) syslog_format_gelf(&msg, out, sizeof(out)), (int) syslog_format_gelf_size(&msg));
+  cl_assert_equal_s(out,
+    "{\"version\":\"1.1\",\"host\":\"hostname\",\"short_message\":\"Logging message...\","
+    "\"timestamp\":1481889600.125,\"level\":5,\"_facility\":20,\"_appname\":\"appname\",\"_msgid\":\"MSGID\","
+    "\"_exampleSDID_32473_eventID\":\"1011\",\"_origin_ip\":\"10.0.0.1\"}");
+
+  free_syslog_message_t(&msg);
+
+  // Noon seven hours behind UTC is 19:00 UTC
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00-07:00 h - - - - m", &msg));
+  syslog_format_gelf(&msg, out, sizeof(out));
+  cl_assert(strstr(out, ",\"timestamp\":1481914800,"));
+  free_syslog_message_t(&msg);
+
+  // NIL leaves the time to the server
+  cl_assert(parse_syslog_message_t("<165>1 - h - - - - m", &msg));
+  cl_assert_equal_i((int) syslog_format_gelf(&msg, out, sizeof(out)), (int) syslog_format_gelf_size(&msg));
+  cl_assert(!strstr(out, "timestamp"));
+  free_syslog_message_t(&msg);
+}
+
+void test_format__writes_batches(void) {
+  syslog_message_t msgs[3] = {};
+  char scratch[128];
+  char read_back[512];
+  int fds[2];
+
+  cl_assert(parse_syslog_message_t("<13>1 - a - - - - one", &msgs[0]));
+  cl_assert(parse_syslog_message_t("<13>1 - b - - - - two", &msgs[1]));
+  cl_assert(parse_syslog_message_t("<13>1 - c - - - - three", &msgs[2]));
+
+  cl_must_pass(pipe(fds));
+
+  // Small enough that the batch has to be flushed part way through
+  ssize_t written = syslog_write_batch(fds[1], msgs, 3, SYSLOG_OUTPUT_RFC5424, scratch, 48);
+  cl_assert_equal_i((int) written, 68);
+
+  ssize_t n = read(fds[0], read_back, sizeof(read_back) - 1);
+  read_back[n] = 0;
+  cl_assert_equal_s(read_back, "<13>1 - a - - - - one\n<13>1 - b - - - - two\n<13>1 - c - - - - three\n");
+
+  cl_assert_equal_i((int) syslog_write_batch(fds[1], msgs, 1, SYSLOG_OUTPUT_RFC5424, scratch, 8), -1);
+  cl_assert_equal_i(errno, EMSGSIZE);
+
+  close(fds[0]);
+  close(fds[1]);
+
+  free_syslog_message_t(&msgs[0]);
+  free_syslog_message_t(&msgs[1]);
+  free_syslog_message_t(&msgs[2]);
+}
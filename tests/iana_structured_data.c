@@ -0,0 +1,68 @@
+#include "test.h"
+
+void test_iana_structured_data__decodes_registered_ids(void) {
+  syslog_message_t msg = {};
+
+  char * mm = "<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID "
+    "[timeQuality tzKnown=\"1\" isSynced=\"1\" syncAccuracy=\"60000000\"]"
+    "[origin ip=\"192.0.2.1\" ip=\"2001:db8::1\" enterpriseId=\"32473.1\" software=\"rsyslogd\" swVersion=\"8.2\"]"
+    "[meta sequenceId=\"42\" sysUpTime=\"123456\" language=\"en-US\"] Logging message...";
+
+  if (!parse_syslog_message_t(mm, &msg)) {
+    cl_fail("Could not parse the syslog message");
+  }
+
+  cl_assert_equal_i((int) msg.structured_data_count, 3);
+  cl_assert_equal_s(msg.structured_data[2].id, "meta");
+
+  syslog_time_quality_t * tq = &msg.iana.time_quality;
+  cl_assert(tq->present);
+  cl_assert_equal_i(tq->tz_known, 1);
+  cl_assert_equal_i(tq->is_synced, 1);
+  cl_assert(tq->sync_accuracy == 60000000);
+
+  syslog_origin_t * origin = &msg.iana.origin;
+  cl_assert(origin->present);
+  cl_assert_equal_i((int) origin->ip_count, 2);
+  cl_assert_equal_i(origin->ips[0].version, 4);
+  cl_assert_equal_i(origin->ips[0].address[0], 192);
+  cl_assert_equal_i(origin->ips[0].address[3], 1);
+  cl_assert_equal_i(origin->ips[1].version, 6);
+  cl_assert_equal_i(origin->ips[1].address[3], 0xb8);
+  cl_assert_equal_s(origin->enterprise_id, "32473.1");
+  cl_assert_equal_s(origin->software, "rsyslogd");
+  cl_assert_equal_s(origin->sw_version, "8.2");
+
+  syslog_meta_t * meta = &msg.iana.meta;
+  cl_assert(meta->present);
+  cl_assert(meta->sequence_id == 42);
+  cl_assert(meta->sys_up_time == 123456);
+  cl_assert_equal_s(meta->language, "en-US");
+
+  // The generic pairs are still available
+  cl_assert_equal_s(msg.structured_data[1].pairs[0].value, "192.0.2.1");
+
+  free_syslog_message_t(&msg);
+}
+
+void test_iana_structured_data__leaves_missing_params_unset(void) {
+  syslog_message_t msg = {};
+
+  char * mm = "<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID "
+    "[meta sequenceId=\"0\"][exampleSDID@32473 ip=\"10.0.0.1\"] Logging message...";
+
+  if (!parse_syslog_message_t(mm, &msg)) {
+    cl_fail("Could not parse the syslog message");
+  }
+
+  cl_assert(!msg.iana.time_quality.present);
+  cl_assert(!msg.iana.origin.present);
+
+  // sequenceId must be at least 1
+  cl_assert(msg.iana.meta.present);
+  cl_assert(msg.iana.meta.sequence_id == -1);
+  cl_assert(msg.iana.meta.sys_up_time == -1);
+  cl_assert(msg.iana.meta.language == NULL);
+
+  free_syslog_message_t(&msg);
+}
@@ -0,0 +1,179 @@
+#include "test.h"
+#include "syslog_intern.h"
+#include "syslog_alloc.h"
+
+void test_intern__returns_stable_ids(void) {
+  syslog_intern_table_t * table = syslog_intern_table_new(0);
+
+  uint32_t a = syslog_intern(table, "hostname", 8);
+  uint32_t b = syslog_intern(table, "appname", 7);
+
+  cl_assert(a != SYSLOG_INTERN_NIL);
+  cl_assert(a != b);
+  cl_assert_equal_i(syslog_intern(table, "hostname", 8), a);
+  cl_assert_equal_i(syslog_intern(table, "", 0), SYSLOG_INTERN_NIL);
+
+  cl_assert_equal_s(syslog_intern_string(table, a), "hostname");
+  cl_assert_equal_i((int) syslog_intern_string_length(table, b), 7);
+  cl_assert_equal_i((int) syslog_intern_table_count(table), 2);
+
+  syslog_intern_table_free(table);
+}
+
+void test_intern__survives_growth(void) {
+  syslog_intern_table_t * table = syslog_intern_table_new(4);
+
+  const char* first = syslog_intern_string(table, syslog_intern(table, "host-0", 6));
+
+  char name[32];
+  int i;
+  for (i = 0; i < 5000; i++) {
+    int length = snprintf(name, sizeof(name), "host-%d", i);
+    cl_assert_equal_i(syslog_intern(table, name, length), i + 1);
+  }
+
+  cl_assert_equal_i((int) syslog_intern_table_count(table), 5000);
+  cl_assert_equal_s(syslog_intern_string(table, 4243), "host-4242");
+
+  // Canonical strings never move
+  cl_assert(first == syslog_intern_string(table, 1));
+
+  syslog_intern_table_free(table);
+}
+
+void test_intern__interns_messages(void) {
+  syslog_intern_table_t * table = syslog_intern_table_new(16);
+
+  syslog_message_t a = {};
+  syslog_message_t b = {};
+
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"] Logging message...", &a));
+  cl_assert(parse_syslog_message_t("<165>1 2016-12-16T12:00:00.000Z hostname appname 42 - [exampleSDID@32473 eventSource=\"Other\"] Another message", &b));
+
+  syslog_interned_message_t ia = {};
+  syslog_interned_message_t ib = {};
+
+  cl_assert(syslog_intern_message(table, &a, &ia));
+  cl_assert(syslog_intern_message(table, &b, &ib));
+
+  cl_assert_equal_i(ia.hostname, ib.hostname);
+  cl_assert_equal_i(ia.appname, ib.appname);
+  cl_assert(ia.message_id != SYSLOG_INTERN_NIL);
+  cl_assert_equal_i(ib.message_id, SYSLOG_INTERN_NIL);
+
+  cl_assert_equal_i((int) ia.structured_data_count, 1);
+  cl_assert_equal_i(ia.structured_data_ids[0], ib.structured_data_ids[0]);
+  cl_assert_equal_i((int) ia.param_count, 2);
+  cl_assert_equal_i(ia.param_name_ids[0], ib.param_name_ids[0]);
+  cl_assert_equal_s(syslog_intern_string(table, ia.param_name_ids[1]), "eventID");
+
+  free_syslog_interned_message_t(&ia);
+  free_syslog_interned_message_t(&ib);
+  free_syslog_message_t(&a);
+  free_syslog_message_t(&b);
+  syslog_intern_table_free(table);
+}
+
+void test_intern__interns_while_parsing(void) {
+  syslog_intern_table_t * table = syslog_intern_table_new(16);
+  syslog_parse_options_t options = {};
+  syslog_message_t a = {};
+  syslog_message_t b = {};
+
+  options.intern = table;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<165>1 - a-rather-long-hostname appname 42 MSGID [x@1 k=\"v\"] one", &a, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<165>1 - a-rather-long-hostname appname 43 - - two", &b, &options), SYSLOG_PARSE_OK);
+
+  cl_assert(a.hostname_id != SYSLOG_INTERN_NIL);
+  cl_assert_equal_i(a.hostname_id, b.hostname_id);
+  cl_assert_equal_i(a.appname_id, b.appname_id);
+  cl_assert_equal_i(b.message_id_id, SYSLOG_INTERN_NIL);
+
+  // Both point at the table's copy rather than their own
+  cl_assert(a.hostname == b.hostname);
+  cl_assert(a.hostname == syslog_intern_string(table, a.hostname_id));
+  cl_assert_equal_s(a.message_id, "MSGID");
+  cl_assert_equal_s(b.message_id, "");
+
+  cl_assert_equal_s(a.process_id, "42");
+  cl_assert_equal_s(a.message, "one");
+  cl_assert_equal_s(b.message, "two");
+
+  // So do SD-IDs and PARAM-NAMEs, but not their values
+  cl_assert_equal_s(a.structured_data[0].id, "x@1");
+  cl_assert(a.structured_data[0].id == syslog_intern_string(table, a.structured_data[0].interned_id));
+  cl_assert(a.structured_data[0].pairs[0].key == syslog_intern_string(table, a.structured_data[0].pairs[0].interned_key));
+  cl_assert_equal_s(a.structured_data[0].pairs[0].value, "v");
+
+  cl_assert_equal_i((int) syslog_intern_table_count(table), 5);
+
+  free_syslog_message_t(&a);
+  free_syslog_message_t(&b);
+
+  // Without a table there are no ids
+  cl_assert(parse_syslog_message_t("<165>1 - hostname appname 42 MSGID - one", &a));
+  cl_assert_equal_i(a.hostname_id, SYSLOG_INTERN_NIL);
+  cl_assert_equal_s(a.hostname, "hostname");
+  free_syslog_message_t(&a);
+
+  syslog_intern_table_free(table);
+}
+
+void test_intern__unescapes_sd_ids(void) {
+  syslog_intern_table_t * table = syslog_intern_table_new(16);
+  syslog_parse_options_t options = {};
+  syslog_message_t interned = {};
+  syslog_message_t copied = {};
+  const char* raw = "<165>1 - h a - - [id\\ x@1 k=\"v\"][y@1] m";
+
+  options.intern = table;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t(raw, &interned, &options), SYSLOG_PARSE_OK);
+  cl_assert(parse_syslog_message_t(raw, &copied));
+
+  cl_assert_equal_i((int) interned.structured_data_count, 2);
+  cl_assert_equal_s(interned.structured_data[0].id, copied.structured_data[0].id);
+  cl_assert_equal_s(interned.structured_data[0].pairs[0].key, "k");
+  cl_assert_equal_s(interned.structured_data[1].id, "y@1");
+  cl_assert_equal_i((int) interned.structured_data[1].num_pairs, 0);
+
+  free_syslog_message_t(&interned);
+  free_syslog_message_t(&copied);
+  syslog_intern_table_free(table);
+}
+
+void test_intern__saves_memory_while_parsing(void) {
+  syslog_intern_table_t * table = syslog_intern_table_new(16);
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+  syslog_alloc_stats_t copied, interned;
+  const char* raw = "<165>1 2016-12-16T12:00:00Z web-frontend-01.example.com nginx 42 ACCESS [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"] GET /";
+
+  // The first parse with the table fills it, after that nothing is added
+  options.intern = table;
+  cl_assert_equal_i(parse_syslog_message_with_options_t(raw, &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+
+  syslog_alloc_stats_reset();
+  cl_assert(parse_syslog_message_t(raw, &msg));
+  syslog_alloc_stats(&copied);
+  free_syslog_message_t(&msg);
+
+  syslog_alloc_stats_reset();
+  cl_assert_equal_i(parse_syslog_message_with_options_t(raw, &msg, &options), SYSLOG_PARSE_OK);
+  syslog_alloc_stats(&interned);
+  cl_assert_equal_s(msg.hostname, "web-frontend-01.example.com");
+  cl_assert_equal_s(msg.structured_data[0].pairs[1].key, "eventID");
+  free_syslog_message_t(&msg);
+
+#ifdef SYSLOG_ALLOC_STATS
+  cl_assert(interned.bytes_allocated < copied.bytes_allocated);
+  // What stays alive with the message, less the copies of the names
+  cl_assert(interned.live_bytes < copied.live_bytes);
+#else
+  cl_assert_equal_i((int) interned.bytes_allocated, 0);
+#endif
+
+  syslog_intern_table_free(table);
+}
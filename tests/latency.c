@@ -0,0 +1,75 @@
+#include <pthread.h>
+
+#include "test.h"
+#include "syslog_stats.h"
+
+// Histograms are global, so each test records into what is left over from the
+// ones before and only looks at the difference
+
+void test_latency__stamps_the_message(void) {
+  syslog_parse_options_t options = {};
+  syslog_latency_summary_t before, after;
+  syslog_message_t msg = {};
+
+  syslog_latency(SYSLOG_LATENCY_PARSE, &before);
+
+  options.received_ns = syslog_now_ns();
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - m", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert(msg.received_ns == options.received_ns);
+  cl_assert(msg.parsed_ns >= msg.received_ns);
+
+  syslog_latency(SYSLOG_LATENCY_PARSE, &after);
+  cl_assert_equal_i((int) (after.count - before.count), 1);
+
+  syslog_latency(SYSLOG_LATENCY_TOTAL, &before);
+  syslog_latency_emitted(&msg);
+  syslog_latency(SYSLOG_LATENCY_TOTAL, &after);
+  cl_assert_equal_i((int) (after.count - before.count), 1);
+
+  free_syslog_message_t(&msg);
+
+  // Without received_ns nothing is recorded
+  syslog_latency(SYSLOG_LATENCY_PARSE, &before);
+  cl_assert(parse_syslog_message_t("<13>1 - h a - - - m", &msg));
+  cl_assert(msg.received_ns == 0);
+  syslog_latency_emitted(&msg);
+  free_syslog_message_t(&msg);
+  syslog_latency(SYSLOG_LATENCY_PARSE, &after);
+  cl_assert(after.count == before.count);
+}
+
+static void* record_in_thread(void* arg) {
+  uint64_t i;
+
+  // 1us to 1ms, one of each
+  for (i = 1; i <= 1000; i++) {
+    syslog_latency_record(SYSLOG_LATENCY_SINK, i * 1000);
+  }
+
+  return NULL;
+}
+
+void test_latency__merges_threads_within_a_percent(void) {
+  syslog_latency_summary_t before, summary;
+  pthread_t threads[4];
+  int i;
+
+  // At most a sample or two left over, too few to move the percentiles
+  syslog_latency(SYSLOG_LATENCY_SINK, &before);
+
+  for (i = 0; i < 4; i++) {
+    cl_must_pass(pthread_create(&threads[i], NULL, record_in_thread, NULL));
+  }
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Every thread has exited, so this is all from their retired histograms
+  syslog_latency(SYSLOG_LATENCY_SINK, &summary);
+
+  cl_assert(summary.count - before.count == 4000);
+  cl_assert(summary.max_ns >= 1000000);
+  cl_assert(summary.p50_ns >= 500000 && summary.p50_ns <= 505000);
+  cl_assert(summary.p99_ns >= 990000 && summary.p99_ns <= 1000000);
+  cl_assert(summary.p999_ns >= 998000 && summary.p999_ns <= summary.max_ns);
+}
@@ -0,0 +1,78 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "syslog_metrics.h"
+
+static int64_t read_depth(void* user) {
+  return *(int *) user;
+}
+
+void test_metrics__renders_openmetrics_text(void) {
+  int depth = 17;
+  syslog_metrics_gauge_t gauge = { "receiver_queue_depth", "Messages waiting.", read_depth, &depth };
+  syslog_message_t msg = {};
+  char text[16384];
+
+  parse_syslog_message_t("<13>x", &msg);
+
+  size_t length = syslog_metrics_render(&gauge, 1, text, sizeof(text));
+  cl_assert(length < sizeof(text));
+  cl_assert_equal_i((int) strlen(text), (int) length);
+
+  cl_assert(strstr(text, "# TYPE syslog_messages counter\n"));
+  cl_assert(strstr(text, "syslog_parse_failures_total{reason=\"bad_version\"} "));
+  cl_assert(!strstr(text, "syslog_parse_failures_total{reason=\"bad_version\"} 0\n"));
+  cl_assert(strstr(text, "syslog_latency_seconds{stage=\"parse\",quantile=\"0.99\"} "));
+  cl_assert(strstr(text, "receiver_queue_depth 17\n"));
+  cl_assert_equal_s(text + length - 6, "# EOF\n");
+
+  // Too small a buffer still says how much was needed
+  char small[8];
+  cl_assert(syslog_metrics_render(&gauge, 1, small, sizeof(small)) == length);
+  cl_assert_equal_s(small, "# TYPE ");
+}
+
+static size_t fetch(uint16_t port, const char* request, char* response, size_t size) {
+  struct sockaddr_in address = {};
+  size_t length = 0;
+  ssize_t n;
+
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  cl_must_pass(connect(fd, (struct sockaddr *) &address, sizeof(address)));
+  cl_assert(send(fd, request, strlen(request), 0) == (ssize_t) strlen(request));
+
+  while (length < size - 1 && (n = recv(fd, response + length, size - 1 - length, 0)) > 0) {
+    length += n;
+  }
+  response[length] = '\0';
+
+  close(fd);
+  return length;
+}
+
+void test_metrics__serves_over_http(void) {
+  syslog_metrics_config_t config = {};
+  char response[16384];
+
+  syslog_metrics_server_t * server = syslog_metrics_server_start(&config);
+  cl_assert(server);
+  cl_assert(syslog_metrics_server_port(server) != 0);
+
+  fetch(syslog_metrics_server_port(server), "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", response, sizeof(response));
+  cl_assert(!strncmp(response, "HTTP/1.1 200 OK\r\n", 17));
+  cl_assert(strstr(response, "Content-Type: application/openmetrics-text"));
+  cl_assert(strstr(response, "syslog_messages_total "));
+  cl_assert(strstr(response, "# EOF\n"));
+
+  fetch(syslog_metrics_server_port(server), "GET / HTTP/1.1\r\n\r\n", response, sizeof(response));
+  cl_assert(!strncmp(response, "HTTP/1.1 404", 12));
+
+  syslog_metrics_server_stop(server);
+}
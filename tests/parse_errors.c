@@ -0,0 +1,81 @@
+#include <pthread.h>
+
+#include "test.h"
+#include "syslog_stats.h"
+
+static void assert_error(const char* mm, syslog_parse_error_t error, size_t offset) {
+  syslog_message_t msg = {};
+
+  cl_assert_(!parse_syslog_message_t(mm, &msg), mm);
+  cl_assert_equal_s(syslog_parse_error_name(msg.error), syslog_parse_error_name(error));
+  cl_assert_equal_i((int) msg.error_offset, (int) offset);
+}
+
+void test_parse_errors__says_why_and_where(void) {
+  assert_error("", SYSLOG_ERROR_EMPTY_INPUT, 0);
+  assert_error("<abc>1 - h a - - - m", SYSLOG_ERROR_BAD_PRI, 0);
+  assert_error("<200>1 - h a - - - m", SYSLOG_ERROR_BAD_PRI, 0);
+  assert_error("<13>123 - h a - - - m", SYSLOG_ERROR_BAD_VERSION, 4);
+  assert_error("<13>1 yesterday h a - - - m", SYSLOG_ERROR_BAD_TIMESTAMP, 6);
+  assert_error("<13>1 - h a -", SYSLOG_ERROR_MISSING_FIELD, 12);
+  assert_error("<13>1 - h a - - [id@1 a=\"b\" m", SYSLOG_ERROR_UNTERMINATED_SD, 16);
+  assert_error("<13>1 - h a - - [a@1][b@1 x=\"y\" m", SYSLOG_ERROR_UNTERMINATED_SD, 21);
+  assert_error("<13>1 - h a - - [a@1][", SYSLOG_ERROR_UNTERMINATED_SD, 21);
+}
+
+void test_parse_errors__clears_the_error_on_success(void) {
+  syslog_message_t msg = {};
+
+  cl_assert(!parse_syslog_message_t("<13>1", &msg));
+  cl_assert(msg.error != SYSLOG_ERROR_NONE);
+
+  cl_assert(parse_syslog_message_t("<13>1 2016-12-16T12:00:00Z h a - - - m", &msg));
+  cl_assert_equal_i(msg.error, SYSLOG_ERROR_NONE);
+  free_syslog_message_t(&msg);
+}
+
+static void* parse_in_thread(void* arg) {
+  syslog_message_t msg = {};
+  int i;
+
+  for (i = 0; i < 100; i++) {
+    if (parse_syslog_message_t("<13>1 - h a - - - m", &msg)) {
+      free_syslog_message_t(&msg);
+    }
+    parse_syslog_message_t("<13>x", &msg);
+  }
+
+  return NULL;
+}
+
+void test_parse_errors__counts_per_thread_and_in_total(void) {
+  syslog_parse_stats_t before, after, mine;
+  syslog_message_t msg = {};
+  pthread_t threads[4];
+  int i;
+
+  syslog_parse_stats(&before);
+
+  for (i = 0; i < 4; i++) {
+    cl_must_pass(pthread_create(&threads[i], NULL, parse_in_thread, NULL));
+  }
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  syslog_parse_stats_thread(&mine);
+  uint64_t my_messages = mine.messages;
+
+  cl_assert(!parse_syslog_message_t("<13>1 bad h a - - - m", &msg));
+
+  syslog_parse_stats_thread(&mine);
+  cl_assert(mine.messages == my_messages + 1);
+
+  syslog_parse_stats(&after);
+  cl_assert_equal_i((int) (after.messages - before.messages), 801);
+  cl_assert_equal_i((int) (after.parsed - before.parsed), 400);
+  cl_assert_equal_i((int) (after.failures - before.failures), 401);
+  cl_assert_equal_i((int) (after.failures_by_error[SYSLOG_ERROR_BAD_VERSION] - before.failures_by_error[SYSLOG_ERROR_BAD_VERSION]), 400);
+  cl_assert_equal_i((int) (after.failures_by_error[SYSLOG_ERROR_BAD_TIMESTAMP] - before.failures_by_error[SYSLOG_ERROR_BAD_TIMESTAMP]), 1);
+  cl_assert_equal_i((int) (after.bytes - before.bytes), 400 * 19 + 400 * 5 + 21);
+}
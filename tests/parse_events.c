@@ -0,0 +1,125 @@
+#include "test.h"
+
+typedef struct event_log_t {
+  char text[1024];
+  int abort_on_param;
+} event_log_t;
+
+static void log_span(event_log_t * log, const char* name, syslog_span_t span) {
+  size_t used = strlen(log->text);
+  snprintf(log->text + used, sizeof(log->text) - used, "%s=%.*s;", name, (int) span.length, span.data);
+}
+
+static int on_pri(void* user, int pri_value, int facility, int severity) {
+  event_log_t * log = user;
+  snprintf(log->text, sizeof(log->text), "pri=%d/%d/%d;", pri_value, facility, severity);
+  return 1;
+}
+
+static int on_hostname(void* user, syslog_span_t span) {
+  log_span(user, "host", span);
+  return 1;
+}
+
+static int on_appname(void* user, syslog_span_t span) {
+  log_span(user, "app", span);
+  return 1;
+}
+
+static int on_message_id(void* user, syslog_span_t span) {
+  log_span(user, "msgid", span);
+  return 1;
+}
+
+static int on_sd_element(void* user, syslog_span_t span) {
+  log_span(user, "sd", span);
+  return 1;
+}
+
+static int on_sd_param(void* user, syslog_span_t name, syslog_span_t value, int escaped) {
+  event_log_t * log = user;
+  log_span(log, escaped ? "escaped" : "param", name);
+  log_span(log, "value", value);
+  return !log->abort_on_param;
+}
+
+static int on_sd_element_end(void* user) {
+  syslog_span_t end = {"", 0};
+  log_span(user, "end", end);
+  return 1;
+}
+
+static int on_message(void* user, syslog_span_t span) {
+  log_span(user, "msg", span);
+  return 1;
+}
+
+static const syslog_handler_t handler = {
+  .on_pri = on_pri,
+  .on_hostname = on_hostname,
+  .on_appname = on_appname,
+  .on_message_id = on_message_id,
+  .on_sd_element = on_sd_element,
+  .on_sd_param = on_sd_param,
+  .on_sd_element_end = on_sd_element_end,
+  .on_message = on_message,
+};
+
+static syslog_parse_result_t parse(const char* mm, event_log_t * log) {
+  memset(log, 0, sizeof(event_log_t));
+  return syslog_parse_events(mm, strlen(mm), &handler, log);
+}
+
+void test_parse_events__reports_header_fields(void) {
+  event_log_t log;
+
+  cl_assert_equal_i(parse("<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID - Logging message...", &log), SYSLOG_PARSE_OK);
+  cl_assert_equal_s(log.text, "pri=165/20/5;host=hostname;app=appname;msgid=MSGID;msg=Logging message...;");
+
+  cl_assert_equal_i(parse("<0>1 - - - - -", &log), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(parse("<0>1 - - - - - -", &log), SYSLOG_PARSE_OK);
+  cl_assert_equal_s(log.text, "pri=0/0/0;host=;app=;msgid=;");
+}
+
+void test_parse_events__reports_structured_data(void) {
+  event_log_t log;
+
+  cl_assert_equal_i(parse("<165>1 - h a - - [id@1 a=\"1\" b=\"x\\\"y\"][id2] msg", &log), SYSLOG_PARSE_OK);
+  cl_assert_equal_s(log.text, "pri=165/20/5;host=h;app=a;msgid=;sd=id@1;param=a;value=1;escaped=b;value=x\\\"y;end=;sd=id2;end=;msg=msg;");
+}
+
+void test_parse_events__can_abort(void) {
+  event_log_t log;
+
+  memset(&log, 0, sizeof(log));
+  log.abort_on_param = 1;
+
+  const char* mm = "<165>1 - h a - - [id@1 a=\"1\" b=\"2\"] msg";
+  cl_assert_equal_i(syslog_parse_events(mm, strlen(mm), &handler, &log), SYSLOG_PARSE_ABORTED);
+  cl_assert_equal_s(log.text, "pri=165/20/5;host=h;app=a;msgid=;sd=id@1;param=a;value=1;");
+}
+
+void test_parse_events__rejects_garbage(void) {
+  event_log_t log;
+
+  cl_assert_equal_i(parse("", &log), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(parse("<abc>1 stuff", &log), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(parse("<192>1 - - - - - -", &log), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(parse("<165>1 - h a - - [id@1 a=\"1] msg", &log), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(parse("<165>1 - h a - - [id@1 a=1] msg", &log), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(parse("<165>1 - h a - - id@1 msg", &log), SYSLOG_PARSE_FAILED);
+
+  // Spans are bounded by len, not by a terminator
+  cl_assert_equal_i(syslog_parse_events("<165>1 - h a - - - msg", 7, &handler, &log), SYSLOG_PARSE_FAILED);
+}
+
+void test_parse_events__unescapes_values(void) {
+  const char* raw = "a\\\"b\\]c\\\\d\\e";
+  syslog_span_t value = {raw, strlen(raw)};
+  char out[32];
+
+  size_t length = syslog_sd_unescape(value, out);
+  out[length] = 0;
+
+  cl_assert_equal_s(out, "a\"b]c\\d\\e");
+}
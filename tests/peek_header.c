@@ -0,0 +1,51 @@
+#include "test.h"
+
+#define FALSE 0
+
+static void assert_field(const char* buf, size_t offset, size_t length, const char* expected) {
+  cl_assert_equal_i((int) length, (int) strlen(expected));
+  cl_assert(strncmp(buf + offset, expected, length) == 0);
+}
+
+void test_peek_header__decodes_the_header(void) {
+  syslog_header_t header;
+
+  const char* mm = "<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventID=\"1011\"] Logging message...";
+
+  cl_assert(syslog_peek_header(mm, strlen(mm), &header));
+
+  cl_assert_equal_i(header.pri_value, 165);
+  cl_assert_equal_i(header.facility, 20);
+  cl_assert_equal_i(header.severity, 5);
+  cl_assert_equal_i(header.version, 1);
+
+  assert_field(mm, header.hostname_offset, header.hostname_length, "hostname");
+  assert_field(mm, header.appname_offset, header.appname_length, "appname");
+  assert_field(mm, header.process_id_offset, header.process_id_length, "PROCID");
+  assert_field(mm, header.message_id_offset, header.message_id_length, "MSGID");
+
+  cl_assert(mm[header.structured_data_offset] == '[');
+}
+
+void test_peek_header__reports_nil_as_empty(void) {
+  syslog_header_t header;
+
+  const char* mm = "<7>1 - - - - - -";
+
+  cl_assert(syslog_peek_header(mm, strlen(mm), &header));
+  cl_assert_equal_i(header.severity, 7);
+  cl_assert_equal_i(header.facility, 0);
+  cl_assert_equal_i((int) header.hostname_length, 0);
+  cl_assert_equal_i((int) header.appname_length, 0);
+  cl_assert_equal_i((int) header.structured_data_offset, 15);
+}
+
+void test_peek_header__rejects_garbage(void) {
+  syslog_header_t header;
+
+  cl_assert_equal_i(syslog_peek_header(NULL, 0, &header), FALSE);
+  cl_assert_equal_i(syslog_peek_header("", 0, &header), FALSE);
+  cl_assert_equal_i(syslog_peek_header("<abc>1 - - - - - -", 18, &header), FALSE);
+  cl_assert_equal_i(syslog_peek_header("<165>123 - - - - - -", 20, &header), FALSE);
+  cl_assert_equal_i(syslog_peek_header("<165>1 - host app", 17, &header), FALSE);
+}
@@ -0,0 +1,114 @@
+#include "test.h"
+#include "syslog_ratelimit.h"
+
+#define SECOND 1000000000ULL
+
+static syslog_rate_decision_t from(syslog_rate_limiter_t * limiter, const char* hostname, int severity, uint64_t now_ns) {
+  return syslog_rate_limit(limiter, hostname, strlen(hostname), "app", 3, severity, now_ns);
+}
+
+void test_ratelimit__limits_each_source_separately(void) {
+  syslog_rate_limit_config_t config = { 2, 3, 64, 0, 0 };
+  syslog_rate_limiter_t * limiter = syslog_rate_limiter_new(&config);
+  cl_assert(limiter);
+
+  // The burst goes first
+  cl_assert_equal_i(from(limiter, "noisy", 6, SECOND), SYSLOG_RATE_KEEP);
+  cl_assert_equal_i(from(limiter, "noisy", 6, SECOND), SYSLOG_RATE_KEEP);
+  cl_assert_equal_i(from(limiter, "noisy", 6, SECOND), SYSLOG_RATE_KEEP);
+  cl_assert_equal_i(from(limiter, "noisy", 6, SECOND), SYSLOG_RATE_DROP);
+
+  // Other sources are not affected and severe messages always get through
+  cl_assert_equal_i(from(limiter, "quiet", 6, SECOND), SYSLOG_RATE_KEEP);
+  cl_assert_equal_i(from(limiter, "noisy", 0, SECOND), SYSLOG_RATE_KEEP);
+
+  // Half a second buys one more message at 2 a second
+  cl_assert_equal_i(from(limiter, "noisy", 6, SECOND + SECOND / 2), SYSLOG_RATE_KEEP);
+  cl_assert_equal_i(from(limiter, "noisy", 6, SECOND + SECOND / 2), SYSLOG_RATE_DROP);
+
+  syslog_rate_limiter_free(limiter);
+}
+
+void test_ratelimit__samples_over_the_limit(void) {
+  syslog_rate_limit_config_t config = { 0, 1, 16, -1, 4 };
+  syslog_rate_limiter_t * limiter = syslog_rate_limiter_new(&config);
+  int sampled = 0;
+  int i;
+
+  cl_assert_equal_i(from(limiter, "h", 0, 0), SYSLOG_RATE_KEEP);
+
+  for (i = 0; i < 4000; i++) {
+    syslog_rate_decision_t decision = from(limiter, "h", 0, 0);
+    cl_assert(decision != SYSLOG_RATE_KEEP);
+    sampled += decision == SYSLOG_RATE_SAMPLED;
+  }
+
+  cl_assert(sampled > 800 && sampled < 1200);
+
+  syslog_rate_limiter_free(limiter);
+}
+
+void test_ratelimit__stays_bounded_with_many_sources(void) {
+  syslog_rate_limit_config_t config = { 1, 1, 16, -1, 0 };
+  syslog_rate_limiter_t * limiter = syslog_rate_limiter_new(&config);
+  char hostname[32];
+  int i;
+
+  // Far more sources than slots, every new one still gets its burst
+  for (i = 0; i < 10000; i++) {
+    snprintf(hostname, sizeof(hostname), "host-%d", i);
+    cl_assert_equal_i(from(limiter, hostname, 6, i), SYSLOG_RATE_KEEP);
+  }
+
+  syslog_rate_limiter_free(limiter);
+}
+
+void test_ratelimit__drops_during_parse(void) {
+  syslog_rate_limit_config_t config = { 0, 1, 16, 2, 0 };
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.rate_limiter = syslog_rate_limiter_new(&config);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<14>1 - h a - - - one", &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<14>1 - h a - - - two", &msg, &options), SYSLOG_PARSE_FILTERED);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<10>1 - h a - - - three", &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+
+  syslog_rate_limiter_free(options.rate_limiter);
+}
+
+void test_ratelimit__weights_sampled_messages(void) {
+  syslog_rate_limit_config_t config = { 0, 1, 16, -1, 4 };
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+  int sampled = 0;
+  int i;
+
+  options.rate_limiter = syslog_rate_limiter_new(&config);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<14>1 - h a - - - first", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_i((int) msg.sample_weight, 1);
+  free_syslog_message_t(&msg);
+
+  // Everything kept from here on is a sample standing in for four messages
+  for (i = 0; i < 400; i++) {
+    syslog_parse_result_t result = parse_syslog_message_with_options_t("<14>1 - h a - - - more", &msg, &options);
+    if (result == SYSLOG_PARSE_OK) {
+      cl_assert_equal_i((int) msg.sample_weight, 4);
+      free_syslog_message_t(&msg);
+      sampled++;
+    } else {
+      cl_assert_equal_i(result, SYSLOG_PARSE_FILTERED);
+    }
+  }
+
+  cl_assert(sampled > 0);
+
+  syslog_rate_limiter_free(options.rate_limiter);
+
+  cl_assert(parse_syslog_message_t("<14>1 - h a - - - plain", &msg));
+  cl_assert_equal_i((int) msg.sample_weight, 1);
+  free_syslog_message_t(&msg);
+}
@@ -0,0 +1,48 @@
+#include "test.h"
+
+void test_shard_key__is_computed_during_parse(void) {
+  syslog_parse_options_t options = {};
+  syslog_message_t a = {};
+  syslog_message_t b = {};
+
+  options.shard_key_fields = SYSLOG_FIELD_HOSTNAME | SYSLOG_FIELD_APPNAME;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<14>1 - web-1 nginx 12 - - one", &a, &options), SYSLOG_PARSE_OK);
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<11>1 2016-12-16T12:00:00Z web-1 nginx 13 ID [x@1 a=\"b\"] two", &b, &options), SYSLOG_PARSE_OK);
+
+  cl_assert(a.shard_key != 0);
+  cl_assert(a.shard_key == b.shard_key);
+  cl_assert(a.shard_key == syslog_message_hash(&a, options.shard_key_fields));
+  // Only worked out when there is a dedup table to check it against
+  cl_assert(a.fingerprint == 0);
+
+  free_syslog_message_t(&a);
+  free_syslog_message_t(&b);
+
+  cl_assert(parse_syslog_message_t("<14>1 - web-1 nginx 12 - - one", &a));
+  cl_assert(a.shard_key == 0);
+  free_syslog_message_t(&a);
+}
+
+void test_shard_key__spreads_keys_consistently(void) {
+  int counts[10] = {};
+  uint64_t key;
+
+  for (key = 1; key <= 10000; key++) {
+    uint64_t h = key * 0x9e3779b97f4a7c15ULL;
+    uint32_t shard = syslog_shard(h, 10);
+    uint32_t grown = syslog_shard(h, 11);
+
+    cl_assert(shard < 10);
+    // Growing only ever moves keys onto the new shard
+    cl_assert(grown == shard || grown == 10);
+
+    counts[shard]++;
+  }
+
+  for (key = 0; key < 10; key++) {
+    cl_assert(counts[key] > 800 && counts[key] < 1200);
+  }
+
+  cl_assert_equal_i(syslog_shard(12345, 1), 0);
+}
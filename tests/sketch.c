@@ -0,0 +1,115 @@
+#include "test.h"
+#include "syslog_sketch.h"
+
+#define SECOND 1000000000ULL
+
+static void add(syslog_sketch_t * sketch, const char* mm, uint64_t now_ns) {
+  syslog_message_t msg = {};
+  cl_assert_(parse_syslog_message_t(mm, &msg), mm);
+  syslog_sketch_add(sketch, &msg, now_ns);
+  free_syslog_message_t(&msg);
+}
+
+void test_sketch__finds_heavy_hitters(void) {
+  syslog_sketch_config_t config = { 4, 60 * SECOND, 6 };
+  syslog_sketch_t * sketches[2] = { syslog_sketch_new(&config), syslog_sketch_new(&config) };
+  syslog_sketch_summary_t summary;
+  char mm[128];
+  int i;
+
+  // Two threads' worth: one noisy host among a lot of one-off ones
+  for (i = 0; i < 1000; i++) {
+    add(sketches[i & 1], "<11>1 - noisy app - - - crashed", SECOND);
+
+    snprintf(mm, sizeof(mm), "<14>1 - host-%d app - - [x@1 id=\"%d\"] fine", i, i % 100);
+    add(sketches[i & 1], mm, 2 * SECOND);
+  }
+
+  cl_assert(syslog_sketch_read(sketches, 2, 3 * SECOND, &summary));
+
+  cl_assert_equal_i((int) summary.messages, 2000);
+  cl_assert_equal_i((int) summary.severity_counts[3], 1000);
+  cl_assert_equal_i((int) summary.severity_counts[6], 1000);
+
+  cl_assert(summary.hostname_count == 4);
+  cl_assert_equal_s(summary.hostnames[0].name, "noisy");
+  cl_assert(summary.hostnames[0].count >= 1000);
+  cl_assert(summary.hostnames[0].count - summary.hostnames[0].error <= 1000);
+
+  cl_assert_equal_i((int) summary.appname_count, 1);
+  cl_assert_equal_s(summary.appnames[0].name, "app");
+  cl_assert_equal_i((int) summary.appnames[0].count, 2000);
+  cl_assert_equal_i((int) summary.message_id_count, 0);
+
+  cl_assert(summary.distinct_hostnames > 950 && summary.distinct_hostnames < 1050);
+  cl_assert(summary.distinct_sd_values > 95 && summary.distinct_sd_values < 105);
+
+  free_syslog_sketch_summary_t(&summary);
+
+  syslog_sketch_free(sketches[0]);
+  syslog_sketch_free(sketches[1]);
+}
+
+void test_sketch__forgets_what_left_the_window(void) {
+  syslog_sketch_config_t config = { 4, 60 * SECOND, 6 };
+  syslog_sketch_t * sketch = syslog_sketch_new(&config);
+  syslog_sketch_summary_t summary;
+
+  add(sketch, "<11>1 - old app - - - m", 0);
+  add(sketch, "<11>1 - new app - - - m", 50 * SECOND);
+
+  cl_assert(syslog_sketch_read(&sketch, 1, 55 * SECOND, &summary));
+  cl_assert_equal_i((int) summary.messages, 2);
+  free_syslog_sketch_summary_t(&summary);
+
+  cl_assert(syslog_sketch_read(&sketch, 1, 65 * SECOND, &summary));
+  cl_assert_equal_i((int) summary.messages, 1);
+  cl_assert_equal_s(summary.hostnames[0].name, "new");
+  free_syslog_sketch_summary_t(&summary);
+
+  // The bucket "old" was in gets reused
+  add(sketch, "<11>1 - newer app - - - m", 120 * SECOND);
+  cl_assert(syslog_sketch_read(&sketch, 1, 120 * SECOND, &summary));
+  cl_assert_equal_i((int) summary.messages, 1);
+  cl_assert_equal_s(summary.hostnames[0].name, "newer");
+  free_syslog_sketch_summary_t(&summary);
+
+  syslog_sketch_free(sketch);
+}
+
+void test_sketch__keeps_upper_bounds_when_merging(void) {
+  syslog_sketch_config_t config = { 2, 60 * SECOND, 6 };
+  syslog_sketch_t * sketch = syslog_sketch_new(&config);
+  syslog_sketch_summary_t summary;
+  int i;
+
+  // The first bucket ends up with a=5 and c=4 (3 of them error), having
+  // pushed b out after it was seen 3 times
+  for (i = 0; i < 5; i++) {
+    add(sketch, "<11>1 - a app - - - m", SECOND);
+  }
+  for (i = 0; i < 3; i++) {
+    add(sketch, "<11>1 - b app - - - m", SECOND);
+  }
+  add(sketch, "<11>1 - c app - - - m", SECOND);
+
+  // The second still has b
+  for (i = 0; i < 10; i++) {
+    add(sketch, "<11>1 - b app - - - m", 11 * SECOND);
+  }
+  add(sketch, "<11>1 - a app - - - m", 11 * SECOND);
+
+  cl_assert(syslog_sketch_read(&sketch, 1, 15 * SECOND, &summary));
+  cl_assert_equal_i((int) summary.hostname_count, 2);
+
+  // b was really seen 13 times and a 6
+  cl_assert_equal_s(summary.hostnames[0].name, "b");
+  cl_assert(summary.hostnames[0].count >= 13);
+  cl_assert(summary.hostnames[0].count - summary.hostnames[0].error <= 13);
+  cl_assert_equal_s(summary.hostnames[1].name, "a");
+  cl_assert(summary.hostnames[1].count >= 6);
+  cl_assert(summary.hostnames[1].count - summary.hostnames[1].error <= 6);
+
+  free_syslog_sketch_summary_t(&summary);
+  syslog_sketch_free(sketch);
+}
@@ -0,0 +1,111 @@
+#include "test.h"
+
+static void assert_strict_error(const char* mm, syslog_parse_error_t error, size_t offset) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.strict = 1;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t(mm, &msg, &options), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_s(syslog_parse_error_name(msg.error), syslog_parse_error_name(error));
+  cl_assert_equal_i((int) msg.error_offset, (int) offset);
+}
+
+static void assert_strict_ok(const char* mm) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.strict = 1;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t(mm, &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+}
+
+void test_strict__accepts_what_the_rfc_does(void) {
+  assert_strict_ok("<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 [exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"][examplePriority@32473 class=\"high\"] An application event");
+  assert_strict_ok("<13>1 - - - - - -");
+  assert_strict_ok("<13>12 - h a - - [esc@1 v=\"a \\\"b\\\" \\] c\\\\\"] m");
+  assert_strict_ok("<13>1 - h 012345678901234567890123456789012345678901234567 - - - m");
+}
+
+void test_strict__enforces_header_fields(void) {
+  char mm[512];
+
+  // The default parse lets these through
+  syslog_message_t msg = {};
+  cl_assert(parse_syslog_message_t("<13>0 - h a - - - m", &msg));
+  free_syslog_message_t(&msg);
+
+  assert_strict_error("<13>0 - h a - - - m", SYSLOG_ERROR_BAD_VERSION, 4);
+  assert_strict_error("<13>1x - h a - - - m", SYSLOG_ERROR_BAD_VERSION, 4);
+
+  // 49 byte APP-NAME
+  assert_strict_error("<13>1 - h 0123456789012345678901234567890123456789012345678 - - - m", SYSLOG_ERROR_FIELD_TOO_LONG, 10);
+  // 33 byte MSGID
+  assert_strict_error("<13>1 - h a - 012345678901234567890123456789012 - m", SYSLOG_ERROR_FIELD_TOO_LONG, 14);
+
+  memset(mm, 0, sizeof(mm));
+  strcpy(mm, "<13>1 - ");
+  memset(mm + 8, 'h', 256);
+  strcat(mm, " a - - - m");
+  assert_strict_error(mm, SYSLOG_ERROR_FIELD_TOO_LONG, 8);
+}
+
+void test_strict__finds_a_bad_byte_anywhere(void) {
+  static const char BAD[] = { 0x01, 0x7f, (char) 0x80, (char) 0xc3 };
+  char mm[80];
+  size_t at, i;
+
+  // Every position of a 44 byte HOSTNAME, so the SSE2, word at a time and
+  // byte at a time parts all see each bad byte
+  for (i = 0; i < sizeof(BAD); i++) {
+    for (at = 0; at < 44; at++) {
+      snprintf(mm, sizeof(mm), "<13>1 - %s a - - - m", "hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh");
+      mm[8 + at] = BAD[i];
+      assert_strict_error(mm, SYSLOG_ERROR_BAD_CHARACTER, 8);
+    }
+  }
+}
+
+void test_strict__finds_a_reserved_byte_anywhere_in_an_sd_name(void) {
+  static const char BAD[] = { '=', '"', 0x01, (char) 0x80 };
+  char mm[80];
+  size_t at, i;
+
+  // A 30 byte SD-ID goes through all three parts of the check as well
+  for (i = 0; i < sizeof(BAD); i++) {
+    for (at = 0; at < 30; at++) {
+      snprintf(mm, sizeof(mm), "<13>1 - h a - - [%s] m", "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+      mm[17 + at] = BAD[i];
+      assert_strict_error(mm, SYSLOG_ERROR_BAD_SD, 17 + at);
+    }
+  }
+}
+
+void test_strict__enforces_structured_data(void) {
+  assert_strict_error("<13>1 - h a - - -m", SYSLOG_ERROR_BAD_SD, 17);
+  assert_strict_error("<13>1 - h a - - [id=x a=\"b\"] m", SYSLOG_ERROR_BAD_SD, 19);
+  assert_strict_error("<13>1 - h a - - [id@1 a=\"b\"]m", SYSLOG_ERROR_BAD_SD, 28);
+  assert_strict_error("<13>1 - h a - - [id@1 a=b] m", SYSLOG_ERROR_BAD_SD, 24);
+  assert_strict_error("<13>1 - h a - - [id@1 a=\"b\" m", SYSLOG_ERROR_UNTERMINATED_SD, 16);
+  assert_strict_error("<13>1 - h a - - [id@1 a=\"b\"", SYSLOG_ERROR_UNTERMINATED_SD, 16);
+  // 33 byte SD-ID
+  assert_strict_error("<13>1 - h a - - [012345678901234567890123456789012] m", SYSLOG_ERROR_BAD_SD, 17);
+  // Anything but structured data
+  assert_strict_error("<13>1 - h a - - message", SYSLOG_ERROR_BAD_SD, 16);
+}
+
+void test_strict__rejects_oversized_messages_up_front(void) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.max_message_size = 19;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - m", &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - mm", &msg, &options), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(msg.error, SYSLOG_ERROR_MESSAGE_TOO_LONG);
+  cl_assert_equal_i((int) msg.error_offset, 19);
+  cl_assert(msg.raw_interned_message == NULL);
+}
@@ -1,4 +1,5 @@
 #include "test.h"
+#include "syslog_format.h"
 
 void test_syslog_message_with_structured_data__can_be_parsed(void) {
   syslog_message_t msg = {};
@@ -175,3 +176,62 @@ void test_syslog_message_with_structured_data__can_contain_escaped_characters(vo
   // ;
   // ;
 }
+
+void test_syslog_message_with_structured_data__can_find_params(void) {
+  syslog_message_t msg = {};
+
+  char * mm = "<165>1 2016-12-16T12:00:00.000Z hostname appname PROCID MSGID [exampleSDID@32473 eventSource=\"Application\" eventID=\"1011\"][origin ip=\"10.0.0.1\" ip=\"10.0.0.2\"][exampleSDID_2@32473 eventID=\"2022\"] Logging message...";
+
+  if (!parse_syslog_message_t(mm, &msg)) {
+    cl_fail("Could not parse the syslog message");
+  }
+
+  cl_assert(msg.structured_data_index == NULL);
+
+  cl_assert_equal_s(syslog_sd_find(&msg, "exampleSDID@32473", "eventID", 7), "1011");
+  cl_assert_equal_s(syslog_sd_find(&msg, "exampleSDID_2@32473", "eventID", 7), "2022");
+  cl_assert_equal_s(syslog_sd_find(&msg, "origin", "ip", 2), "10.0.0.1");
+
+  cl_assert(msg.structured_data_index != NULL);
+
+  cl_assert(syslog_sd_find(&msg, "origin", "eventID", 7) == NULL);
+  cl_assert(syslog_sd_find(&msg, "exampleSDID@32473", "event", 5) == NULL);
+  cl_assert(syslog_sd_find(&msg, "nope", "ip", 2) == NULL);
+
+  syslog_sd_key_t key = syslog_sd_key("exampleSDID@32473", "eventSource", 11);
+  cl_assert_equal_s(syslog_sd_find_key(&msg, &key), "Application");
+
+  free_syslog_message_t(&msg);
+
+  cl_assert(msg.structured_data_index == NULL);
+}
+
+void test_syslog_message_with_structured_data__keeps_backslashes_that_escape_nothing(void) {
+  syslog_message_t msg = {};
+  if (!parse_syslog_message_t("<165>1 2016-12-16T12:00:00.000Z hostname - - - [exampleSDID@32473 path=\"C:\\temp\"] Logging message...", &msg)) {
+    cl_fail("Could not parse the syslog message");
+  }
+
+  cl_assert_equal_s(msg.structured_data[0].pairs[0].value, "C:\\temp");
+
+  free_syslog_message_t(&msg);
+}
+
+void test_syslog_message_with_structured_data__drops_elements_it_cannot_parse(void) {
+  syslog_message_t msg = {};
+  char json[512];
+
+  // No SD-ID in the first one
+  cl_assert(parse_syslog_message_t("<13>1 - h a - - [ a=\"b\"][id@1 c=\"d\"] m", &msg));
+  cl_assert_equal_i((int) msg.structured_data_count, 1);
+  cl_assert_equal_s(msg.structured_data[0].id, "id@1");
+  cl_assert_equal_s(msg.message, "m");
+  cl_assert(syslog_format_json(&msg, json, sizeof(json)) < sizeof(json));
+  free_syslog_message_t(&msg);
+
+  cl_assert(parse_syslog_message_t("<13>1 - h a - - [ a=\"b\"] m", &msg));
+  cl_assert_equal_i((int) msg.structured_data_count, 0);
+  cl_assert(msg.structured_data == NULL);
+  cl_assert(syslog_format_json(&msg, json, sizeof(json)) < sizeof(json));
+  free_syslog_message_t(&msg);
+}
@@ -1 +1,21 @@
 #include "test.h"
+
+static void* counting_malloc(size_t size, void* user) {
+  ((counting_t *) user)->mallocs++;
+  return malloc(size);
+}
+
+static void* counting_realloc(void* ptr, size_t size, void* user) {
+  ((counting_t *) user)->reallocs++;
+  return realloc(ptr, size);
+}
+
+static void counting_free(void* ptr, void* user) {
+  ((counting_t *) user)->frees++;
+  free(ptr);
+}
+
+syslog_allocator_t counting_allocator(counting_t * counting) {
+  syslog_allocator_t allocator = { counting_malloc, counting_realloc, counting_free, counting };
+  return allocator;
+}
@@ -6,6 +6,18 @@
 
 /* Your custom shared includes / defines here */
 #include "syslog.h"
+#include "syslog_alloc.h"
 #include "time.h"
 
+// How many times each hook of counting_allocator was called
+typedef struct counting_t {
+  int mallocs;
+  int reallocs;
+  int frees;
+} counting_t;
+
+// An allocator that goes to malloc, realloc and free, counting every call
+// into counting
+syslog_allocator_t counting_allocator(counting_t * counting);
+
 #endif
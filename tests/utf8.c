@@ -0,0 +1,86 @@
+#include "test.h"
+#include "syslog_utf8.h"
+
+static int valid(const char* s) {
+  return syslog_utf8_validate(s, strlen(s));
+}
+
+void test_utf8__validates(void) {
+  cl_assert(valid(""));
+  cl_assert(valid("plain ascii"));
+  cl_assert(valid("caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 \xE6\x97\xA5\xE6\x9C\xAC"));
+  cl_assert(valid("\xED\x9F\xBF \xEE\x80\x80 \xF4\x8F\xBF\xBF"));
+
+  // Overlong forms
+  cl_assert(!valid("\xC0\x80"));
+  cl_assert(!valid("\xC1\xBF"));
+  cl_assert(!valid("\xE0\x80\x80"));
+  cl_assert(!valid("\xF0\x80\x80\x80"));
+  // Surrogates and past U+10FFFF
+  cl_assert(!valid("\xED\xA0\x80"));
+  cl_assert(!valid("\xF4\x90\x80\x80"));
+  cl_assert(!valid("\xF5\x80\x80\x80"));
+  // Stray continuation bytes and sequences cut short
+  cl_assert(!valid("\x80"));
+  cl_assert(!valid("a\xC3"));
+  cl_assert(!valid("\xE2\x82"));
+  cl_assert(!valid("\xE2\x82z"));
+  cl_assert(!valid("\xF0\x9F\x98"));
+}
+
+void test_utf8__finds_a_bad_byte_anywhere(void) {
+  char s[64];
+  size_t at;
+
+  // Every position of a run long enough for the 16 byte chunks and the tail
+  for (at = 0; at < 40; at++) {
+    memset(s, 'a', 40);
+    s[40] = '\0';
+    s[at] = (char) 0xFF;
+    cl_assert(!syslog_utf8_validate(s, 40));
+
+    s[at] = 'a';
+    cl_assert(syslog_utf8_validate(s, 40));
+  }
+}
+
+void test_utf8__strips_the_bom(void) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  cl_assert(parse_syslog_message_t("<13>1 - h a - - - \xEF\xBB\xBF" "caf\xC3\xA9", &msg));
+  cl_assert_equal_s(msg.message, "caf\xC3\xA9");
+  cl_assert(msg.has_bom);
+  cl_assert(!msg.is_utf8);
+  free_syslog_message_t(&msg);
+
+  options.validate_utf8 = 1;
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - caf\xC3\xA9", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert(!msg.has_bom);
+  cl_assert(msg.is_utf8);
+  free_syslog_message_t(&msg);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - caf\xE9", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert(!msg.is_utf8);
+  free_syslog_message_t(&msg);
+}
+
+void test_utf8__strict_holds_the_sender_to_the_bom(void) {
+  syslog_parse_options_t options = {};
+  syslog_message_t msg = {};
+
+  options.strict = 1;
+
+  // Without a BOM, MSG can be anything
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - caf\xE9", &msg, &options), SYSLOG_PARSE_OK);
+  free_syslog_message_t(&msg);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - \xEF\xBB\xBF" "caf\xC3\xA9", &msg, &options), SYSLOG_PARSE_OK);
+  cl_assert(msg.is_utf8);
+  free_syslog_message_t(&msg);
+
+  cl_assert_equal_i(parse_syslog_message_with_options_t("<13>1 - h a - - - \xEF\xBB\xBF" "caf\xE9", &msg, &options), SYSLOG_PARSE_FAILED);
+  cl_assert_equal_i(msg.error, SYSLOG_ERROR_BAD_UTF8);
+  cl_assert_equal_i((int) msg.error_offset, 18);
+}